@@ -32,8 +32,25 @@ static glui32 func_10_rl__pr(glui32 argc, glui32 *argv);
 static glui32 func_11_oc__cl(glui32 argc, glui32 *argv);
 static glui32 func_12_rv__pr(glui32 argc, glui32 *argv);
 static glui32 func_13_op__pr(glui32 argc, glui32 *argv);
+static glui32 func_256_rt__chldb(glui32 argc, glui32 *argv);
+static glui32 func_257_rt__chldw(glui32 argc, glui32 *argv);
+static glui32 func_258_rt__chstb(glui32 argc, glui32 *argv);
+static glui32 func_259_rt__chstw(glui32 argc, glui32 *argv);
+static glui32 func_260_dictionarylookup(glui32 argc, glui32 *argv);
+static glui32 func_261_tokenise(glui32 argc, glui32 *argv);
+static glui32 func_262_filter_putb(glui32 argc, glui32 *argv);
+static glui32 func_263_filter_putw(glui32 argc, glui32 *argv);
+static glui32 func_264_blkvalue_read(glui32 argc, glui32 *argv);
+static glui32 func_265_blkvalue_write(glui32 argc, glui32 *argv);
 
 static int obj_in_class(glui32 obj);
+static int rt_check_read(glui32 addr, glui32 len);
+static int rt_check_write(glui32 addr, glui32 len);
+static int tokenise_ready(void);
+static void tokenise(glui32 buf, glui32 tab);
+static void filter_put(glui32 ch, glui32 size);
+static glui32 blkvalue_seek(glui32 bv, glui32 pos, int indirect,
+    glui32 *sizeptr);
 static glui32 get_prop(glui32 obj, glui32 id);
 static glui32 get_prop_new(glui32 obj, glui32 id);
 
@@ -47,85 +64,298 @@ static glui32 string_metaclass = 0;  /* "String" class object */
 static glui32 self = 0;              /* address of global "self" */
 static glui32 num_attr_bytes = 0;    /* number of attributes / 8 */
 static glui32 cpv__start = 0;        /* array of common prop defaults */
+static glui32 rt_read_end = 0;       /* end of checked-readable memory */
+static glui32 rt_write_start = 0;    /* start of checked-writable memory */
+static glui32 rt_write_end = 0;      /* end of checked-writable memory */
+static glui32 dictionary_table = 0;  /* #dictionary_table */
+static glui32 dict_word_size = 0;    /* DICT_WORD_SIZE */
+static glui32 gg_tokenbuf = 0;       /* gg_tokenbuf array */
+static glui32 max_buffer_words = 0;  /* MAX_BUFFER_WORDS */
+static glui32 buffer2 = 0;           /* buffer2 array */
+static glui32 parse2 = 0;            /* parse2 array */
+static glui32 filter_buffer = 0;     /* output filter's array */
+static glui32 filter_count = 0;      /* address of its character count */
+static glui32 filter_limit = 0;      /* its capacity, in characters */
+static glui32 blk_header_n = 0;      /* BLK_HEADER_N */
+static glui32 blk_header_flags = 0;  /* BLK_HEADER_FLAGS */
+static glui32 blk_flag_multiple = 0; /* BLK_FLAG_MULTIPLE */
+static glui32 blk_flag_16_bit = 0;   /* BLK_FLAG_16_BIT */
+static glui32 blk_flag_word = 0;     /* BLK_FLAG_WORD */
+static glui32 blk_data_offset = 0;   /* BLK_DATA_OFFSET */
+static glui32 blk_data_multi_offset = 0; /* BLK_DATA_MULTI_OFFSET */
+static glui32 blk_next = 0;          /* BLK_NEXT */
+static glui32 blk_bvbitmap = 0;      /* BLK_BVBITMAP */
+
+/* An accelerated function can set this to say that it can't handle
+   the call after all. The VM then runs the original function instead. */
+int accel_fallback = FALSE;
+
+/* Every native function, with a bitmask of the @accelparam parameters
+   it depends on (bit N for parameter N). The scanner in accelscan.c
+   won't install a function until all of its parameters are known.
+
+   Functions 1 through 13 are defined by the Glulx spec. The functions
+   from 256 up are Glulxe extensions, numbered so that they will never
+   collide with future spec functions. A game can check for them with
+   gestalt selector 10 (AccelFunc), like any other.
+
+   Each of these must behave exactly like the game routine it replaces.
+   Where the game routine would print an error, the native version
+   doesn't try to reproduce it; it sets accel_fallback and lets the
+   real routine run. */
+typedef struct accelfunc_struct {
+    glui32 index;
+    acceleration_func func;
+    glui32 params;
+} accelfunc_t;
+
+static accelfunc_t accel_funcs[] = {
+    { 1, func_1_z__region, 0 },
+    { 2, func_2_cp__tab, 0 },
+    { 3, func_3_ra__pr, 0x0FF },
+    { 4, func_4_rl__pr, 0x0FF },
+    { 5, func_5_oc__cl, 0x0FF },
+    { 6, func_6_rv__pr, 0x1FF },
+    { 7, func_7_op__pr, 0x0FF },
+    { 8, func_8_cp__tab, 0x080 },
+    { 9, func_9_ra__pr, 0x0FF },
+    { 10, func_10_rl__pr, 0x0FF },
+    { 11, func_11_oc__cl, 0x0FF },
+    { 12, func_12_rv__pr, 0x1FF },
+    { 13, func_13_op__pr, 0x0FF },
+    { 256, func_256_rt__chldb, 0x200 },
+    { 257, func_257_rt__chldw, 0x200 },
+    { 258, func_258_rt__chstb, 0xC00 },
+    { 259, func_259_rt__chstw, 0xC00 },
+    { 260, func_260_dictionarylookup, 0x3F000 },
+    { 261, func_261_tokenise, 0x0F000 },
+    { 262, func_262_filter_putb, 0x1C0000 },
+    { 263, func_263_filter_putw, 0x1C0000 },
+    { 264, func_264_blkvalue_read, 0x1FC00000 },
+    { 265, func_265_blkvalue_write, 0x1FC00000 },
+    { 0, NULL, 0 }
+};
+
+/* The acceleration table is an open-addressed hash table, keyed by
+   function address, with linear probing. An address of zero marks an
+   empty slot (there can't be a function at address zero). Entries are
+   never removed; accelerating a function with index zero just clears
+   its func.
+
+   accel_get_func() is called on every function call, and nearly
+   always misses. So in front of the table there's a bitset with one
+   bit per hash value; a bit is set only if some accelerated function
+   hashes to it. A miss usually costs one load and a branch. The
+   bitset is rebuilt whenever the set of accelerated functions shrinks. */
 
 typedef struct accelentry_struct {
     glui32 addr;
     glui32 index;
     acceleration_func func;
-    struct accelentry_struct *next;
 } accelentry_t;
 
-#define ACCEL_HASH_SIZE (511)
-
-static accelentry_t **accelentries = NULL;
+/* Fibonacci hashing; the top bits of the product are well mixed. */
+#define ACCEL_HASH(addr) ((glui32)((addr) * 0x9E3779B1))
+
+#define ACCEL_FILTER_LOG2 (12)
+#define ACCEL_FILTER_WORDS ((1 << ACCEL_FILTER_LOG2) / 32)
+#define ACCEL_FILTER_BIT(hash) ((hash) >> (32 - ACCEL_FILTER_LOG2))
+
+#define ACCEL_TABLE_INITIAL (64)
+
+static accelentry_t *accelentries = NULL;
+static glui32 accel_table_size = 0; /* always a power of two */
+static glui32 accel_table_count = 0;
+static glui32 accel_filter[ACCEL_FILTER_WORDS];
+
+static accelentry_t *accel_find_entry(glui32 addr);
+static void accel_grow_table(void);
+static void accel_rebuild_filter(void);
+
+#if ACCEL_PLUGINS
+
+/* Functions registered by plugins, and the plugins themselves. See
+   accelplugin.h. */
+static accelfunc_t *plugin_funcs = NULL;
+static int num_plugin_funcs = 0;
+static int plugin_funcs_size = 0;
+static glulxe_accel_plugin_t *plugins = NULL;
+static int num_plugins = 0;
+
+static int plugin_register_func(uint32_t index, glulxe_accel_func_t func);
+static void plugin_set_func(uint32_t index, uint32_t addr);
+static uint32_t plugin_get_param(uint32_t index);
+static uint32_t plugin_mem_read(uint32_t addr, int len);
+static void plugin_mem_write(uint32_t addr, int len, uint32_t val);
+static uint32_t plugin_mem_size(void);
+static void plugin_fallback(void);
+static void plugin_fatal_error(char *msg);
+
+static const glulxe_accel_host_t accel_plugin_host = {
+    GLULXE_ACCEL_PLUGIN_VERSION,
+    plugin_register_func,
+    plugin_set_func,
+    plugin_get_param,
+    plugin_mem_read,
+    plugin_mem_write,
+    plugin_mem_size,
+    plugin_fallback,
+    plugin_fatal_error,
+};
+
+#endif /* ACCEL_PLUGINS */
 
 void init_accel()
 {
     accelentries = NULL;
+    accel_table_size = 0;
+    accel_table_count = 0;
+    accel_rebuild_filter();
 }
 
 acceleration_func accel_find_func(glui32 index)
 {
-    switch (index) {
-        case 0: return NULL; /* 0 always means no acceleration */
-        case 1: return func_1_z__region;
-        case 2: return func_2_cp__tab;
-        case 3: return func_3_ra__pr;
-        case 4: return func_4_rl__pr;
-        case 5: return func_5_oc__cl;
-        case 6: return func_6_rv__pr;
-        case 7: return func_7_op__pr;
-        case 8: return func_8_cp__tab;
-        case 9: return func_9_ra__pr;
-        case 10: return func_10_rl__pr;
-        case 11: return func_11_oc__cl;
-        case 12: return func_12_rv__pr;
-        case 13: return func_13_op__pr;
+    accelfunc_t *ent;
+    int ix;
+
+    if (index == 0)
+        return NULL; /* 0 always means no acceleration */
+    for (ent = accel_funcs; ent->func; ent++) {
+        if (ent->index == index)
+            return ent->func;
     }
+#if ACCEL_PLUGINS
+    for (ix=0; ix<num_plugin_funcs; ix++) {
+        if (plugin_funcs[ix].index == index)
+            return plugin_funcs[ix].func;
+    }
+#endif /* ACCEL_PLUGINS */
     return NULL;
 }
 
+/* accel_func_params():
+   Return the bitmask of parameters which function index depends on.
+   For a plugin function, or one we don't know, this is all ones; we
+   can't tell what it needs.
+*/
+glui32 accel_func_params(glui32 index)
+{
+    accelfunc_t *ent;
+
+    for (ent = accel_funcs; ent->func; ent++) {
+        if (ent->index == index)
+            return ent->params;
+    }
+    return 0xFFFFFFFF;
+}
+
 acceleration_func accel_get_func(glui32 addr)
 {
-    int bucknum;
-    accelentry_t *ptr;
+    glui32 hash = ACCEL_HASH(addr);
+    glui32 bit = ACCEL_FILTER_BIT(hash);
+    glui32 mask, pos;
+    accelentry_t *ent;
 
-    if (!accelentries)
+    if (!(accel_filter[bit >> 5] & (1U << (bit & 31))))
         return NULL;
 
-    bucknum = (addr % ACCEL_HASH_SIZE);
-    for (ptr = accelentries[bucknum]; ptr; ptr = ptr->next) {
-        if (ptr->addr == addr)
-            return ptr->func;
+    mask = accel_table_size - 1;
+    for (pos = (hash >> 8) & mask; ; pos = (pos+1) & mask) {
+        ent = &accelentries[pos];
+        if (ent->addr == addr)
+            return ent->func;
+        if (!ent->addr)
+            return NULL;
     }
-    return NULL;
 }
 
 /* Iterate the entire acceleration table, calling the callback for
    each (non-NULL) entry. This is used only for autosave. */
 void accel_iterate_funcs(void (*func)(glui32 index, glui32 addr))
 {
-    int bucknum;
-    accelentry_t *ptr;
+    glui32 pos;
+    accelentry_t *ent;
 
+    for (pos=0; pos<accel_table_size; pos++) {
+        ent = &accelentries[pos];
+        if (ent->addr && ent->func) {
+            func(ent->index, ent->addr);
+        }
+    }
+}
+
+/* Find the table slot for addr: either the entry which has it, or the
+   empty slot where it would go. The table must exist. */
+static accelentry_t *accel_find_entry(glui32 addr)
+{
+    glui32 mask = accel_table_size - 1;
+    glui32 pos;
+    accelentry_t *ent;
+
+    for (pos = (ACCEL_HASH(addr) >> 8) & mask; ; pos = (pos+1) & mask) {
+        ent = &accelentries[pos];
+        if (ent->addr == addr || !ent->addr)
+            return ent;
+    }
+}
+
+/* Double the size of the table (or create it), rehashing every entry. */
+static void accel_grow_table()
+{
+    accelentry_t *oldentries = accelentries;
+    glui32 oldsize = accel_table_size;
+    glui32 pos;
+    accelentry_t *ent;
+
+    if (!oldsize)
+        accel_table_size = ACCEL_TABLE_INITIAL;
+    else
+        accel_table_size = 2 * oldsize;
+
+    accelentries = (accelentry_t *)glulx_malloc(accel_table_size
+        * sizeof(accelentry_t));
     if (!accelentries)
-        return;
+        fatal_error("Cannot malloc acceleration table.");
+    for (pos=0; pos<accel_table_size; pos++) {
+        accelentries[pos].addr = 0;
+        accelentries[pos].index = 0;
+        accelentries[pos].func = NULL;
+    }
 
-    for (bucknum=0; bucknum<ACCEL_HASH_SIZE; bucknum++) {
-        for (ptr = accelentries[bucknum]; ptr; ptr = ptr->next) {
-            if (ptr->func) {
-                func(ptr->index, ptr->addr);
-            }
+    for (pos=0; pos<oldsize; pos++) {
+        if (oldentries[pos].addr) {
+            ent = accel_find_entry(oldentries[pos].addr);
+            *ent = oldentries[pos];
+        }
+    }
+
+    if (oldentries)
+        glulx_free(oldentries);
+}
+
+static void accel_rebuild_filter()
+{
+    glui32 pos, bit;
+    accelentry_t *ent;
+
+    for (pos=0; pos<ACCEL_FILTER_WORDS; pos++)
+        accel_filter[pos] = 0;
+
+    for (pos=0; pos<accel_table_size; pos++) {
+        ent = &accelentries[pos];
+        if (ent->addr && ent->func) {
+            bit = ACCEL_FILTER_BIT(ACCEL_HASH(ent->addr));
+            accel_filter[bit >> 5] |= (1U << (bit & 31));
         }
     }
 }
 
 void accel_set_func(glui32 index, glui32 addr)
 {
-    int bucknum;
-    accelentry_t *ptr;
+    accelentry_t *ent;
     int functype;
     acceleration_func new_func = NULL;
+    glui32 bit;
 
     /* Check the Glulx type identifier byte. */
     functype = Mem1(addr);
@@ -133,41 +363,151 @@ void accel_set_func(glui32 index, glui32 addr)
         fatal_error_i("Attempt to accelerate non-function.", addr);
     }
 
-    if (!accelentries) {
-        accelentries = (accelentry_t **)glulx_malloc(ACCEL_HASH_SIZE 
-            * sizeof(accelentry_t *));
-        if (!accelentries) 
-            fatal_error("Cannot malloc acceleration table.");
-        for (bucknum=0; bucknum<ACCEL_HASH_SIZE; bucknum++)
-            accelentries[bucknum] = NULL;
-    }
-
     new_func = accel_find_func(index);
     /* Might be NULL, if the index is zero or not recognized. */
 
-    bucknum = (addr % ACCEL_HASH_SIZE);
-    for (ptr = accelentries[bucknum]; ptr; ptr = ptr->next) {
-        if (ptr->addr == addr)
-            break;
-    }
-    if (!ptr) {
+    ent = (accelentries ? accel_find_entry(addr) : NULL);
+    if (!ent || !ent->addr) {
         if (!new_func) {
             return; /* no need for a new entry */
         }
-        ptr = (accelentry_t *)glulx_malloc(sizeof(accelentry_t));
-        if (!ptr)
-            fatal_error("Cannot malloc acceleration entry.");
-        ptr->addr = addr;
-        ptr->index = 0;
-        ptr->func = NULL;
-        ptr->next = accelentries[bucknum];
-        accelentries[bucknum] = ptr;
+        /* Keep the table at most half full. */
+        if (2 * (accel_table_count+1) > accel_table_size) {
+            accel_grow_table();
+        }
+        ent = accel_find_entry(addr);
+        ent->addr = addr;
+        ent->index = 0;
+        ent->func = NULL;
+        accel_table_count++;
+    }
+
+    ent->index = index;
+    if (ent->func && !new_func) {
+        ent->func = NULL;
+        accel_rebuild_filter();
+    }
+    else {
+        ent->func = new_func;
+        if (new_func) {
+            bit = ACCEL_FILTER_BIT(ACCEL_HASH(addr));
+            accel_filter[bit >> 5] |= (1U << (bit & 31));
+        }
+    }
+}
+
+#if ACCEL_PLUGINS
+
+/* accel_load_plugin():
+   Initialize an accelerator plugin, given its init function. Returns
+   FALSE if the plugin refuses to start or was built for a different
+   version of the interface.
+*/
+int accel_load_plugin(glulxe_accel_plugin_init_t initfunc)
+{
+    glulxe_accel_plugin_t plugin;
+
+    plugin.version = 0;
+    plugin.game_start = NULL;
+
+    if (!initfunc(&accel_plugin_host, &plugin))
+        return FALSE;
+    if (plugin.version != GLULXE_ACCEL_PLUGIN_VERSION)
+        return FALSE;
+
+    if (!plugins)
+        plugins = (glulxe_accel_plugin_t *)glulx_malloc(sizeof(glulxe_accel_plugin_t));
+    else
+        plugins = (glulxe_accel_plugin_t *)glulx_realloc(plugins, (num_plugins+1) * sizeof(glulxe_accel_plugin_t));
+    if (!plugins)
+        fatal_error("Cannot malloc plugin table.");
+    plugins[num_plugins] = plugin;
+    num_plugins++;
+    return TRUE;
+}
+
+/* accel_start_plugins():
+   Let each plugin look at the newly-loaded game.
+*/
+void accel_start_plugins()
+{
+    int ix;
+
+    for (ix=0; ix<num_plugins; ix++) {
+        if (plugins[ix].game_start)
+            plugins[ix].game_start();
     }
+}
 
-    ptr->index = index;
-    ptr->func = new_func;
+static int plugin_register_func(uint32_t index, glulxe_accel_func_t func)
+{
+    if (!func || !index || accel_find_func(index))
+        return FALSE;
+
+    if (num_plugin_funcs >= plugin_funcs_size) {
+        plugin_funcs_size = 2*plugin_funcs_size + 8;
+        if (!plugin_funcs)
+            plugin_funcs = (accelfunc_t *)glulx_malloc(plugin_funcs_size * sizeof(accelfunc_t));
+        else
+            plugin_funcs = (accelfunc_t *)glulx_realloc(plugin_funcs, plugin_funcs_size * sizeof(accelfunc_t));
+        if (!plugin_funcs)
+            fatal_error("Cannot malloc plugin function table.");
+    }
+    plugin_funcs[num_plugin_funcs].index = index;
+    plugin_funcs[num_plugin_funcs].func = (acceleration_func)func;
+    plugin_funcs[num_plugin_funcs].params = 0xFFFFFFFF;
+    num_plugin_funcs++;
+    return TRUE;
+}
+
+static void plugin_set_func(uint32_t index, uint32_t addr)
+{
+    accel_set_func(index, addr);
+}
+
+static uint32_t plugin_get_param(uint32_t index)
+{
+    return accel_get_param(index);
+}
+
+static uint32_t plugin_mem_read(uint32_t addr, int len)
+{
+    switch (len) {
+        case 1: return Mem1(addr);
+        case 2: return Mem2(addr);
+        case 4: return Mem4(addr);
+    }
+    fatal_error_i("Plugin memory read of invalid length.", len);
+    return 0;
+}
+
+static void plugin_mem_write(uint32_t addr, int len, uint32_t val)
+{
+    switch (len) {
+        case 1: MemW1(addr, val & 0xFF); return;
+        case 2: MemW2(addr, val & 0xFFFF); return;
+        case 4: MemW4(addr, val); return;
+    }
+    fatal_error_i("Plugin memory write of invalid length.", len);
+}
+
+static uint32_t plugin_mem_size()
+{
+    return endmem;
 }
 
+static void plugin_fallback()
+{
+    accel_fallback = TRUE;
+}
+
+static void plugin_fatal_error(char *msg)
+{
+    fatal_error(msg);
+}
+
+#endif /* ACCEL_PLUGINS */
+
 void accel_set_param(glui32 index, glui32 val)
 {
     switch (index) {
@@ -180,13 +520,34 @@ void accel_set_param(glui32 index, glui32 val)
         case 6: self = val; break;
         case 7: num_attr_bytes = val; break;
         case 8: cpv__start = val; break;
+        case 9: rt_read_end = val; break;
+        case 10: rt_write_start = val; break;
+        case 11: rt_write_end = val; break;
+        case 12: dictionary_table = val; break;
+        case 13: dict_word_size = val; break;
+        case 14: gg_tokenbuf = val; break;
+        case 15: max_buffer_words = val; break;
+        case 16: buffer2 = val; break;
+        case 17: parse2 = val; break;
+        case 18: filter_buffer = val; break;
+        case 19: filter_count = val; break;
+        case 20: filter_limit = val; break;
+        case 21: blk_header_n = val; break;
+        case 22: blk_header_flags = val; break;
+        case 23: blk_flag_multiple = val; break;
+        case 24: blk_flag_16_bit = val; break;
+        case 25: blk_flag_word = val; break;
+        case 26: blk_data_offset = val; break;
+        case 27: blk_data_multi_offset = val; break;
+        case 28: blk_next = val; break;
+        case 29: blk_bvbitmap = val; break;
     }
 }
 
 /* This is used only for autosave. */
 glui32 accel_get_param_count()
 {
-    return 9;
+    return 30;
 }
 
 /* This is used only for autosave. */
@@ -202,6 +563,27 @@ glui32 accel_get_param(glui32 index)
         case 6: return self;
         case 7: return num_attr_bytes;
         case 8: return cpv__start;
+        case 9: return rt_read_end;
+        case 10: return rt_write_start;
+        case 11: return rt_write_end;
+        case 12: return dictionary_table;
+        case 13: return dict_word_size;
+        case 14: return gg_tokenbuf;
+        case 15: return max_buffer_words;
+        case 16: return buffer2;
+        case 17: return parse2;
+        case 18: return filter_buffer;
+        case 19: return filter_count;
+        case 20: return filter_limit;
+        case 21: return blk_header_n;
+        case 22: return blk_header_flags;
+        case 23: return blk_flag_multiple;
+        case 24: return blk_flag_16_bit;
+        case 25: return blk_flag_word;
+        case 26: return blk_data_offset;
+        case 27: return blk_data_multi_offset;
+        case 28: return blk_next;
+        case 29: return blk_bvbitmap;
         default: return 0;
     }
 }
@@ -211,6 +593,7 @@ static void accel_error(char *msg)
     glui32 mode, rock;
     stream_get_iosys(&mode, &rock);
     if (mode == 2) { /* iosys_Glk */
+        stream_flush_output();
         glk_put_char('\n');
         glk_put_string(msg);
         glk_put_char('\n');
@@ -690,3 +1073,405 @@ static glui32 func_13_op__pr(glui32 argc, glui32 *argv)
 
     return ((func_9_ra__pr(argc, argv)) ? 1 : 0);
 }
+
+/* Here are the extended functions. The RT__Ch functions replace the
+   Inform veneer routines which do bounds-checked array access, when
+   the game is compiled in strict mode. The game sets parameter 9 to
+   the end of the memory its RT__ChLDB/RT__ChLDW accept, and parameters
+   10 and 11 to the range its RT__ChSTB/RT__ChSTW accept. If an access
+   falls outside that range (or the parameters were never set), we fall
+   back to the game routine, which will print its own error. As with
+   any routine that runs off its end, the store functions return 1. */
+
+static int rt_check_read(glui32 addr, glui32 len)
+{
+    glui32 limit = rt_read_end;
+    if (limit > endmem)
+        limit = endmem;
+    if (addr >= limit || limit - addr < len) {
+        accel_fallback = TRUE;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static int rt_check_write(glui32 addr, glui32 len)
+{
+    glui32 start = rt_write_start;
+    glui32 limit = rt_write_end;
+    if (start < ramstart)
+        start = ramstart;
+    if (limit > endmem)
+        limit = endmem;
+    if (addr < start || addr >= limit || limit - addr < len) {
+        accel_fallback = TRUE;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static glui32 func_256_rt__chldb(glui32 argc, glui32 *argv)
+{
+    glui32 addr;
+
+    addr = ARG_IF_GIVEN(argv, argc, 0) + ARG_IF_GIVEN(argv, argc, 1);
+    if (!rt_check_read(addr, 1))
+        return 0;
+    return Mem1(addr);
+}
+
+static glui32 func_257_rt__chldw(glui32 argc, glui32 *argv)
+{
+    glui32 addr;
+
+    addr = ARG_IF_GIVEN(argv, argc, 0) + 4 * ARG_IF_GIVEN(argv, argc, 1);
+    if (!rt_check_read(addr, 4))
+        return 0;
+    return Mem4(addr);
+}
+
+static glui32 func_258_rt__chstb(glui32 argc, glui32 *argv)
+{
+    glui32 addr;
+
+    addr = ARG_IF_GIVEN(argv, argc, 0) + ARG_IF_GIVEN(argv, argc, 1);
+    if (!rt_check_write(addr, 1))
+        return 0;
+    MemW1(addr, ARG_IF_GIVEN(argv, argc, 2) & 0xFF);
+    return 1;
+}
+
+static glui32 func_259_rt__chstw(glui32 argc, glui32 *argv)
+{
+    glui32 addr;
+
+    addr = ARG_IF_GIVEN(argv, argc, 0) + 4 * ARG_IF_GIVEN(argv, argc, 1);
+    if (!rt_check_write(addr, 4))
+        return 0;
+    MemW4(addr, ARG_IF_GIVEN(argv, argc, 2));
+    return 1;
+}
+
+/* The parser functions replace DictionaryLookup and Tokenise__ from
+   the Inform parser (Glulx version, with one-byte dictionary words).
+   They need the dictionary table, DICT_WORD_SIZE, the gg_tokenbuf
+   array, and MAX_BUFFER_WORDS (parameters 12 to 15); DictionaryLookup
+   also needs the buffer2 and parse2 arrays (16 and 17). If any of
+   these are unset, we fall back to the game routine.
+
+   Like the Inform code, the tokeniser splits words at spaces, and
+   treats each period, comma, and double-quote as a word of its own.
+   Words are lower-cased with glk_char_to_lower(), clipped or padded
+   to DICT_WORD_SIZE in gg_tokenbuf, and looked up with the same binary
+   search that the game's @binarysearch would do. */
+
+static int tokenise_ready()
+{
+    if (!dictionary_table || !dict_word_size || !gg_tokenbuf
+        || !max_buffer_words) {
+        accel_fallback = TRUE;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void tokenise(glui32 buf, glui32 tab)
+{
+    glsi32 cx, bx, len, numwords, wx, wlen, wpos, ix;
+    glui32 ch, dictlen, entrylen, res;
+
+    len = Mem4(buf);
+    buf += 4;
+
+    cx = 0;
+    numwords = 0;
+    while (cx < len) {
+        while (cx < len && Mem1(buf+cx) == ' ')
+            cx++;
+        if (cx >= len)
+            break;
+        bx = cx;
+        ch = Mem1(buf+cx);
+        if (ch == '.' || ch == ',' || ch == '"') {
+            cx++;
+        }
+        else {
+            while (cx < len) {
+                ch = Mem1(buf+cx);
+                if (ch == ' ' || ch == '.' || ch == ',' || ch == '"')
+                    break;
+                cx++;
+            }
+        }
+        MemW4(tab + 4*(numwords*3+2), cx-bx);
+        MemW4(tab + 4*(numwords*3+3), 4+bx);
+        numwords++;
+        if (numwords >= (glsi32)max_buffer_words)
+            break;
+    }
+    MemW4(tab, numwords);
+
+    dictlen = Mem4(dictionary_table);
+    entrylen = dict_word_size + 7;
+
+    for (wx=0; wx<numwords; wx++) {
+        wlen = Mem4(tab + 4*(wx*3+2));
+        wpos = Mem4(tab + 4*(wx*3+3));
+
+        if (wlen > (glsi32)dict_word_size)
+            wlen = dict_word_size;
+        cx = wpos - 4;
+        for (ix=0; ix<wlen; ix++)
+            MemW1(gg_tokenbuf+ix, glk_char_to_lower(Mem1(buf+cx+ix)));
+        for (; ix<(glsi32)dict_word_size; ix++)
+            MemW1(gg_tokenbuf+ix, 0);
+
+        /* @binarysearch gg_tokenbuf DICT_WORD_SIZE dict+4 entrylen
+           dictlen 1 1 res; */
+        res = binary_search(gg_tokenbuf, dict_word_size,
+            dictionary_table+4, entrylen, dictlen, 1, 1);
+        MemW4(tab + 4*(wx*3+1), res);
+    }
+}
+
+static glui32 func_260_dictionarylookup(glui32 argc, glui32 *argv)
+{
+    glui32 b;
+    glsi32 l, ix;
+
+    if (!tokenise_ready())
+        return 0;
+    if (!buffer2 || !parse2) {
+        accel_fallback = TRUE;
+        return 0;
+    }
+
+    b = ARG_IF_GIVEN(argv, argc, 0);
+    l = ARG_IF_GIVEN(argv, argc, 1);
+
+    for (ix=0; ix<l; ix++)
+        MemW1(buffer2+4+ix, Mem1(b+ix));
+    MemW4(buffer2, l);
+    tokenise(buffer2, parse2);
+    return Mem4(parse2+4);
+}
+
+static glui32 func_261_tokenise(glui32 argc, glui32 *argv)
+{
+    if (!tokenise_ready())
+        return 0;
+
+    tokenise(ARG_IF_GIVEN(argv, argc, 0), ARG_IF_GIVEN(argv, argc, 1));
+    return 1;
+}
+
+/* The filter functions are for games which print into an array by
+   setting iosys to Filter mode, with a filter function like
+
+     [ FilterPut ch  n;
+         n = filter_count-->0;
+         if (n < FILTER_LIMIT)
+             filter_buffer->n = ch;
+         filter_count-->0 = n+1;
+         return 0;
+     ];
+
+   (or filter_buffer-->n, for a word array). Parameters 18 to 20 are
+   the array, the address of the count, and the limit. When the filter
+   function is accelerated, the interpreter calls the native code for
+   each character directly, without entering the VM at all. If the
+   parameters are unset, or point outside RAM, we fall back to the game
+   routine. */
+
+static void filter_put(glui32 ch, glui32 size)
+{
+    glui32 count, addr;
+
+    if (!filter_buffer || !filter_count
+        || filter_count < ramstart || filter_count > endmem - 4) {
+        accel_fallback = TRUE;
+        return;
+    }
+
+    count = Mem4(filter_count);
+    if (count < filter_limit) {
+        addr = filter_buffer + count * size;
+        if (addr < ramstart || addr > endmem - size
+            || count > (0xFFFFFFFF - filter_buffer) / size) {
+            accel_fallback = TRUE;
+            return;
+        }
+        if (size == 1)
+            MemW1(addr, ch & 0xFF);
+        else
+            MemW4(addr, ch);
+    }
+    MemW4(filter_count, count+1);
+}
+
+static glui32 func_262_filter_putb(glui32 argc, glui32 *argv)
+{
+    filter_put(ARG_IF_GIVEN(argv, argc, 0), 1);
+    return 0;
+}
+
+static glui32 func_263_filter_putw(glui32 argc, glui32 *argv)
+{
+    filter_put(ARG_IF_GIVEN(argv, argc, 0), 4);
+    return 0;
+}
+
+/* The BlkValue functions are the Inform 7 template's BlkValueRead and
+   BlkValueWrite (BlockValues.i6t). Every operation on texts, lists and
+   relations goes through them, one entry at a time:
+
+     [ BlkValueRead from pos do_not_indirect  long_block ...;
+         if (from == 0) return 0;
+         if (do_not_indirect) long_block = from;
+         else long_block = BlkValueGetLongBlock(from);
+         flags = long_block->BLK_HEADER_FLAGS;
+         ...
+         seek_byte_position = pos*entry_size_in_bytes;
+         for (:long_block~=NULL:long_block=long_block-->BLK_NEXT) {
+             chunk_size_in_bytes = FlexSize(long_block) - header_size_in_bytes;
+             if ((seek_byte_position >= 0) &&
+                 (seek_byte_position<chunk_size_in_bytes)) { ... }
+             seek_byte_position = seek_byte_position - chunk_size_in_bytes;
+         }
+         "*** BlkValueRead: reading from index out of range: ", ...
+     ];
+
+   Parameters 21 to 29 are the template's layout constants, in the
+   order BLK_HEADER_N, BLK_HEADER_FLAGS, BLK_FLAG_MULTIPLE,
+   BLK_FLAG_16_BIT, BLK_FLAG_WORD, BLK_DATA_OFFSET,
+   BLK_DATA_MULTI_OFFSET, BLK_NEXT, BLK_BVBITMAP. (The last is zero for
+   releases without short blocks.) These vary between releases, which
+   is why they're parameters rather than built in.
+
+   Anything the native code can't reproduce exactly falls back to the
+   game routine: an index out of range (which prints an error), a short
+   block holding a bitmap rather than a pointer, a block outside
+   memory, or a write that doesn't set do_not_indirect. (That one goes
+   through BlkMakeMutable, which may copy the block.) */
+
+#define BLK_MAX_CHAIN (0x10000)
+
+static glui32 blkvalue_seek(glui32 bv, glui32 pos, int indirect,
+    glui32 *sizeptr)
+{
+    glui32 block, val, flags, size, header, seek, bsize;
+    glsi32 chunk;
+    int count;
+
+    if (!blk_header_flags || !blk_data_offset || !blk_data_multi_offset
+        || !blk_next || blk_next > 0x3FFFFFFF)
+        goto fallback;
+
+    block = bv;
+    if (indirect) {
+        if (bv > endmem - 4)
+            goto fallback;
+        val = Mem4(bv);
+        if (val) {
+            if ((val & blk_bvbitmap) == val)
+                goto fallback;
+            block = val;
+        }
+    }
+
+    if (block >= endmem || blk_header_flags >= endmem - block)
+        goto fallback;
+    flags = Mem1(block + blk_header_flags);
+    size = 1;
+    if (flags & blk_flag_16_bit)
+        size = 2;
+    else if (flags & blk_flag_word)
+        size = 4;
+    if (flags & blk_flag_multiple)
+        header = blk_data_multi_offset;
+    else
+        header = blk_data_offset;
+
+    seek = pos * size;
+    for (count=0; block; count++) {
+        if (count >= BLK_MAX_CHAIN
+            || block >= endmem || blk_header_n >= endmem - block
+            || endmem - block < 4 || 4*blk_next > endmem - block - 4)
+            goto fallback;
+        val = Mem1(block + blk_header_n);
+        if (val > 30)
+            goto fallback;
+        bsize = (1 << val);
+        chunk = (glsi32)(bsize - header);
+        if ((glsi32)seek >= 0 && (glsi32)seek < chunk) {
+            val = block + header + seek;
+            if (val < block || val >= endmem || size > endmem - val)
+                goto fallback;
+            *sizeptr = size;
+            return val;
+        }
+        seek -= (glui32)chunk;
+        block = Mem4(block + 4*blk_next);
+    }
+
+ fallback:
+    accel_fallback = TRUE;
+    return 0;
+}
+
+static glui32 func_264_blkvalue_read(glui32 argc, glui32 *argv)
+{
+    glui32 bv, addr, size;
+
+    bv = ARG_IF_GIVEN(argv, argc, 0);
+    if (bv == 0)
+        return 0;
+
+    addr = blkvalue_seek(bv, ARG_IF_GIVEN(argv, argc, 1),
+        !ARG_IF_GIVEN(argv, argc, 2), &size);
+    if (!addr)
+        return 0;
+    switch (size) {
+        case 1: return Mem1(addr);
+        case 2: return Mem2(addr);
+        default: return Mem4(addr);
+    }
+}
+
+static glui32 func_265_blkvalue_write(glui32 argc, glui32 *argv)
+{
+    glui32 bv, addr, size;
+    glsi32 val;
+
+    bv = ARG_IF_GIVEN(argv, argc, 0);
+    if (bv == 0)
+        return 1;
+    if (!ARG_IF_GIVEN(argv, argc, 3)) {
+        accel_fallback = TRUE;
+        return 0;
+    }
+
+    addr = blkvalue_seek(bv, ARG_IF_GIVEN(argv, argc, 1), FALSE, &size);
+    if (!addr)
+        return 0;
+    if (addr < ramstart) {
+        accel_fallback = TRUE;
+        return 0;
+    }
+    val = (glsi32)ARG_IF_GIVEN(argv, argc, 2);
+    switch (size) {
+        case 1:
+            MemW1(addr, val & 0xFF);
+            break;
+        case 2:
+            /* The game writes (val/256)%256 and val%256, with signed
+               division. */
+            MemW1(addr, ((val / 256) % 256) & 0xFF);
+            MemW1(addr+1, (val % 256) & 0xFF);
+            break;
+        default:
+            MemW4(addr, val);
+            break;
+    }
+    return 1; /* the game routine ends with a bare "return;" */
+}
@@ -0,0 +1,98 @@
+/* accelplugin.h: Glulxe interface for accelerator plugins.
+    Designed by Andrew Plotkin <erkyrath@eblong.com>
+    http://eblong.com/zarf/glulx/index.html
+*/
+
+#ifndef _ACCELPLUGIN_H
+#define _ACCELPLUGIN_H
+
+/* An accelerator plugin is a shared object which supplies native
+   versions of game functions, in the same way that accel.c does for
+   the Inform veneer. Glulxe loads it with the "--accelplugin FILE"
+   option, if it was built with ACCEL_PLUGINS defined in glulxe.h.
+
+   A plugin must export one function:
+
+     int glulxe_accel_plugin_init(const glulxe_accel_host_t *host,
+       glulxe_accel_plugin_t *plugin);
+
+   This is called once, at startup, before the game file is loaded.
+   It should check host->version, register its native functions with
+   host->register_func(), and fill in the plugin structure. It returns
+   nonzero on success; if it returns zero, Glulxe stops with an error.
+
+   A native function is registered under an accel index. The index
+   must not be one that Glulxe (or another plugin) already uses;
+   choosing numbers from 0x10000 up keeps clear of those. Once
+   registered, the game can accelerate a function with @accelfunc in
+   the usual way, or the plugin can do it from its game_start() hook
+   with host->set_func(). Either way, it goes through the normal
+   acceleration table, so autosave records it like any other.
+
+   Native functions are called in place of the game function, with
+   the same arguments. They must not try to call back into the VM --
+   the interpreter is not re-entrant. If a native function can't
+   handle a particular call (for example, an error case whose output
+   it doesn't want to reproduce), it can call host->fallback() and
+   return; the game's own function then runs instead.
+
+   Memory access goes through host->mem_read() and host->mem_write(),
+   which are bounds-checked just as VM instructions are.
+
+   This file is self-contained; a plugin does not need glk.h or
+   glulxe.h to build.
+*/
+
+#include <stdint.h>
+
+/* The version of this interface. It is incremented whenever the
+   structures below change incompatibly. */
+#define GLULXE_ACCEL_PLUGIN_VERSION (1)
+
+typedef uint32_t (*glulxe_accel_func_t)(uint32_t argc, uint32_t *argv);
+
+typedef struct glulxe_accel_host_struct {
+  /* GLULXE_ACCEL_PLUGIN_VERSION, as the interpreter was built. */
+  uint32_t version;
+
+  /* Register func under accel index. Returns zero if the index is
+     already taken. */
+  int (*register_func)(uint32_t index, glulxe_accel_func_t func);
+  /* Accelerate the function at addr, just as @accelfunc does. */
+  void (*set_func)(uint32_t index, uint32_t addr);
+  /* Read an accel parameter, as set by @accelparam. */
+  uint32_t (*get_param)(uint32_t index);
+
+  /* Read or write main memory. len must be 1, 2, or 4; values are
+     big-endian, as in the VM. */
+  uint32_t (*mem_read)(uint32_t addr, int len);
+  void (*mem_write)(uint32_t addr, int len, uint32_t val);
+  /* The current size of main memory (the end of memory). */
+  uint32_t (*mem_size)(void);
+
+  /* Called from inside a native function: run the game's own function
+     instead, ignoring the native function's return value. */
+  void (*fallback)(void);
+  /* Stop the interpreter with an error message. This does not
+     return. */
+  void (*fatal_error)(char *msg);
+} glulxe_accel_host_t;
+
+typedef struct glulxe_accel_plugin_struct {
+  /* The plugin sets this to GLULXE_ACCEL_PLUGIN_VERSION, as the plugin
+     was built. */
+  uint32_t version;
+
+  /* Called after the game file is loaded and before it starts running.
+     The plugin may examine memory to identify the game, and call
+     host->set_func(). (Acceleration survives @restart, so this is not
+     called again then.) May be NULL. */
+  void (*game_start)(void);
+} glulxe_accel_plugin_t;
+
+typedef int (*glulxe_accel_plugin_init_t)(const glulxe_accel_host_t *host,
+  glulxe_accel_plugin_t *plugin);
+
+#define GLULXE_ACCEL_PLUGIN_INIT_NAME "glulxe_accel_plugin_init"
+
+#endif /* _ACCELPLUGIN_H */
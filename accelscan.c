@@ -0,0 +1,716 @@
+/* accelscan.c: Glulxe code for recognizing acceleratable functions
+    Designed by Andrew Plotkin <erkyrath@eblong.com>
+    http://eblong.com/zarf/glulx/index.html
+*/
+
+/*
+Acceleration only happens if the game asks for it with @accelfunc.
+Games built with older compilers never do, even though their veneer
+routines (Z__Region, CP__Tab, RA__Pr, RL__Pr, OC__Cl, RV__Pr, OP__Pr)
+are the same code that accel.c implements natively. This module lets
+the interpreter find those routines on its own.
+
+Each function is reduced to a fingerprint: a hash over its local-format
+bytes, its opcodes, and the kinds of its operands (constant, memory,
+local, etc). Constant values and addresses are left out of the hash,
+so the same veneer routine compiled into two different games yields
+the same fingerprint. The count of instructions is kept alongside the
+hash as a sanity check.
+
+A small catalogue of fingerprints is compiled in: the seven veneer
+routines above, as Inform 6 compiles them. The scan only uses these
+if the "--accelscan builtin" option is given, since a routine of the
+same shape with different constants would match too. It also leaves
+them alone if the game contains an @accelfunc instruction anywhere in
+ROM; such a game will set up its own acceleration, and we shouldn't
+guess ahead of it.
+
+More fingerprints can be loaded from a catalogue file. You build one
+by running a game that *does* use @accelfunc with the "--acceltrain
+FILE" option. Every function the game accelerates is written out as a
+line of the form
+
+  accel INDEX HASH COUNT PARAM:ORD PARAM:ORD ...
+
+The PARAM:ORD pairs record which operands of the function (counted
+from zero, through the whole function) held the value of each
+@accelparam parameter at the time. Catalogues from several games can
+simply be concatenated. Blank lines and lines beginning with "#" are
+ignored. The built-in catalogue below is in the same format.
+
+At startup, the interpreter walks ROM, the same way glulxdump finds
+functions, and fingerprints everything it finds. When a function
+matches a catalogue entry, the parameter values are read back out of
+the corresponding operands. (If two operands disagree about a
+parameter, that parameter is not trusted.) Parameters which the game
+has already set are left alone. A native function is only installed
+once every parameter it depends on is known; see accel_func_params()
+in accel.c. The old functions (2 through 7) assume the default seven
+attribute bytes, as the veneer that goes with them does.
+
+Catalogue files are given with "--accelscan FILE", and are used even
+for games that contain @accelfunc. Either way, the game can still
+override any of this with @accelfunc and @accelparam, and if it does,
+those take precedence.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "glk.h"
+#include "glulxe.h"
+#include "opcodes.h"
+
+/* An instruction count past which a function is too long to match.
+   Veneer routines are much shorter than this. (We still step through
+   a longer function, to find its end.) */
+#define MAX_PRINT_INSTRS (1024)
+/* The maximum number of operands whose values we keep track of. */
+#define MAX_PRINT_OPERANDS (2048)
+/* The maximum number of PARAM:ORD pairs per catalogue entry. */
+#define MAX_PRINT_PAIRS (32)
+
+/* The number of parameters which accel.c uses. This must be no more
+   than 32, since they're tracked in bitmasks. */
+#define NUM_SCAN_PARAMS (30)
+
+/* The built-in catalogue. These were generated with --acceltrain from
+   the Inform 6 veneer, compiled with the default seven attribute
+   bytes. */
+static const char *builtin_prints[] = {
+  "accel 1 0x0ef0ce40 14", /* Z__Region */
+  "accel 2 0xb091ccea 11", /* CP__Tab */
+  "accel 3 0x44c1228d 24 0:8 1:39 2:34 6:45", /* RA__Pr */
+  "accel 4 0x4126459f 25 0:8 1:39 2:34 6:45", /* RL__Pr */
+  "accel 5 0xe4f3b67f 46 2:21 2:27 2:30 2:49 2:52 2:74 2:76 3:39 3:43"
+    " 3:61 4:14 4:36 4:58 4:68 5:7 5:33 5:55 5:65", /* OC__Cl */
+  "accel 6 0xd772ac38 10 1:10 8:12", /* RV__Pr */
+  "accel 7 0x0e937977 16 1:24 2:33", /* OP__Pr */
+  NULL
+};
+
+/* Set by the "--accelscan builtin" option. */
+int accel_builtin_scan = FALSE;
+
+typedef struct accelprint_struct {
+  glui32 index;
+  glui32 hash;
+  glui32 count;
+  int builtin; /* from builtin_prints, rather than a file */
+  int numpairs;
+  glui32 param[MAX_PRINT_PAIRS];
+  glui32 ordinal[MAX_PRINT_PAIRS];
+  struct accelprint_struct *next;
+} accelprint_t;
+
+/* The result of fingerprinting one function. */
+typedef struct fingerprint_struct {
+  glui32 hash;
+  glui32 count;
+  glui32 endpos; /* the address just past the function */
+  int clean; /* did it end at the start of another object? */
+  int toolong; /* more than MAX_PRINT_INSTRS instructions */
+  int accelfunc; /* does it contain @accelfunc? */
+  int numoperands;
+  glui32 opvals[MAX_PRINT_OPERANDS];
+} fingerprint_t;
+
+/* A catalogue entry which matched something in ROM. */
+typedef struct scanmatch_struct {
+  glui32 addr;
+  accelprint_t *print;
+  glui32 params[NUM_SCAN_PARAMS];
+  glui32 known; /* bitmask of params which were found */
+} scanmatch_t;
+
+static accelprint_t *catalogue = NULL;
+static int builtin_loaded = FALSE;
+static accelprint_t *trained = NULL;
+static strid_t trainstream = NULL;
+static fingerprint_t scratchprint;
+
+static int fingerprint_function(glui32 addr, glui32 limit,
+  fingerprint_t *print);
+static accelprint_t *find_print(glui32 hash, glui32 count);
+static void load_builtin_prints(void);
+static int parse_print_line(const char *buf, accelprint_t *print);
+static void write_hex(strid_t str, glui32 val);
+static void write_dec(strid_t str, glui32 val);
+
+/* The FNV-1a hash, one byte at a time. */
+#define HASH_START (0x811C9DC5)
+#define HASH_BYTE(hash, ch)  (((hash) ^ (glui32)(ch)) * 0x01000193)
+
+/* Operand kinds, as far as the fingerprint is concerned. The width of
+   a constant depends on its value, so it's not part of the kind. */
+#define OPKIND_ZERO (0)
+#define OPKIND_CONST (1)
+#define OPKIND_ADDR (2)
+#define OPKIND_STACK (3)
+#define OPKIND_LOCAL (4)
+#define OPKIND_RAM (5)
+
+/* accel_load_fingerprints():
+   Read a catalogue of function fingerprints from a stream. This may be
+   called more than once; the catalogues accumulate. Returns FALSE if
+   the stream contained a line which could not be parsed.
+*/
+int accel_load_fingerprints(strid_t stream)
+{
+  char buf[1024];
+  glui32 len;
+  accelprint_t *print;
+  accelprint_t tmp;
+
+  while (1) {
+    len = glk_get_line_stream(stream, buf, sizeof(buf));
+    if (!len)
+      break;
+    if (!parse_print_line(buf, &tmp))
+      return FALSE;
+    if (!tmp.count)
+      continue; /* comment or blank line */
+    print = (accelprint_t *)glulx_malloc(sizeof(accelprint_t));
+    if (!print)
+      fatal_error("Unable to allocate fingerprint entry.");
+    *print = tmp;
+    print->next = catalogue;
+    catalogue = print;
+  }
+
+  return TRUE;
+}
+
+/* load_builtin_prints():
+   Add the compiled-in fingerprints to the catalogue. These go at the
+   end, so that entries loaded from a file are found first.
+*/
+static void load_builtin_prints()
+{
+  accelprint_t **tail;
+  accelprint_t *print;
+  int ix;
+
+  if (builtin_loaded)
+    return;
+  builtin_loaded = TRUE;
+
+  for (tail = &catalogue; *tail; tail = &((*tail)->next)) { };
+
+  for (ix=0; builtin_prints[ix]; ix++) {
+    print = (accelprint_t *)glulx_malloc(sizeof(accelprint_t));
+    if (!print)
+      fatal_error("Unable to allocate fingerprint entry.");
+    if (!parse_print_line(builtin_prints[ix], print) || !print->count)
+      fatal_error("Malformed built-in fingerprint.");
+    print->builtin = TRUE;
+    *tail = print;
+    tail = &print->next;
+  }
+}
+
+/* accel_set_train_stream():
+   Set a stream to write fingerprints to. Every function that the game
+   accelerates with @accelfunc will be written out.
+*/
+void accel_set_train_stream(strid_t stream)
+{
+  trainstream = stream;
+}
+
+/* parse_print_line():
+   Parse one line of a catalogue. A comment or blank line is returned
+   with a count of zero.
+*/
+static int parse_print_line(const char *buf, accelprint_t *print)
+{
+  const char *cx = buf;
+  char *endptr;
+  glui32 vals[3];
+  int ix;
+
+  print->count = 0;
+  print->builtin = FALSE;
+  print->numpairs = 0;
+  print->next = NULL;
+
+  while (*cx == ' ' || *cx == '\t')
+    cx++;
+  if (*cx == '#' || *cx == '\n' || *cx == '\r' || *cx == '\0')
+    return TRUE;
+  if (strncmp(cx, "accel ", 6))
+    return FALSE;
+  cx += 6;
+
+  for (ix=0; ix<3; ix++) {
+    vals[ix] = strtoul(cx, &endptr, 0);
+    if (endptr == cx)
+      return FALSE;
+    cx = endptr;
+  }
+  print->index = vals[0];
+  print->hash = vals[1];
+  print->count = vals[2];
+  if (!print->count)
+    return FALSE;
+
+  while (1) {
+    while (*cx == ' ' || *cx == '\t')
+      cx++;
+    if (*cx == '\n' || *cx == '\r' || *cx == '\0')
+      break;
+    if (print->numpairs >= MAX_PRINT_PAIRS)
+      return FALSE;
+    print->param[print->numpairs] = strtoul(cx, &endptr, 10);
+    if (endptr == cx || *endptr != ':')
+      return FALSE;
+    cx = endptr+1;
+    print->ordinal[print->numpairs] = strtoul(cx, &endptr, 10);
+    if (endptr == cx)
+      return FALSE;
+    cx = endptr;
+    if (print->param[print->numpairs] >= NUM_SCAN_PARAMS
+      || print->ordinal[print->numpairs] >= MAX_PRINT_OPERANDS)
+      return FALSE;
+    print->numpairs++;
+  }
+
+  return TRUE;
+}
+
+/* fingerprint_function():
+   Compute the fingerprint of the function at addr, reading no further
+   than limit. Returns FALSE if this doesn't look like a function at all.
+*/
+static int fingerprint_function(glui32 addr, glui32 limit,
+  fingerprint_t *print)
+{
+  glui32 pos = addr;
+  glui32 hash = HASH_START;
+  glui32 opcode, val;
+  const operandlist_t *oplist;
+  int ch, loctype, locnum, ix, numops, mode, kind, size;
+  unsigned char modes[MAX_OPERANDS];
+
+  print->count = 0;
+  print->numoperands = 0;
+  print->clean = FALSE;
+  print->toolong = FALSE;
+  print->accelfunc = FALSE;
+
+  if (limit > endmem)
+    limit = endmem;
+  if (pos >= limit)
+    return FALSE;
+
+  ch = Mem1(pos);
+  if (ch != 0xC0 && ch != 0xC1)
+    return FALSE;
+  hash = HASH_BYTE(hash, ch);
+  pos++;
+
+  /* The local-format list. */
+  while (1) {
+    if (pos+2 > limit)
+      return FALSE;
+    loctype = Mem1(pos);
+    locnum = Mem1(pos+1);
+    pos += 2;
+    hash = HASH_BYTE(hash, loctype);
+    hash = HASH_BYTE(hash, locnum);
+    if (loctype == 0) {
+      if (locnum != 0)
+        return FALSE;
+      break;
+    }
+    if ((loctype != 1 && loctype != 2 && loctype != 4) || locnum == 0)
+      return FALSE;
+  }
+
+  while (1) {
+    if (pos >= limit) {
+      print->clean = (pos == limit);
+      break;
+    }
+
+    ch = Mem1(pos);
+    if (ch == 0xC0 || ch == 0xC1 || ch == 0xE0 || ch == 0xE1 || ch == 0xE2) {
+      /* The start of the next object. */
+      print->clean = TRUE;
+      break;
+    }
+
+    /* Decode the opcode number, the same way exec.c does. */
+    if ((ch & 0x80) == 0) {
+      opcode = ch;
+      pos++;
+    }
+    else if ((ch & 0x40) == 0) {
+      if (pos+2 > limit)
+        break;
+      opcode = Mem2(pos) & 0x7FFF;
+      pos += 2;
+    }
+    else {
+      if (pos+4 > limit)
+        break;
+      opcode = Mem4(pos) & 0x0FFFFFFF;
+      pos += 4;
+    }
+
+    oplist = lookup_operandlist(opcode);
+    if (!oplist)
+      break;
+
+    hash = HASH_BYTE(hash, (opcode >> 8) & 0xFF);
+    hash = HASH_BYTE(hash, opcode & 0xFF);
+    if (opcode == op_accelfunc)
+      print->accelfunc = TRUE;
+
+    numops = oplist->num_ops;
+    if (pos + (numops+1)/2 > limit)
+      break;
+    for (ix=0; ix<numops; ix+=2) {
+      ch = Mem1(pos);
+      pos++;
+      modes[ix] = (ch & 0x0F);
+      if (ix+1 < numops)
+        modes[ix+1] = ((ch >> 4) & 0x0F);
+    }
+
+    for (ix=0; ix<numops; ix++) {
+      mode = modes[ix];
+      if (mode == 0x4 || mode == 0xC)
+        break; /* illegal */
+      if (mode == 0) {
+        kind = OPKIND_ZERO;
+        size = 0;
+      }
+      else if (mode == 8) {
+        kind = OPKIND_STACK;
+        size = 0;
+      }
+      else {
+        size = (mode & 3);
+        if (size == 3)
+          size = 4;
+        switch (mode >> 2) {
+        case 0: kind = OPKIND_CONST; break;
+        case 1: kind = OPKIND_ADDR; break;
+        case 2: kind = OPKIND_LOCAL; break;
+        default: kind = OPKIND_RAM; break;
+        }
+      }
+
+      if (pos+size > limit)
+        break;
+      switch (size) {
+      case 0:
+        val = 0;
+        break;
+      case 1:
+        val = Mem1(pos);
+        if (kind == OPKIND_CONST && (val & 0x80))
+          val |= 0xFFFFFF00;
+        break;
+      case 2:
+        val = Mem2(pos);
+        if (kind == OPKIND_CONST && (val & 0x8000))
+          val |= 0xFFFF0000;
+        break;
+      default:
+        val = Mem4(pos);
+        break;
+      }
+      pos += size;
+
+      if (kind == OPKIND_RAM)
+        val += ramstart;
+
+      hash = HASH_BYTE(hash, kind);
+      if (kind == OPKIND_LOCAL) {
+        /* Which local is used is part of the routine's shape. */
+        hash = HASH_BYTE(hash, (val >> 8) & 0xFF);
+        hash = HASH_BYTE(hash, val & 0xFF);
+      }
+
+      if (print->numoperands < MAX_PRINT_OPERANDS)
+        print->opvals[print->numoperands] = val;
+      print->numoperands++;
+    }
+    if (ix < numops)
+      break;
+
+    print->count++;
+  }
+
+  print->hash = hash;
+  print->endpos = pos;
+  print->toolong = (print->count > MAX_PRINT_INSTRS);
+  return (print->count > 0);
+}
+
+static accelprint_t *find_print(glui32 hash, glui32 count)
+{
+  accelprint_t *print;
+
+  for (print = catalogue; print; print = print->next) {
+    if (print->hash == hash && print->count == count)
+      return print;
+  }
+  return NULL;
+}
+
+/* accel_scan_functions():
+   Walk through ROM, looking for functions which match the catalogue,
+   and accelerate the ones we can. This is called at startup, after the
+   initial memory state is loaded.
+*/
+void accel_scan_functions()
+{
+  glui32 pos, startpos;
+  int ch, ix, jx;
+  accelprint_t *print;
+  scanmatch_t *matches = NULL;
+  int nummatches = 0;
+  int matchsize = 0;
+  glui32 params[NUM_SCAN_PARAMS];
+  glui32 known;
+  int gameaccel = FALSE;
+  fingerprint_t *fp = &scratchprint;
+
+  if (accel_builtin_scan)
+    load_builtin_prints();
+  if (!catalogue)
+    return;
+
+  pos = 36; /* skip the header */
+  while (pos < ramstart) {
+    startpos = pos;
+    ch = Mem1(pos);
+
+    if (ch == 0xE0) {
+      /* Skip an uncompressed string. */
+      for (pos++; pos < ramstart && Mem1(pos); pos++) { };
+      pos++;
+      continue;
+    }
+    if (ch == 0xE2) {
+      /* Skip an uncompressed Unicode string. */
+      for (pos += 4; pos+4 <= ramstart && Mem4(pos); pos += 4) { };
+      pos += 4;
+      continue;
+    }
+    if (ch != 0xC0 && ch != 0xC1) {
+      /* Padding, or compressed string data, or something we don't
+         understand. */
+      pos++;
+      continue;
+    }
+
+    if (!fingerprint_function(startpos, ramstart, fp) || !fp->clean) {
+      /* Not really a function; keep looking from the next byte. */
+      pos = startpos+1;
+      continue;
+    }
+    pos = fp->endpos;
+    if (fp->accelfunc)
+      gameaccel = TRUE;
+    if (fp->toolong)
+      continue;
+
+    print = find_print(fp->hash, fp->count);
+    if (!print || accel_get_func(startpos))
+      continue;
+
+    /* Pull the parameter values out of the operands. */
+    known = 0;
+    for (ix=0; ix<print->numpairs; ix++) {
+      glui32 param = print->param[ix];
+      glui32 ord = print->ordinal[ix];
+      glui32 val;
+      if (ord >= (glui32)fp->numoperands || ord >= MAX_PRINT_OPERANDS)
+        break;
+      val = fp->opvals[ord];
+      if (known & (1 << param)) {
+        if (params[param] != val)
+          break;
+      }
+      else {
+        params[param] = val;
+        known |= (1 << param);
+      }
+    }
+    if (ix < print->numpairs)
+      continue; /* inconsistent; don't trust this match */
+
+    if (nummatches >= matchsize) {
+      matchsize = 2*matchsize + 8;
+      if (!matches)
+        matches = (scanmatch_t *)glulx_malloc(matchsize * sizeof(scanmatch_t));
+      else
+        matches = (scanmatch_t *)glulx_realloc(matches, matchsize * sizeof(scanmatch_t));
+      if (!matches)
+        fatal_error("Unable to allocate accel scan table.");
+    }
+    matches[nummatches].addr = startpos;
+    matches[nummatches].print = print;
+    matches[nummatches].known = known;
+    for (jx=0; jx<NUM_SCAN_PARAMS; jx++)
+      matches[nummatches].params[jx] = params[jx];
+    nummatches++;
+  }
+
+  if (!matches)
+    return;
+
+  if (gameaccel) {
+    /* The game does its own acceleration; drop the built-in matches. */
+    for (ix=0, jx=0; ix<nummatches; ix++) {
+      if (!matches[ix].print->builtin)
+        matches[jx++] = matches[ix];
+    }
+    nummatches = jx;
+  }
+
+  /* Fill in whatever parameters the game hasn't set. Several routines
+     may supply the same parameter; if they disagree, we can't trust
+     any of them. */
+  known = 0;
+  for (ix=0; ix<nummatches; ix++) {
+    for (jx=0; jx<NUM_SCAN_PARAMS; jx++) {
+      if (!(matches[ix].known & (1 << jx)))
+        continue;
+      if (!(known & (1 << jx))) {
+        params[jx] = matches[ix].params[jx];
+        known |= (1 << jx);
+      }
+      else if (params[jx] != matches[ix].params[jx]) {
+        params[jx] = 0;
+      }
+    }
+  }
+  for (jx=0; jx<NUM_SCAN_PARAMS; jx++) {
+    if ((known & (1 << jx)) && params[jx] && !accel_get_param(jx))
+      accel_set_param(jx, params[jx]);
+  }
+
+  for (ix=0; ix<nummatches; ix++) {
+    glui32 index = matches[ix].print->index;
+    glui32 required = accel_func_params(index);
+
+    if (index >= 2 && index <= 7 && !accel_get_param(7)) {
+      /* The old veneer only works with seven bytes of attributes. */
+      accel_set_param(7, 7);
+    }
+
+    for (jx=0; jx<NUM_SCAN_PARAMS; jx++) {
+      if ((required & (1 << jx)) && !accel_get_param(jx))
+        break;
+    }
+    if (jx < NUM_SCAN_PARAMS || (required >> NUM_SCAN_PARAMS))
+      continue;
+
+    accel_set_func(index, matches[ix].addr);
+  }
+
+  glulx_free(matches);
+}
+
+/* accel_train_func():
+   The game has just accelerated a function. If we're training, write
+   out its fingerprint, along with the operands where the current
+   parameter values appear.
+*/
+void accel_train_func(glui32 index, glui32 addr)
+{
+  fingerprint_t *fp = &scratchprint;
+  accelprint_t *print;
+  glui32 param, val, required;
+  int ix, numvals;
+
+  if (!trainstream)
+    return;
+  if (!accel_find_func(index))
+    return;
+
+  if (!fingerprint_function(addr, endmem, fp) || fp->toolong)
+    return;
+
+  /* Don't write the same routine twice. (The game may accelerate its
+     functions again after a restart.) */
+  for (print = trained; print; print = print->next) {
+    if (print->index == index && print->hash == fp->hash
+      && print->count == fp->count)
+      return;
+  }
+  print = (accelprint_t *)glulx_malloc(sizeof(accelprint_t));
+  if (!print)
+    return;
+  print->index = index;
+  print->hash = fp->hash;
+  print->count = fp->count;
+  print->numpairs = 0;
+  print->next = trained;
+  trained = print;
+
+  glk_put_string_stream(trainstream, "accel ");
+  write_dec(trainstream, index);
+  glk_put_string_stream(trainstream, " 0x");
+  write_hex(trainstream, fp->hash);
+  glk_put_char_stream(trainstream, ' ');
+  write_dec(trainstream, fp->count);
+
+  numvals = fp->numoperands;
+  if (numvals > MAX_PRINT_OPERANDS)
+    numvals = MAX_PRINT_OPERANDS;
+
+  /* Only look for the parameters this function actually uses. A small
+     parameter value will often turn up as an unrelated constant. */
+  required = accel_func_params(index);
+  for (param=0; param<NUM_SCAN_PARAMS; param++) {
+    if (!(required & (1 << param)))
+      continue;
+    val = accel_get_param(param);
+    if (!val)
+      continue;
+    for (ix=0; ix<numvals; ix++) {
+      if (fp->opvals[ix] != val)
+        continue;
+      if (print->numpairs >= MAX_PRINT_PAIRS)
+        break;
+      print->numpairs++;
+      glk_put_char_stream(trainstream, ' ');
+      write_dec(trainstream, param);
+      glk_put_char_stream(trainstream, ':');
+      write_dec(trainstream, ix);
+    }
+  }
+
+  glk_put_char_stream(trainstream, '\n');
+}
+
+static void write_hex(strid_t str, glui32 val)
+{
+  char buf[9];
+  int ix;
+
+  for (ix=7; ix>=0; ix--) {
+    buf[ix] = "0123456789abcdef"[val & 0x0F];
+    val >>= 4;
+  }
+  buf[8] = '\0';
+  glk_put_string_stream(str, buf);
+}
+
+static void write_dec(strid_t str, glui32 val)
+{
+  char buf[16];
+  int ix = 0;
+
+  do {
+    buf[ix++] = '0' + (val % 10);
+    val /= 10;
+  } while (val);
+  while (ix > 0)
+    glk_put_char_stream(str, buf[--ix]);
+}
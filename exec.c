@@ -806,6 +806,7 @@ void execute_loop()
 
       case op_accelfunc:
         accel_set_func(inst[0].value, inst[1].value);
+        accel_train_func(inst[0].value, inst[1].value);
         break;
       case op_accelparam:
         accel_set_param(inst[0].value, inst[1].value);
@@ -27,8 +27,12 @@ void enter_function(glui32 funcaddr, glui32 argc, glui32 *argv)
     profile_in(addr, stackptr, TRUE);
     val = accelfunc(argc, argv);
     profile_out(stackptr);
-    pop_callstub(val);
-    return;
+    if (!accel_fallback) {
+      pop_callstub(val);
+      return;
+    }
+    /* The native code declined; run the real function. */
+    accel_fallback = FALSE;
   }
     
   profile_in(addr, stackptr, FALSE);
@@ -0,0 +1,365 @@
+#!/usr/bin/env python
+
+from __future__ import print_function
+
+"""
+This script reads the gi_dispa.c file of a Glk library, and writes out
+glkfast.h: direct C wrappers for every Glk function whose arguments
+are simple enough to convert without going through the dispatch layer.
+(Integers, characters, opaque objects, strings, read-only arrays, and
+integers returned through a reference.) Functions that take structs,
+retained arrays, or arrays the library writes into are left to the
+full dispatcher in glkop.c.
+
+Usage:
+
+  python glkfast-gen.py GLKDIR/gi_dispa.c > glkfast.h
+
+The Makefile does this with "make glkfast". The output only depends on
+the prototype table, so a glkfast.h generated from one library will
+work with another. When the interpreter starts, it checks each
+wrapper's prototype against the library it's linked with; any that
+don't match are not used.
+
+Sections of gi_dispa.c inside #ifdef GLK_MODULE_... are copied into
+the output under the same conditions.
+"""
+
+import sys
+import re
+
+# perform_glk() handles these itself, so wrappers would never be called.
+HANDCODED = set([
+    0x0047, 0x0048, 0x0062, 0x0080, 0x0081, 0x00A0, 0x00A1, 0x00C0,
+    0x0128, 0x012B,
+])
+
+# The C types of the opaque-object classes.
+OBJTYPES = {
+    'a': 'winid_t',
+    'b': 'strid_t',
+    'c': 'frefid_t',
+    'd': 'schanid_t',
+}
+
+# Plain value types, and how to cast a Glulx argument to them.
+VALCASTS = {
+    'Iu': 'glui32',
+    'Is': 'glsi32',
+    'Cu': 'unsigned char',
+    'Cs': 'signed char',
+    'Cn': 'char',
+}
+
+class Ineligible(Exception):
+    pass
+
+class Arg:
+    def __init__(self, kind, typ, nullok=True):
+        self.kind = kind    # 'val', 'obj', 'str', 'ustr', 'arr', 'out', 'ret'
+        self.typ = typ
+        self.nullok = nullok
+
+def parse_proto(proto):
+    """Parse a prototype string into a list of Arg, or raise Ineligible.
+    """
+    match = re.match(r'^(\d+)(.*)$', proto)
+    if not match:
+        raise Ineligible('no count')
+    count = int(match.group(1))
+    rest = match.group(2)
+    args = []
+    for ix in range(count):
+        prefix = ''
+        while rest and rest[0] in '<>&+:#!':
+            prefix += rest[0]
+            rest = rest[1:]
+        if not rest:
+            raise Ineligible('truncated')
+        typeclass = rest[0]
+        if typeclass in 'IC':
+            typ = rest[0:2]
+            rest = rest[2:]
+        elif typeclass == 'Q':
+            typ = rest[0:2]
+            rest = rest[2:]
+        elif typeclass in 'SU':
+            typ = rest[0]
+            rest = rest[1:]
+        else:
+            raise Ineligible('struct')
+
+        nullok = ('+' not in prefix)
+        flags = prefix.replace('+', '')
+        if flags == ':':
+            if typ in VALCASTS or (typ[0] == 'Q' and typ[1] in OBJTYPES):
+                args.append(Arg('ret', typ))
+                continue
+            raise Ineligible('return type')
+        if flags == '':
+            if typ in VALCASTS:
+                args.append(Arg('val', typ))
+            elif typ[0] == 'Q' and typ[1] in OBJTYPES:
+                args.append(Arg('obj', typ))
+            elif typ == 'S':
+                args.append(Arg('str', typ))
+            elif typ == 'U':
+                args.append(Arg('ustr', typ))
+            else:
+                raise Ineligible('value type')
+            continue
+        if flags == '>#' and typ in ('Cn', 'Iu'):
+            args.append(Arg('arr', typ, nullok))
+            continue
+        if flags == '<' and typ in ('Iu', 'Is'):
+            args.append(Arg('out', typ, nullok))
+            continue
+        raise Ineligible('prefix ' + prefix)
+
+    if rest not in ('', ':'):
+        raise Ineligible('trailing')
+    return args
+
+def read_dispa(filename):
+    """Read gi_dispa.c. Returns a list of (funcnum, name, proto, conds),
+    where conds is the list of preprocessor conditions around the
+    prototype.
+    """
+    names = {}
+    protos = []
+    conds = []
+    curcase = None
+    infunc = False
+
+    fl = open(filename)
+    for line in fl:
+        stripped = line.strip()
+        if stripped.startswith('#'):
+            directive = stripped[1:].strip()
+            if directive.startswith('if'):
+                conds.append(stripped)
+            elif directive.startswith('else'):
+                conds[-1] = '#else /* ' + conds[-1] + ' */'
+            elif directive.startswith('endif'):
+                conds.pop()
+            continue
+
+        match = re.match(r'\{\s*(0x[0-9A-Fa-f]+)\s*,\s*glk_(\w+)\s*,\s*"(\w+)"\s*\}', stripped)
+        if match:
+            names[int(match.group(1), 16)] = match.group(2)
+            continue
+
+        if re.match(r'char\s*\*\s*gidispatch_prototype\s*\(', stripped):
+            infunc = True
+            continue
+        if not infunc:
+            continue
+        if stripped == '}' and line.startswith('}'):
+            infunc = False
+            continue
+        match = re.match(r'case\s+(0x[0-9A-Fa-f]+)\s*:', stripped)
+        if match:
+            curcase = int(match.group(1), 16)
+            continue
+        match = re.match(r'return\s+"([^"]*)"\s*;', stripped)
+        if match and curcase is not None:
+            protos.append((curcase, match.group(1), list(conds)))
+            curcase = None
+    fl.close()
+
+    res = []
+    for (funcnum, proto, fconds) in protos:
+        if funcnum not in names:
+            continue
+        res.append((funcnum, names[funcnum], proto, fconds))
+    return res
+
+def wrap_conds(lines, conds, prevconds):
+    """Emit #endif/#if lines to move from prevconds to conds.
+    """
+    common = 0
+    while (common < len(conds) and common < len(prevconds)
+           and conds[common] == prevconds[common]):
+        common += 1
+    for cond in reversed(prevconds[common:]):
+        lines.append('#endif /* %s */' % (cond[1:].split(None, 1)[1],))
+    for cond in conds[common:]:
+        lines.append(cond)
+
+def gen_case(funcnum, name, args):
+    """Generate the body of one case in glkfast_call().
+    """
+    lines = []
+    numvargs = len([arg for arg in args if arg.kind != 'ret'])
+    numvargs += len([arg for arg in args if arg.kind == 'arr'])
+
+    lines.append('  case 0x%04X: /* %s */' % (funcnum, name))
+    lines.append('    if (!glkfast_protos[glkfast_%s].ok || numargs != %d)' % (name, numvargs))
+    lines.append('      return FALSE;')
+
+    # Anything that would make the full dispatcher complain (or take
+    # a path we don't copy) goes back there, before we touch anything.
+    checks = []
+    vx = 0
+    for arg in args:
+        if arg.kind == 'arr':
+            checks.append('!arglist[%d]' % (vx,))
+            vx += 2
+        elif arg.kind == 'out':
+            if not arg.nullok:
+                checks.append('!arglist[%d]' % (vx,))
+            vx += 1
+        elif arg.kind != 'ret':
+            vx += 1
+    if checks:
+        lines.append('    if (%s)' % (' || '.join(checks),))
+        lines.append('      return FALSE;')
+
+    decls = []
+    before = []
+    after = []
+    params = []
+    retarg = None
+    usestrings = False
+    vx = 0
+    for (ix, arg) in enumerate(args):
+        if arg.kind == 'ret':
+            retarg = arg
+            continue
+        if arg.kind == 'val':
+            params.append('(%s)arglist[%d]' % (VALCASTS[arg.typ], vx))
+            vx += 1
+        elif arg.kind == 'obj':
+            params.append('(%s)glkfast_obj(%d, arglist[%d])'
+                % (OBJTYPES[arg.typ[1]], ord(arg.typ[1]) - ord('a'), vx))
+            vx += 1
+        elif arg.kind == 'str':
+            params.append('DecodeVMString(arglist[%d])' % (vx,))
+            usestrings = True
+            vx += 1
+        elif arg.kind == 'ustr':
+            params.append('DecodeVMUstring(arglist[%d])' % (vx,))
+            usestrings = True
+            vx += 1
+        elif arg.kind == 'arr':
+            if arg.typ == 'Cn':
+                decls.append('char *arr%d;' % (ix,))
+                before.append('arr%d = glkfast_c_array(arglist[%d], &arglist[%d]);' % (ix, vx, vx+1))
+                after.append('ReleaseDirectCArray(arr%d, arglist[%d], arglist[%d], FALSE);' % (ix, vx, vx+1))
+            else:
+                decls.append('glui32 *arr%d;' % (ix,))
+                before.append('arr%d = glkfast_i_array(arglist[%d], &arglist[%d]);' % (ix, vx, vx+1))
+                after.append('ReleaseIArray(arr%d, arglist[%d], arglist[%d], FALSE);' % (ix, vx, vx+1))
+            params.append('arr%d' % (ix,))
+            params.append('arglist[%d]' % (vx+1,))
+            vx += 2
+        elif arg.kind == 'out':
+            decls.append('%s out%d = 0;' % (VALCASTS[arg.typ], ix))
+            params.append('(arglist[%d] ? &out%d : NULL)' % (vx, ix))
+            after.append('if (arglist[%d])' % (vx,))
+            after.append('  WriteMemory(arglist[%d], (glui32)out%d);' % (vx, ix))
+            vx += 1
+
+    call = 'glk_%s(%s)' % (name, ', '.join(params))
+    if retarg is None:
+        callline = call + ';'
+    elif retarg.typ[0] == 'Q':
+        callline = '*retval = glkfast_objid(%d, %s);' % (ord(retarg.typ[1]) - ord('a'), call)
+    elif retarg.typ == 'Is':
+        callline = '*retval = (glui32)(glsi32)%s;' % (call,)
+    elif retarg.typ in ('Cu', 'Cs', 'Cn'):
+        callline = '*retval = (glui32)(%s)%s;' % (VALCASTS[retarg.typ], call)
+    else:
+        callline = '*retval = %s;' % (call,)
+
+    body = before + [callline] + after
+    if usestrings:
+        body.append('reset_temp_strings();')
+
+    if decls:
+        lines.append('    {')
+        for ln in decls:
+            lines.append('      ' + ln)
+        for ln in body:
+            lines.append('      ' + ln)
+        lines.append('    }')
+    else:
+        for ln in body:
+            lines.append('    ' + ln)
+    lines.append('    return TRUE;')
+    return lines
+
+def main():
+    if len(sys.argv) != 2:
+        print('usage: glkfast-gen.py GLKDIR/gi_dispa.c', file=sys.stderr)
+        sys.exit(1)
+
+    entries = []
+    for (funcnum, name, proto, conds) in read_dispa(sys.argv[1]):
+        if funcnum in HANDCODED:
+            continue
+        try:
+            args = parse_proto(proto)
+        except Ineligible:
+            continue
+        entries.append((funcnum, name, proto, conds, args))
+
+    out = []
+    out.append('/* glkfast.h: Direct wrappers for Glk functions with plain arguments.')
+    out.append('    Generated by glkfast-gen.py from gi_dispa.c; do not edit.')
+    out.append('*/')
+    out.append('')
+    out.append('/* This is included by glkop.c, which supplies the argument macros and')
+    out.append('   the glkfast_obj(), glkfast_objid(), glkfast_c_array(), and')
+    out.append('   glkfast_i_array() helpers. */')
+    out.append('')
+
+    out.append('enum {')
+    prev = []
+    for (funcnum, name, proto, conds, args) in entries:
+        wrap_conds(out, conds, prev)
+        prev = conds
+        out.append('  glkfast_%s,' % (name,))
+    wrap_conds(out, [], prev)
+    out.append('  glkfast_Count')
+    out.append('};')
+    out.append('')
+
+    out.append('static glkfast_proto_t glkfast_protos[glkfast_Count+1] = {')
+    prev = []
+    for (funcnum, name, proto, conds, args) in entries:
+        wrap_conds(out, conds, prev)
+        prev = conds
+        out.append('  { 0x%04X, "%s", FALSE },' % (funcnum, proto))
+    wrap_conds(out, [], prev)
+    out.append('  { 0, NULL, FALSE }')
+    out.append('};')
+    out.append('')
+
+    out.append('/* glkfast_call():')
+    out.append('   Call a Glk function directly, if it has a wrapper and the library\'s')
+    out.append('   prototype matched. Returns FALSE (having done nothing) if the call')
+    out.append('   should go through the full dispatcher.')
+    out.append('*/')
+    out.append('static int glkfast_call(glui32 funcnum, glui32 numargs, glui32 *arglist,')
+    out.append('  glui32 *retval)')
+    out.append('{')
+    out.append('  switch (funcnum) {')
+    out.append('')
+    prev = []
+    for (funcnum, name, proto, conds, args) in entries:
+        wrap_conds(out, conds, prev)
+        prev = conds
+        out.extend(gen_case(funcnum, name, args))
+    wrap_conds(out, [], prev)
+    out.append('')
+    out.append('  default:')
+    out.append('    return FALSE;')
+    out.append('  }')
+    out.append('}')
+
+    for ln in out:
+        print(ln)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,476 @@
+/* glkfast.h: Direct wrappers for Glk functions with plain arguments.
+    Generated by glkfast-gen.py from gi_dispa.c; do not edit.
+*/
+
+/* This is included by glkop.c, which supplies the argument macros and
+   the glkfast_obj(), glkfast_objid(), glkfast_c_array(), and
+   glkfast_i_array() helpers. */
+
+enum {
+  glkfast_exit,
+  glkfast_tick,
+  glkfast_gestalt,
+  glkfast_window_iterate,
+  glkfast_window_get_rock,
+  glkfast_window_get_root,
+  glkfast_window_open,
+  glkfast_window_get_size,
+  glkfast_window_set_arrangement,
+  glkfast_window_get_type,
+  glkfast_window_get_parent,
+  glkfast_window_clear,
+  glkfast_window_move_cursor,
+  glkfast_window_get_stream,
+  glkfast_window_set_echo_stream,
+  glkfast_window_get_echo_stream,
+  glkfast_set_window,
+  glkfast_window_get_sibling,
+  glkfast_stream_iterate,
+  glkfast_stream_get_rock,
+  glkfast_stream_open_file,
+  glkfast_stream_set_position,
+  glkfast_stream_get_position,
+  glkfast_fileref_create_temp,
+  glkfast_fileref_create_by_name,
+  glkfast_fileref_destroy,
+  glkfast_fileref_iterate,
+  glkfast_fileref_get_rock,
+  glkfast_fileref_delete_file,
+  glkfast_fileref_does_file_exist,
+  glkfast_fileref_create_from_fileref,
+  glkfast_put_string,
+  glkfast_put_string_stream,
+  glkfast_put_buffer,
+  glkfast_put_buffer_stream,
+  glkfast_set_style,
+  glkfast_set_style_stream,
+  glkfast_get_char_stream,
+  glkfast_stylehint_set,
+  glkfast_stylehint_clear,
+  glkfast_style_distinguish,
+  glkfast_style_measure,
+  glkfast_request_char_event,
+  glkfast_cancel_char_event,
+  glkfast_request_mouse_event,
+  glkfast_cancel_mouse_event,
+  glkfast_request_timer_events,
+#ifdef GLK_MODULE_UNICODE
+  glkfast_put_string_uni,
+  glkfast_put_buffer_uni,
+  glkfast_put_string_stream_uni,
+  glkfast_put_buffer_stream_uni,
+  glkfast_get_char_stream_uni,
+  glkfast_stream_open_file_uni,
+  glkfast_request_char_event_uni,
+#endif /* GLK_MODULE_UNICODE */
+  glkfast_Count
+};
+
+static glkfast_proto_t glkfast_protos[glkfast_Count+1] = {
+  { 0x0001, "0:", FALSE },
+  { 0x0003, "0:", FALSE },
+  { 0x0004, "3IuIu:Iu", FALSE },
+  { 0x0020, "3Qa<Iu:Qa", FALSE },
+  { 0x0021, "2Qa:Iu", FALSE },
+  { 0x0022, "1:Qa", FALSE },
+  { 0x0023, "6QaIuIuIuIu:Qa", FALSE },
+  { 0x0025, "3Qa<Iu<Iu:", FALSE },
+  { 0x0026, "4QaIuIuQa:", FALSE },
+  { 0x0028, "2Qa:Iu", FALSE },
+  { 0x0029, "2Qa:Qa", FALSE },
+  { 0x002A, "1Qa:", FALSE },
+  { 0x002B, "3QaIuIu:", FALSE },
+  { 0x002C, "2Qa:Qb", FALSE },
+  { 0x002D, "2QaQb:", FALSE },
+  { 0x002E, "2Qa:Qb", FALSE },
+  { 0x002F, "1Qa:", FALSE },
+  { 0x0030, "2Qa:Qa", FALSE },
+  { 0x0040, "3Qb<Iu:Qb", FALSE },
+  { 0x0041, "2Qb:Iu", FALSE },
+  { 0x0042, "4QcIuIu:Qb", FALSE },
+  { 0x0045, "3QbIsIu:", FALSE },
+  { 0x0046, "2Qb:Iu", FALSE },
+  { 0x0060, "3IuIu:Qc", FALSE },
+  { 0x0061, "4IuSIu:Qc", FALSE },
+  { 0x0063, "1Qc:", FALSE },
+  { 0x0064, "3Qc<Iu:Qc", FALSE },
+  { 0x0065, "2Qc:Iu", FALSE },
+  { 0x0066, "1Qc:", FALSE },
+  { 0x0067, "2Qc:Iu", FALSE },
+  { 0x0068, "4IuQcIu:Qc", FALSE },
+  { 0x0082, "1S:", FALSE },
+  { 0x0083, "2QbS:", FALSE },
+  { 0x0084, "1>+#Cn:", FALSE },
+  { 0x0085, "2Qb>+#Cn:", FALSE },
+  { 0x0086, "1Iu:", FALSE },
+  { 0x0087, "2QbIu:", FALSE },
+  { 0x0090, "2Qb:Is", FALSE },
+  { 0x00B0, "4IuIuIuIs:", FALSE },
+  { 0x00B1, "3IuIuIu:", FALSE },
+  { 0x00B2, "4QaIuIu:Iu", FALSE },
+  { 0x00B3, "5QaIuIu<Iu:Iu", FALSE },
+  { 0x00D2, "1Qa:", FALSE },
+  { 0x00D3, "1Qa:", FALSE },
+  { 0x00D4, "1Qa:", FALSE },
+  { 0x00D5, "1Qa:", FALSE },
+  { 0x00D6, "1Iu:", FALSE },
+#ifdef GLK_MODULE_UNICODE
+  { 0x0129, "1U:", FALSE },
+  { 0x012A, "1>+#Iu:", FALSE },
+  { 0x012C, "2QbU:", FALSE },
+  { 0x012D, "2Qb>+#Iu:", FALSE },
+  { 0x0130, "2Qb:Is", FALSE },
+  { 0x0138, "4QcIuIu:Qb", FALSE },
+  { 0x0140, "1Qa:", FALSE },
+#endif /* GLK_MODULE_UNICODE */
+  { 0, NULL, FALSE }
+};
+
+/* glkfast_call():
+   Call a Glk function directly, if it has a wrapper and the library's
+   prototype matched. Returns FALSE (having done nothing) if the call
+   should go through the full dispatcher.
+*/
+static int glkfast_call(glui32 funcnum, glui32 numargs, glui32 *arglist,
+  glui32 *retval)
+{
+  switch (funcnum) {
+
+  case 0x0001: /* exit */
+    if (!glkfast_protos[glkfast_exit].ok || numargs != 0)
+      return FALSE;
+    glk_exit();
+    return TRUE;
+  case 0x0003: /* tick */
+    if (!glkfast_protos[glkfast_tick].ok || numargs != 0)
+      return FALSE;
+    glk_tick();
+    return TRUE;
+  case 0x0004: /* gestalt */
+    if (!glkfast_protos[glkfast_gestalt].ok || numargs != 2)
+      return FALSE;
+    *retval = glk_gestalt((glui32)arglist[0], (glui32)arglist[1]);
+    return TRUE;
+  case 0x0020: /* window_iterate */
+    if (!glkfast_protos[glkfast_window_iterate].ok || numargs != 2)
+      return FALSE;
+    {
+      glui32 out1 = 0;
+      *retval = glkfast_objid(0, glk_window_iterate((winid_t)glkfast_obj(0, arglist[0]), (arglist[1] ? &out1 : NULL)));
+      if (arglist[1])
+        WriteMemory(arglist[1], (glui32)out1);
+    }
+    return TRUE;
+  case 0x0021: /* window_get_rock */
+    if (!glkfast_protos[glkfast_window_get_rock].ok || numargs != 1)
+      return FALSE;
+    *retval = glk_window_get_rock((winid_t)glkfast_obj(0, arglist[0]));
+    return TRUE;
+  case 0x0022: /* window_get_root */
+    if (!glkfast_protos[glkfast_window_get_root].ok || numargs != 0)
+      return FALSE;
+    *retval = glkfast_objid(0, glk_window_get_root());
+    return TRUE;
+  case 0x0023: /* window_open */
+    if (!glkfast_protos[glkfast_window_open].ok || numargs != 5)
+      return FALSE;
+    *retval = glkfast_objid(0, glk_window_open((winid_t)glkfast_obj(0, arglist[0]), (glui32)arglist[1], (glui32)arglist[2], (glui32)arglist[3], (glui32)arglist[4]));
+    return TRUE;
+  case 0x0025: /* window_get_size */
+    if (!glkfast_protos[glkfast_window_get_size].ok || numargs != 3)
+      return FALSE;
+    {
+      glui32 out1 = 0;
+      glui32 out2 = 0;
+      glk_window_get_size((winid_t)glkfast_obj(0, arglist[0]), (arglist[1] ? &out1 : NULL), (arglist[2] ? &out2 : NULL));
+      if (arglist[1])
+        WriteMemory(arglist[1], (glui32)out1);
+      if (arglist[2])
+        WriteMemory(arglist[2], (glui32)out2);
+    }
+    return TRUE;
+  case 0x0026: /* window_set_arrangement */
+    if (!glkfast_protos[glkfast_window_set_arrangement].ok || numargs != 4)
+      return FALSE;
+    glk_window_set_arrangement((winid_t)glkfast_obj(0, arglist[0]), (glui32)arglist[1], (glui32)arglist[2], (winid_t)glkfast_obj(0, arglist[3]));
+    return TRUE;
+  case 0x0028: /* window_get_type */
+    if (!glkfast_protos[glkfast_window_get_type].ok || numargs != 1)
+      return FALSE;
+    *retval = glk_window_get_type((winid_t)glkfast_obj(0, arglist[0]));
+    return TRUE;
+  case 0x0029: /* window_get_parent */
+    if (!glkfast_protos[glkfast_window_get_parent].ok || numargs != 1)
+      return FALSE;
+    *retval = glkfast_objid(0, glk_window_get_parent((winid_t)glkfast_obj(0, arglist[0])));
+    return TRUE;
+  case 0x002A: /* window_clear */
+    if (!glkfast_protos[glkfast_window_clear].ok || numargs != 1)
+      return FALSE;
+    glk_window_clear((winid_t)glkfast_obj(0, arglist[0]));
+    return TRUE;
+  case 0x002B: /* window_move_cursor */
+    if (!glkfast_protos[glkfast_window_move_cursor].ok || numargs != 3)
+      return FALSE;
+    glk_window_move_cursor((winid_t)glkfast_obj(0, arglist[0]), (glui32)arglist[1], (glui32)arglist[2]);
+    return TRUE;
+  case 0x002C: /* window_get_stream */
+    if (!glkfast_protos[glkfast_window_get_stream].ok || numargs != 1)
+      return FALSE;
+    *retval = glkfast_objid(1, glk_window_get_stream((winid_t)glkfast_obj(0, arglist[0])));
+    return TRUE;
+  case 0x002D: /* window_set_echo_stream */
+    if (!glkfast_protos[glkfast_window_set_echo_stream].ok || numargs != 2)
+      return FALSE;
+    glk_window_set_echo_stream((winid_t)glkfast_obj(0, arglist[0]), (strid_t)glkfast_obj(1, arglist[1]));
+    return TRUE;
+  case 0x002E: /* window_get_echo_stream */
+    if (!glkfast_protos[glkfast_window_get_echo_stream].ok || numargs != 1)
+      return FALSE;
+    *retval = glkfast_objid(1, glk_window_get_echo_stream((winid_t)glkfast_obj(0, arglist[0])));
+    return TRUE;
+  case 0x002F: /* set_window */
+    if (!glkfast_protos[glkfast_set_window].ok || numargs != 1)
+      return FALSE;
+    glk_set_window((winid_t)glkfast_obj(0, arglist[0]));
+    return TRUE;
+  case 0x0030: /* window_get_sibling */
+    if (!glkfast_protos[glkfast_window_get_sibling].ok || numargs != 1)
+      return FALSE;
+    *retval = glkfast_objid(0, glk_window_get_sibling((winid_t)glkfast_obj(0, arglist[0])));
+    return TRUE;
+  case 0x0040: /* stream_iterate */
+    if (!glkfast_protos[glkfast_stream_iterate].ok || numargs != 2)
+      return FALSE;
+    {
+      glui32 out1 = 0;
+      *retval = glkfast_objid(1, glk_stream_iterate((strid_t)glkfast_obj(1, arglist[0]), (arglist[1] ? &out1 : NULL)));
+      if (arglist[1])
+        WriteMemory(arglist[1], (glui32)out1);
+    }
+    return TRUE;
+  case 0x0041: /* stream_get_rock */
+    if (!glkfast_protos[glkfast_stream_get_rock].ok || numargs != 1)
+      return FALSE;
+    *retval = glk_stream_get_rock((strid_t)glkfast_obj(1, arglist[0]));
+    return TRUE;
+  case 0x0042: /* stream_open_file */
+    if (!glkfast_protos[glkfast_stream_open_file].ok || numargs != 3)
+      return FALSE;
+    *retval = glkfast_objid(1, glk_stream_open_file((frefid_t)glkfast_obj(2, arglist[0]), (glui32)arglist[1], (glui32)arglist[2]));
+    return TRUE;
+  case 0x0045: /* stream_set_position */
+    if (!glkfast_protos[glkfast_stream_set_position].ok || numargs != 3)
+      return FALSE;
+    glk_stream_set_position((strid_t)glkfast_obj(1, arglist[0]), (glsi32)arglist[1], (glui32)arglist[2]);
+    return TRUE;
+  case 0x0046: /* stream_get_position */
+    if (!glkfast_protos[glkfast_stream_get_position].ok || numargs != 1)
+      return FALSE;
+    *retval = glk_stream_get_position((strid_t)glkfast_obj(1, arglist[0]));
+    return TRUE;
+  case 0x0060: /* fileref_create_temp */
+    if (!glkfast_protos[glkfast_fileref_create_temp].ok || numargs != 2)
+      return FALSE;
+    *retval = glkfast_objid(2, glk_fileref_create_temp((glui32)arglist[0], (glui32)arglist[1]));
+    return TRUE;
+  case 0x0061: /* fileref_create_by_name */
+    if (!glkfast_protos[glkfast_fileref_create_by_name].ok || numargs != 3)
+      return FALSE;
+    *retval = glkfast_objid(2, glk_fileref_create_by_name((glui32)arglist[0], DecodeVMString(arglist[1]), (glui32)arglist[2]));
+    reset_temp_strings();
+    return TRUE;
+  case 0x0063: /* fileref_destroy */
+    if (!glkfast_protos[glkfast_fileref_destroy].ok || numargs != 1)
+      return FALSE;
+    glk_fileref_destroy((frefid_t)glkfast_obj(2, arglist[0]));
+    return TRUE;
+  case 0x0064: /* fileref_iterate */
+    if (!glkfast_protos[glkfast_fileref_iterate].ok || numargs != 2)
+      return FALSE;
+    {
+      glui32 out1 = 0;
+      *retval = glkfast_objid(2, glk_fileref_iterate((frefid_t)glkfast_obj(2, arglist[0]), (arglist[1] ? &out1 : NULL)));
+      if (arglist[1])
+        WriteMemory(arglist[1], (glui32)out1);
+    }
+    return TRUE;
+  case 0x0065: /* fileref_get_rock */
+    if (!glkfast_protos[glkfast_fileref_get_rock].ok || numargs != 1)
+      return FALSE;
+    *retval = glk_fileref_get_rock((frefid_t)glkfast_obj(2, arglist[0]));
+    return TRUE;
+  case 0x0066: /* fileref_delete_file */
+    if (!glkfast_protos[glkfast_fileref_delete_file].ok || numargs != 1)
+      return FALSE;
+    glk_fileref_delete_file((frefid_t)glkfast_obj(2, arglist[0]));
+    return TRUE;
+  case 0x0067: /* fileref_does_file_exist */
+    if (!glkfast_protos[glkfast_fileref_does_file_exist].ok || numargs != 1)
+      return FALSE;
+    *retval = glk_fileref_does_file_exist((frefid_t)glkfast_obj(2, arglist[0]));
+    return TRUE;
+  case 0x0068: /* fileref_create_from_fileref */
+    if (!glkfast_protos[glkfast_fileref_create_from_fileref].ok || numargs != 3)
+      return FALSE;
+    *retval = glkfast_objid(2, glk_fileref_create_from_fileref((glui32)arglist[0], (frefid_t)glkfast_obj(2, arglist[1]), (glui32)arglist[2]));
+    return TRUE;
+  case 0x0082: /* put_string */
+    if (!glkfast_protos[glkfast_put_string].ok || numargs != 1)
+      return FALSE;
+    glk_put_string(DecodeVMString(arglist[0]));
+    reset_temp_strings();
+    return TRUE;
+  case 0x0083: /* put_string_stream */
+    if (!glkfast_protos[glkfast_put_string_stream].ok || numargs != 2)
+      return FALSE;
+    glk_put_string_stream((strid_t)glkfast_obj(1, arglist[0]), DecodeVMString(arglist[1]));
+    reset_temp_strings();
+    return TRUE;
+  case 0x0084: /* put_buffer */
+    if (!glkfast_protos[glkfast_put_buffer].ok || numargs != 2)
+      return FALSE;
+    if (!arglist[0])
+      return FALSE;
+    {
+      char *arr0;
+      arr0 = glkfast_c_array(arglist[0], &arglist[1]);
+      glk_put_buffer(arr0, arglist[1]);
+      ReleaseDirectCArray(arr0, arglist[0], arglist[1], FALSE);
+    }
+    return TRUE;
+  case 0x0085: /* put_buffer_stream */
+    if (!glkfast_protos[glkfast_put_buffer_stream].ok || numargs != 3)
+      return FALSE;
+    if (!arglist[1])
+      return FALSE;
+    {
+      char *arr1;
+      arr1 = glkfast_c_array(arglist[1], &arglist[2]);
+      glk_put_buffer_stream((strid_t)glkfast_obj(1, arglist[0]), arr1, arglist[2]);
+      ReleaseDirectCArray(arr1, arglist[1], arglist[2], FALSE);
+    }
+    return TRUE;
+  case 0x0086: /* set_style */
+    if (!glkfast_protos[glkfast_set_style].ok || numargs != 1)
+      return FALSE;
+    glk_set_style((glui32)arglist[0]);
+    return TRUE;
+  case 0x0087: /* set_style_stream */
+    if (!glkfast_protos[glkfast_set_style_stream].ok || numargs != 2)
+      return FALSE;
+    glk_set_style_stream((strid_t)glkfast_obj(1, arglist[0]), (glui32)arglist[1]);
+    return TRUE;
+  case 0x0090: /* get_char_stream */
+    if (!glkfast_protos[glkfast_get_char_stream].ok || numargs != 1)
+      return FALSE;
+    *retval = (glui32)(glsi32)glk_get_char_stream((strid_t)glkfast_obj(1, arglist[0]));
+    return TRUE;
+  case 0x00B0: /* stylehint_set */
+    if (!glkfast_protos[glkfast_stylehint_set].ok || numargs != 4)
+      return FALSE;
+    glk_stylehint_set((glui32)arglist[0], (glui32)arglist[1], (glui32)arglist[2], (glsi32)arglist[3]);
+    return TRUE;
+  case 0x00B1: /* stylehint_clear */
+    if (!glkfast_protos[glkfast_stylehint_clear].ok || numargs != 3)
+      return FALSE;
+    glk_stylehint_clear((glui32)arglist[0], (glui32)arglist[1], (glui32)arglist[2]);
+    return TRUE;
+  case 0x00B2: /* style_distinguish */
+    if (!glkfast_protos[glkfast_style_distinguish].ok || numargs != 3)
+      return FALSE;
+    *retval = glk_style_distinguish((winid_t)glkfast_obj(0, arglist[0]), (glui32)arglist[1], (glui32)arglist[2]);
+    return TRUE;
+  case 0x00B3: /* style_measure */
+    if (!glkfast_protos[glkfast_style_measure].ok || numargs != 4)
+      return FALSE;
+    {
+      glui32 out3 = 0;
+      *retval = glk_style_measure((winid_t)glkfast_obj(0, arglist[0]), (glui32)arglist[1], (glui32)arglist[2], (arglist[3] ? &out3 : NULL));
+      if (arglist[3])
+        WriteMemory(arglist[3], (glui32)out3);
+    }
+    return TRUE;
+  case 0x00D2: /* request_char_event */
+    if (!glkfast_protos[glkfast_request_char_event].ok || numargs != 1)
+      return FALSE;
+    glk_request_char_event((winid_t)glkfast_obj(0, arglist[0]));
+    return TRUE;
+  case 0x00D3: /* cancel_char_event */
+    if (!glkfast_protos[glkfast_cancel_char_event].ok || numargs != 1)
+      return FALSE;
+    glk_cancel_char_event((winid_t)glkfast_obj(0, arglist[0]));
+    return TRUE;
+  case 0x00D4: /* request_mouse_event */
+    if (!glkfast_protos[glkfast_request_mouse_event].ok || numargs != 1)
+      return FALSE;
+    glk_request_mouse_event((winid_t)glkfast_obj(0, arglist[0]));
+    return TRUE;
+  case 0x00D5: /* cancel_mouse_event */
+    if (!glkfast_protos[glkfast_cancel_mouse_event].ok || numargs != 1)
+      return FALSE;
+    glk_cancel_mouse_event((winid_t)glkfast_obj(0, arglist[0]));
+    return TRUE;
+  case 0x00D6: /* request_timer_events */
+    if (!glkfast_protos[glkfast_request_timer_events].ok || numargs != 1)
+      return FALSE;
+    glk_request_timer_events((glui32)arglist[0]);
+    return TRUE;
+#ifdef GLK_MODULE_UNICODE
+  case 0x0129: /* put_string_uni */
+    if (!glkfast_protos[glkfast_put_string_uni].ok || numargs != 1)
+      return FALSE;
+    glk_put_string_uni(DecodeVMUstring(arglist[0]));
+    reset_temp_strings();
+    return TRUE;
+  case 0x012A: /* put_buffer_uni */
+    if (!glkfast_protos[glkfast_put_buffer_uni].ok || numargs != 2)
+      return FALSE;
+    if (!arglist[0])
+      return FALSE;
+    {
+      glui32 *arr0;
+      arr0 = glkfast_i_array(arglist[0], &arglist[1]);
+      glk_put_buffer_uni(arr0, arglist[1]);
+      ReleaseIArray(arr0, arglist[0], arglist[1], FALSE);
+    }
+    return TRUE;
+  case 0x012C: /* put_string_stream_uni */
+    if (!glkfast_protos[glkfast_put_string_stream_uni].ok || numargs != 2)
+      return FALSE;
+    glk_put_string_stream_uni((strid_t)glkfast_obj(1, arglist[0]), DecodeVMUstring(arglist[1]));
+    reset_temp_strings();
+    return TRUE;
+  case 0x012D: /* put_buffer_stream_uni */
+    if (!glkfast_protos[glkfast_put_buffer_stream_uni].ok || numargs != 3)
+      return FALSE;
+    if (!arglist[1])
+      return FALSE;
+    {
+      glui32 *arr1;
+      arr1 = glkfast_i_array(arglist[1], &arglist[2]);
+      glk_put_buffer_stream_uni((strid_t)glkfast_obj(1, arglist[0]), arr1, arglist[2]);
+      ReleaseIArray(arr1, arglist[1], arglist[2], FALSE);
+    }
+    return TRUE;
+  case 0x0130: /* get_char_stream_uni */
+    if (!glkfast_protos[glkfast_get_char_stream_uni].ok || numargs != 1)
+      return FALSE;
+    *retval = (glui32)(glsi32)glk_get_char_stream_uni((strid_t)glkfast_obj(1, arglist[0]));
+    return TRUE;
+  case 0x0138: /* stream_open_file_uni */
+    if (!glkfast_protos[glkfast_stream_open_file_uni].ok || numargs != 3)
+      return FALSE;
+    *retval = glkfast_objid(1, glk_stream_open_file_uni((frefid_t)glkfast_obj(2, arglist[0]), (glui32)arglist[1], (glui32)arglist[2]));
+    return TRUE;
+  case 0x0140: /* request_char_event_uni */
+    if (!glkfast_protos[glkfast_request_char_event_uni].ok || numargs != 1)
+      return FALSE;
+    glk_request_char_event_uni((winid_t)glkfast_obj(0, arglist[0]));
+    return TRUE;
+#endif /* GLK_MODULE_UNICODE */
+
+  default:
+    return FALSE;
+  }
+}
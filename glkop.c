@@ -17,6 +17,11 @@
      The array can be turned into a C char array by the macro
      CaptureCArray(addr, len), and released by ReleaseCArray().
      The passin, passout hints may be used to avoid unnecessary copying.
+     If the library will not hold onto the array after the call returns,
+     the macros CaptureDirectCArray(addr, len) and ReleaseDirectCArray()
+     are used instead; these may hand over a pointer straight into VM
+     memory. (A retained array must be a copy, since VM memory may be
+     moved or resized before the library lets go of it.)
    - An integer array is a sequence of integers somewhere in VM memory.
      The array can be turned into a C integer array by the macro
      CaptureIArray(addr, len), and released by ReleaseIArray().
@@ -55,6 +60,10 @@
     (grab_temp_c_array(addr, len, passin))
 #define ReleaseCArray(ptr, addr, len, passout)  \
     (release_temp_c_array(ptr, addr, len, passout))
+#define CaptureDirectCArray(addr, len, passout)  \
+    (grab_direct_c_array(addr, len, passout))
+#define ReleaseDirectCArray(ptr, addr, len, passout)  \
+    (release_direct_c_array(ptr, addr, len, passout))
 #define CaptureIArray(addr, len, passin)  \
     (grab_temp_i_array(addr, len, passin))
 #define ReleaseIArray(ptr, addr, len, passout)  \
@@ -73,31 +82,71 @@
       : (MemW4((addr)+(fieldnum)*4, (val))))
 #define DecodeVMString(addr)  \
     (make_temp_string(addr))
+/* Temporary strings all live in an arena, which perform_glk() resets
+   at the end of the call; there's nothing to release one at a time. */
 #define ReleaseVMString(ptr)  \
-    (free_temp_string(ptr))
+    (0)
 #define DecodeVMUstring(addr)  \
     (make_temp_ustring(addr))
 #define ReleaseVMUstring(ptr)  \
-    (free_temp_ustring(ptr))
+    (0)
 
+#include <stdio.h>
 #include <time.h>
+#include <string.h>
 #include "glk.h"
 #include "glulxe.h"
 #include "gi_dispa.h"
 
 typedef struct dispatch_splot_struct {
-  int numwanted;
-  int maxargs;
   gluniversal_t *garglist;
   glui32 *varglist;
   int numvargs;
   glui32 *retval;
 } dispatch_splot_t;
 
-/* We maintain a linked list of arrays being used for Glk calls. It is
-   only used for integer (glui32) arrays -- char arrays are handled in
-   place. It's not worth bothering with a hash table, since most
-   arrays appear here only momentarily. */
+/* Each Glk function's prototype string is compiled, the first time the
+   function is called, into a plan: an array of glkarg_t, one for each
+   argument. A struct argument is followed directly by the arguments
+   for its fields. The plans are kept in a hash table by function
+   number. */
+
+typedef struct glkarg_struct {
+  char typeclass; /* 'I', 'C', 'Q', 'S', 'U', or '[' for a struct */
+  char subtype; /* 'u', 's', or 'n' for I and C; the class letter for Q */
+  unsigned char flags; /* glkarg_IsRef, etc */
+  unsigned char numsub; /* for a struct, the number of fields */
+  int span; /* entries taken up by this argument, including fields */
+} glkarg_t;
+
+#define glkarg_IsRef (0x01)
+#define glkarg_PassIn (0x02)
+#define glkarg_PassOut (0x04)
+#define glkarg_NullOk (0x08)
+#define glkarg_IsArray (0x10)
+#define glkarg_IsReturn (0x20)
+#define glkarg_Retained (0x40)
+
+typedef struct glkplan_struct {
+  glui32 funcnum;
+  int numargs; /* top-level arguments */
+  int numops; /* entries in args, including struct fields */
+  int maxargs; /* gluniversal_t entries needed */
+  int numvargs; /* Glulx arguments expected */
+  glkarg_t *args;
+  struct glkplan_struct *next;
+} glkplan_t;
+
+#define GLKPLAN_HASH_SIZE (64)
+static glkplan_t *glkplans[GLKPLAN_HASH_SIZE];
+
+/* We maintain a hash table of arrays being used for Glk calls, keyed
+   by the address of the native array. Most arrays appear here only
+   momentarily, but retained arrays (line input buffers, sound and I/O
+   buffers) can pile up, and every Glk call with an array argument has
+   to re-find its entry. The arrayref_t nodes are allocated in blocks
+   and recycled through a free list, so registering an array doesn't
+   cost a malloc of its own. */
 
 typedef struct arrayref_struct arrayref_t;
 struct arrayref_struct {
@@ -109,26 +158,47 @@ struct arrayref_struct {
   arrayref_t *next;
 };
 
-static arrayref_t *arrays = NULL;
-
-/* We maintain a hash table for each opaque Glk class. classref_t are the
-    nodes of the table, and classtable_t are the tables themselves. */
+#define ARRAYHASH_SIZE (64)
+#define ARRAYREF_BLOCK (32)
+static arrayref_t *arrays[ARRAYHASH_SIZE];
+static arrayref_t *free_arrayrefs = NULL;
+
+static arrayref_t *new_arrayref(void *array, glui32 addr, glui32 elemsize,
+  glui32 len);
+static arrayref_t **find_arrayref(void *array);
+static void free_arrayref(arrayref_t **aptr);
+
+/* We maintain a table for each opaque Glk class, indexed directly by
+    object ID. IDs are handed out sequentially, so the table is a
+    directory of fixed-size pages; each page holds CLASSPAGE_SIZE
+    consecutive IDs. A page is allocated when the first object in its
+    range is registered, and freed when the last one goes away, so a
+    game which churns through many short-lived streams only keeps the
+    pages it's still using. classref_t are the slots in the pages, and
+    classtable_t are the tables themselves. */
 
 typedef struct classref_struct classref_t;
 struct classref_struct {
   void *obj;
   glui32 id;
-  int bucknum;
-  classref_t *next;
 };
 
-#define CLASSHASH_SIZE (31)
+#define CLASSPAGE_SHIFT (8)
+#define CLASSPAGE_SIZE (1 << CLASSPAGE_SHIFT)
+#define CLASSPAGE_MASK (CLASSPAGE_SIZE - 1)
+
+typedef struct classpage_struct {
+  int count; /* number of slots in use */
+  classref_t slot[CLASSPAGE_SIZE];
+} classpage_t;
+
 typedef struct classtable_struct {
   glui32 lastid;
-  classref_t *bucket[CLASSHASH_SIZE];
+  glui32 numpages; /* allocated size of the pages array */
+  classpage_t **pages;
 } classtable_t;
 
-/* The list of hash tables, for the classes. */
+/* The list of tables, for the classes. */
 static int num_classes = 0;
 classtable_t **classes = NULL;
 
@@ -160,21 +230,160 @@ static void (*library_select_hook)(glui32, glui32, glui32, glui32) = NULL;
 
 static char *grab_temp_c_array(glui32 addr, glui32 len, int passin);
 static void release_temp_c_array(char *arr, glui32 addr, glui32 len, int passout);
+static char *grab_direct_c_array(glui32 addr, glui32 len, int passout);
+static void release_direct_c_array(char *arr, glui32 addr, glui32 len, int passout);
 static glui32 *grab_temp_i_array(glui32 addr, glui32 len, int passin);
 static void release_temp_i_array(glui32 *arr, glui32 addr, glui32 len, int passout);
 static void **grab_temp_ptr_array(glui32 addr, glui32 len, int objclass, int passin);
 static void release_temp_ptr_array(void **arr, glui32 addr, glui32 len, int objclass, int passout);
 
-static void prepare_glk_args(char *proto, dispatch_splot_t *splot);
-static void parse_glk_args(dispatch_splot_t *splot, char **proto, int depth,
-  int *argnumptr, glui32 subaddress, int subpassin);
-static void unparse_glk_args(dispatch_splot_t *splot, char **proto, int depth,
-  int *argnumptr, glui32 subaddress, int subpassout);
+static glkplan_t *find_glk_plan(glui32 funcnum);
+static int compile_glk_args(glkplan_t *plan, char **proto, int depth,
+  int *sizeptr);
+static void prepare_glk_args(glkplan_t *plan, dispatch_splot_t *splot);
+static void parse_glk_args(dispatch_splot_t *splot, glkarg_t *args,
+  int numwanted, int depth, int *argnumptr, glui32 subaddress,
+  int subpassin);
+static void unparse_glk_args(dispatch_splot_t *splot, glkarg_t *args,
+  int numwanted, int depth, int *argnumptr, glui32 subaddress,
+  int subpassout);
 
 static char *get_game_id(void);
 
+/* If the --glkstats option is used, we count every Glk call, and keep
+   a histogram of how long each selector takes. The buckets are powers
+   of two in microseconds: bucket 0 is under 1us, bucket n is
+   2^(n-1) up to 2^n us, and the last bucket catches everything
+   longer. Calls which wait for the player (glk_select() and file
+   prompts) are timed the same way but reported apart, so that they
+   don't swamp the time spent in the library itself. Sending buffered
+   output before a call is timed separately too, under the made-up
+   selector GLKSTATS_FLUSH; otherwise it would be charged to whichever
+   call came next, which is usually glk_select(). */
+
+#define GLKSTATS_BUCKETS (24)
+#define GLKSTATS_HASH_SIZE (64)
+#define GLKSTATS_FLUSH (0x10000)
+
+typedef struct glkstat_struct {
+  glui32 funcnum;
+  int waits; /* blocks for player input */
+  glui32 count;
+  double total; /* microseconds */
+  glui32 max;
+  glui32 hist[GLKSTATS_BUCKETS];
+  struct glkstat_struct *next;
+} glkstat_t;
+
+static glkstat_t *glkstats[GLKSTATS_HASH_SIZE];
+static int glkstats_count = 0;
+static int glkstats_enabled = FALSE;
+static void (*glkstats_dump_func)(void) = NULL;
+
+/* Set from a signal handler to ask for a report at the next Glk call. */
+volatile sig_atomic_t glkstats_dump_requested = FALSE;
+
+static glui32 dispatch_glk(glui32 funcnum, glui32 numargs, glui32 *arglist);
+static void glkstats_record(glui32 funcnum, glui32 elapsed);
+static int glkstats_compare(void *p1, void *p2);
+
+/* With the --record option, every event that glk_select() or
+   glk_select_poll() returns is logged, along with whatever the library
+   wrote into VM memory during the call (line input, that is) and the
+   state of the RNG afterwards. With --replay, those calls never reach
+   the library; the events are read back from the log instead, so the
+   same session can be rerun exactly, with no player and no UI.
+
+   The log is binary, with all numbers stored as big-endian words. It
+   begins with the header "GlkR", a version number (1), and the RNG
+   seed. Each event is then the byte 'E'; the event type, window ID,
+   val1 and val2; the RNG's usenative flag and its four state words;
+   the number of memory ranges written; and for each range, its
+   address, its length in bytes, and the bytes themselves. */
+
+#define glkrecord_None (0)
+#define glkrecord_Record (1)
+#define glkrecord_Replay (2)
+
+typedef struct glkrange_struct {
+  glui32 addr;
+  glui32 len; /* bytes */
+} glkrange_t;
+
+static int glkrecord_mode = glkrecord_None;
+static strid_t glkrecord_stream = NULL;
+static int glkrecord_capturing = FALSE;
+static glkrange_t *glkrecord_ranges = NULL;
+static int glkrecord_numranges = 0;
+static int glkrecord_maxranges = 0;
+
+static glui32 glkrecord_select(glui32 funcnum, glui32 numargs,
+  glui32 *arglist);
+static void glkrecord_note_range(glui32 addr, glui32 len);
+static void glkrecord_put_word(glui32 val);
+static glui32 glkrecord_get_word(void);
+
+/* With the --glkdefer option, calls which only produce output --
+   printing to the current stream, glk_set_style(), glk_window_clear(),
+   glk_window_move_cursor() -- don't go to the library right away.
+   They are queued, and the queue is sent over in order before any
+   other Glk call, since that call might wait for input or read back
+   state which depends on the output. A style change or cursor move
+   which is replaced before anything else happens is dropped.
+
+   Text doesn't go in the queue. It's copied out of VM memory into
+   string.c's output buffer, like everything else the game prints, and
+   each queued call records how much of that buffer came before it.
+   So adjacent runs of text are sent as one buffer, and
+   stream_flush_output() still means "send everything to Glk now". */
+
+#define glkdefer_Style (1)
+#define glkdefer_Clear (2)
+#define glkdefer_Cursor (3)
+
+/* The queue is sent over early if it fills up (or the output buffer
+   does), so a game which prints for a long time without asking for
+   input still shows its progress. */
+#define GLKDEFER_MAXCMDS (256)
+
+typedef struct glkdefer_struct {
+  int op;
+  glui32 textpos; /* how much of the output buffer goes first */
+  winid_t win; /* Clear, Cursor */
+  glui32 val1, val2; /* Style: the style; Cursor: the position */
+} glkdefer_t;
+
+int glkdefer_enabled = FALSE;
+static int glkdefer_unicode = FALSE;
+static glkdefer_t glkdefer_cmds[GLKDEFER_MAXCMDS];
+static glui32 glkdefer_numcmds = 0;
+
+static int glkdefer_takes(glui32 funcnum, glui32 numargs, glui32 *arglist);
+static int glkdefer_call(glui32 funcnum, glui32 numargs, glui32 *arglist);
+static glkdefer_t *glkdefer_add(int op);
+static glkdefer_t *glkdefer_last(int op);
+
+/* Glk functions whose arguments are all plain values are called
+   directly, through wrappers generated from the dispatch layer's
+   prototype table by glkfast-gen.py. Each wrapper is only used if the
+   library we're linked with has the same prototype. */
+
+typedef struct glkfast_proto_struct {
+  glui32 funcnum;
+  char *proto;
+  int ok;
+} glkfast_proto_t;
+
+static void *glkfast_obj(int classid, glui32 objid);
+static glui32 glkfast_objid(int classid, void *obj);
+static char *glkfast_c_array(glui32 addr, glui32 *lenptr);
+static glui32 *glkfast_i_array(glui32 addr, glui32 *lenptr);
+static void glkfast_check(void);
+
+#include "glkfast.h"
+
 /* init_dispatch():
-   Set up the class hash tables and other startup-time stuff.
+   Set up the class tables and other startup-time stuff.
 */
 int init_dispatch()
 {
@@ -192,19 +401,32 @@ int init_dispatch()
   gidispatch_set_game_id_hook(&get_game_id);
 #endif /* GI_DISPA_GAME_ID_AVAILABLE */
     
-  /* Allocate the class hash tables. */
+  /* Allocate the class tables. */
   num_classes = gidispatch_count_classes();
   classes = (classtable_t **)glulx_malloc(num_classes 
     * sizeof(classtable_t *));
   if (!classes)
     return FALSE;
 
-  randish = time(NULL) % 101;
+  /* When recording or replaying, object IDs must come out the same
+     on every run. */
+  if (glkrecord_mode)
+    randish = 0;
+  else
+    randish = time(NULL) % 101;
   for (ix=0; ix<num_classes; ix++) {
     classes[ix] = new_classtable(1+120*ix+randish);
     if (!classes[ix])
       return FALSE;
   }
+
+  /* See which of the generated wrappers match this library. */
+  glkfast_check();
+
+  /* Deferred text is sent as Unicode if the library can take it. */
+#ifdef GLK_MODULE_UNICODE
+  glkdefer_unicode = (glk_gestalt(gestalt_Unicode, 0) != 0);
+#endif /* GLK_MODULE_UNICODE */
     
   /* Set up the two callbacks. */
   gidispatch_set_object_registry(&glulxe_classtable_register, 
@@ -224,12 +446,62 @@ int init_dispatch()
 
 /* perform_glk():
    Turn a list of Glulx arguments into a list of Glk arguments,
-   dispatch the function call, and return the result. 
+   dispatch the function call, and return the result. If Glk
+   statistics are on, the call is timed as well.
 */
 glui32 perform_glk(glui32 funcnum, glui32 numargs, glui32 *arglist)
+{
+  glui32 retval, starttime;
+
+  if (funcnum == 0x0001) {
+    /* glk_exit() doesn't return, so this is our last chance to finish
+       off reports and logs. */
+    profile_quit();
+    glkstats_quit();
+    glkrecord_quit();
+  }
+
+  if (!glkstats_enabled)
+    return dispatch_glk(funcnum, numargs, arglist);
+
+  if (glkstats_dump_requested) {
+    glkstats_dump_requested = FALSE;
+    glkstats_dump_func();
+  }
+
+  /* Send any waiting output now, if dispatch_glk() would, so that it's
+     timed on its own. */
+  if (funcnum != 0x0080 && funcnum != 0x0128
+    && !(glkdefer_enabled && glkdefer_takes(funcnum, numargs, arglist))
+    && (stream_output_pos() || glkdefer_numcmds)) {
+    starttime = glulx_microseconds();
+    stream_flush_output();
+    glkstats_record(GLKSTATS_FLUSH, glulx_microseconds() - starttime);
+  }
+
+  starttime = glulx_microseconds();
+  retval = dispatch_glk(funcnum, numargs, arglist);
+  glkstats_record(funcnum, glulx_microseconds() - starttime);
+  return retval;
+}
+
+/* dispatch_glk():
+   The guts of perform_glk().
+*/
+static glui32 dispatch_glk(glui32 funcnum, glui32 numargs, glui32 *arglist)
 {
   glui32 retval = 0;
 
+  /* Output-only calls can wait in the deferred queue, if that's on. */
+  if (glkdefer_enabled && glkdefer_call(funcnum, numargs, arglist))
+    return 0;
+
+  /* Printing to the current stream can join the output buffer. Any
+     other call might depend on the output so far (or change the
+     current stream), so flush it first. */
+  if (funcnum != 0x0080 && funcnum != 0x0128)
+    stream_flush_output();
+
   switch (funcnum) {
     /* To speed life up, we implement commonly-used Glk functions
        directly -- instead of bothering with the whole prototype 
@@ -256,7 +528,7 @@ glui32 perform_glk(glui32 funcnum, glui32 numargs, glui32 *arglist)
   case 0x0080: /* put_char */
     if (numargs != 1)
       goto WrongArgNum;
-    glk_put_char(arglist[0] & 0xFF);
+    stream_buffer_char(arglist[0] & 0xFF);
     break;
   case 0x0081: /* put_char_stream */
     if (numargs != 2)
@@ -267,9 +539,19 @@ glui32 perform_glk(glui32 funcnum, glui32 numargs, glui32 *arglist)
     /* call a library hook on every glk_select() */
     if (library_select_hook)
       library_select_hook(0x00C0, arglist[0], 0, 0);
+    if (glkrecord_mode) {
+      retval = glkrecord_select(funcnum, numargs, arglist);
+      break;
+    }
     /* but then fall through to full dispatcher, because there's no real
        need for speed here */
     goto FullDispatcher;
+  case 0x00C1: /* select_poll */
+    if (glkrecord_mode) {
+      retval = glkrecord_select(funcnum, numargs, arglist);
+      break;
+    }
+    goto FullDispatcher;
   case 0x00A0: /* char_to_lower */
     if (numargs != 1)
       goto WrongArgNum;
@@ -283,7 +565,7 @@ glui32 perform_glk(glui32 funcnum, glui32 numargs, glui32 *arglist)
   case 0x0128: /* put_char_uni */
     if (numargs != 1)
       goto WrongArgNum;
-    glk_put_char_uni(arglist[0]);
+    stream_buffer_char(arglist[0]);
     break;
   case 0x012B: /* put_char_stream_uni */
     if (numargs != 2)
@@ -295,46 +577,48 @@ glui32 perform_glk(glui32 funcnum, glui32 numargs, glui32 *arglist)
     fatal_error("Wrong number of arguments to Glk function.");
     break;
 
-  FullDispatcher:
-  default: {
+  default:
+    /* Most functions with plain arguments have a direct wrapper. */
+    if (glkfast_call(funcnum, numargs, arglist, &retval))
+      break;
+    /* ...otherwise, fall through. */
+
+  FullDispatcher: {
     /* Go through the full dispatcher prototype foo. */
-    char *proto, *cx;
+    glkplan_t *plan;
     dispatch_splot_t splot;
     int argnum, argnum2;
 
-    /* Grab the string. */
-    proto = gidispatch_prototype(funcnum);
-    if (!proto)
-      fatal_error("Unknown Glk function.");
+    /* Grab the plan, compiling the prototype string if need be. */
+    plan = find_glk_plan(funcnum);
 
     splot.varglist = arglist;
     splot.numvargs = numargs;
     splot.retval = &retval;
 
-    /* The work goes in four phases. First, we figure out how many
-       arguments we want, and allocate space for the Glk argument
-       list. Then we go through the Glulxe arguments and load them 
-       into the Glk list. Then we call. Then we go through the 
-       arguments again, unloading the data back into Glulx memory. */
+    /* The work goes in four phases. First, we check the argument
+       count, and allocate space for the Glk argument list. Then we go
+       through the Glulxe arguments and load them into the Glk list.
+       Then we call. Then we go through the arguments again, unloading
+       the data back into Glulx memory. */
 
     /* Phase 0. */
-    prepare_glk_args(proto, &splot);
+    prepare_glk_args(plan, &splot);
 
     /* Phase 1. */
     argnum = 0;
-    cx = proto;
-    parse_glk_args(&splot, &cx, 0, &argnum, 0, 0);
+    parse_glk_args(&splot, plan->args, plan->numargs, 0, &argnum, 0, 0);
 
     /* Phase 2. */
     gidispatch_call(funcnum, argnum, splot.garglist);
 
     /* Phase 3. */
     argnum2 = 0;
-    cx = proto;
-    unparse_glk_args(&splot, &cx, 0, &argnum2, 0, 0);
+    unparse_glk_args(&splot, plan->args, plan->numargs, 0, &argnum2, 0, 0);
     if (argnum != argnum2)
       fatal_error("Argument counts did not match.");
 
+    reset_temp_strings();
     break;
   }
   }
@@ -393,99 +677,182 @@ static char *read_prefix(char *cx, int *isref, int *isarray,
   return cx;
 }
 
-/* prepare_glk_args():
-   This reads through the prototype string, and pulls Floo objects off the
-   stack. It also works out the maximal number of gluniversal_t objects
-   which could be used by the Glk call in question. It then allocates
-   space for them.
+/* find_glk_plan():
+   Return the compiled plan for a Glk function, compiling it from the
+   prototype string if this is the first call.
 */
-static void prepare_glk_args(char *proto, dispatch_splot_t *splot)
+static glkplan_t *find_glk_plan(glui32 funcnum)
 {
-  static gluniversal_t *garglist = NULL;
-  static int garglist_size = 0;
+  int bucknum = (funcnum % GLKPLAN_HASH_SIZE);
+  glkplan_t *plan;
+  char *proto, *cx;
+  int size;
+
+  for (plan = glkplans[bucknum]; plan; plan = plan->next) {
+    if (plan->funcnum == funcnum)
+      return plan;
+  }
 
-  int ix;
-  int numwanted, numvargswanted, maxargs;
-  char *cx;
+  proto = gidispatch_prototype(funcnum);
+  if (!proto)
+    fatal_error("Unknown Glk function.");
+
+  plan = (glkplan_t *)glulx_malloc(sizeof(glkplan_t));
+  if (!plan)
+    fatal_error("Unable to allocate Glk call plan.");
+  plan->funcnum = funcnum;
+  plan->numargs = 0;
+  plan->numops = 0;
+  plan->maxargs = 0;
+  plan->numvargs = 0;
+  plan->args = NULL;
+  size = 0;
 
   cx = proto;
+  plan->numargs = compile_glk_args(plan, &cx, 0, &size);
+
+  plan->next = glkplans[bucknum];
+  glkplans[bucknum] = plan;
+  return plan;
+}
+
+/* compile_glk_args():
+   Read one level of a prototype string (the top level, or the inside
+   of a struct) and append an argument for each element to the plan.
+   A struct argument is followed directly by its fields. Returns the
+   number of elements read.
+*/
+static int compile_glk_args(glkplan_t *plan, char **proto, int depth,
+  int *sizeptr)
+{
+  char *cx;
+  int argx, numwanted, argnum;
+  glkarg_t *arg;
+
+  cx = *proto;
+
   numwanted = 0;
   while (*cx >= '0' && *cx <= '9') {
     numwanted = 10 * numwanted + (*cx - '0');
     cx++;
   }
-  splot->numwanted = numwanted;
 
-  maxargs = 0; 
-  numvargswanted = 0; 
-  for (ix = 0; ix < numwanted; ix++) {
+  for (argx = 0; argx < numwanted; argx++) {
     int isref, passin, passout, nullok, isarray, isretained, isreturn;
+    char typeclass, subtype;
+    int flags, numsub;
+
     cx = read_prefix(cx, &isref, &isarray, &passin, &passout, &nullok,
       &isretained, &isreturn);
-    if (isref) {
-      maxargs += 2;
-    }
-    else {
-      maxargs += 1;
-    }
-    if (!isreturn) {
-      if (isarray) {
-        numvargswanted += 2;
-      }
-      else {
-        numvargswanted += 1;
-      }
-    }
-        
-    if (*cx == 'I' || *cx == 'C') {
-      cx += 2;
-    }
-    else if (*cx == 'Q') {
-      cx += 2;
-    }
-    else if (*cx == 'S' || *cx == 'U') {
-      cx += 1;
+
+    flags = 0;
+    if (isref) flags |= glkarg_IsRef;
+    if (passin) flags |= glkarg_PassIn;
+    if (passout) flags |= glkarg_PassOut;
+    if (nullok) flags |= glkarg_NullOk;
+    if (isarray) flags |= glkarg_IsArray;
+    if (isreturn) flags |= glkarg_IsReturn;
+    if (isretained) flags |= glkarg_Retained;
+
+    if (plan->numops >= *sizeptr) {
+      *sizeptr = (*sizeptr ? 2 * *sizeptr : 8);
+      plan->args = (glkarg_t *)glulx_realloc(plan->args,
+        *sizeptr * sizeof(glkarg_t));
+      if (!plan->args)
+        fatal_error("Unable to allocate Glk call plan.");
     }
-    else if (*cx == '[') {
-      int refdepth, nwx;
+    argnum = plan->numops;
+    plan->numops++;
+
+    if (depth == 0 && !isreturn)
+      plan->numvargs += (isarray ? 2 : 1);
+    if (isref)
+      plan->maxargs += 1;
+
+    typeclass = *cx;
+    cx++;
+    subtype = 0;
+    numsub = 0;
+
+    switch (typeclass) {
+    case 'I':
+      subtype = *cx;
       cx++;
-      nwx = 0;
-      while (*cx >= '0' && *cx <= '9') {
-        nwx = 10 * nwx + (*cx - '0');
-        cx++;
-      }
-      maxargs += nwx; /* This is *only* correct because all structs contain
-                         plain values. */
-      refdepth = 1;
-      while (refdepth > 0) {
-        if (*cx == '[')
-          refdepth++;
-        else if (*cx == ']')
-          refdepth--;
-        cx++;
-      }
-    }
-    else {
+      if (!isarray && subtype != 'u' && subtype != 's')
+        fatal_error("Illegal format string.");
+      plan->maxargs += (isarray ? 2 : 1);
+      break;
+    case 'C':
+      subtype = *cx;
+      cx++;
+      if (!isarray && subtype != 'u' && subtype != 's' && subtype != 'n')
+        fatal_error("Illegal format string.");
+      plan->maxargs += (isarray ? 2 : 1);
+      break;
+    case 'Q':
+      subtype = *cx;
+      cx++;
+      plan->maxargs += (isarray ? 2 : 1);
+      break;
+    case 'S':
+    case 'U':
+      if (isarray)
+        fatal_error("Illegal format string.");
+      plan->maxargs += 1;
+      break;
+    case '[':
+      if (isarray)
+        fatal_error("Illegal format string.");
+      numsub = compile_glk_args(plan, &cx, depth+1, sizeptr);
+      break;
+    default:
       fatal_error("Illegal format string.");
+      break;
     }
+
+    arg = &plan->args[argnum];
+    arg->typeclass = typeclass;
+    arg->subtype = subtype;
+    arg->flags = flags;
+    arg->numsub = numsub;
+    arg->span = plan->numops - argnum;
+  }
+
+  if (depth > 0) {
+    if (*cx != ']')
+      fatal_error("Illegal format string.");
+    cx++;
+  }
+  else {
+    if (*cx != ':' && *cx != '\0')
+      fatal_error("Illegal format string.");
   }
 
-  if (*cx != ':' && *cx != '\0')
-    fatal_error("Illegal format string.");
+  *proto = cx;
+  return numwanted;
+}
 
-  splot->maxargs = maxargs;
+/* prepare_glk_args():
+   This checks the number of Glulx arguments against the plan, and
+   makes sure there's space for the gluniversal_t objects which the
+   Glk call will use.
+*/
+static void prepare_glk_args(glkplan_t *plan, dispatch_splot_t *splot)
+{
+  static gluniversal_t *garglist = NULL;
+  static int garglist_size = 0;
 
-  if (splot->numvargs != numvargswanted)
+  if (splot->numvargs != plan->numvargs)
     fatal_error("Wrong number of arguments to Glk function.");
 
-  if (garglist && garglist_size < maxargs) {
+  if (garglist && garglist_size < plan->maxargs) {
     glulx_free(garglist);
     garglist = NULL;
     garglist_size = 0;
   }
   if (!garglist) {
-    garglist_size = maxargs + 16;
-    garglist = (gluniversal_t *)glulx_malloc(garglist_size 
+    garglist_size = plan->maxargs + 16;
+    garglist = (gluniversal_t *)glulx_malloc(garglist_size
       * sizeof(gluniversal_t));
   }
   if (!garglist)
@@ -496,43 +863,33 @@ static void prepare_glk_args(char *proto, dispatch_splot_t *splot)
 
 /* parse_glk_args():
    This long and unpleasant function translates a set of Floo objects into
-   a gluniversal_t array. It's recursive, too, to deal with structures.
+   a gluniversal_t array, following the plan. It's recursive, too, to
+   deal with structures.
 */
-static void parse_glk_args(dispatch_splot_t *splot, char **proto, int depth,
-  int *argnumptr, glui32 subaddress, int subpassin)
+static void parse_glk_args(dispatch_splot_t *splot, glkarg_t *args,
+  int numwanted, int depth, int *argnumptr, glui32 subaddress,
+  int subpassin)
 {
-  char *cx;
+  glkarg_t *arg;
   int ix, argx;
-  int gargnum, numwanted;
+  int gargnum;
   void *opref;
   gluniversal_t *garglist;
   glui32 *varglist;
-  
+
   garglist = splot->garglist;
   varglist = splot->varglist;
   gargnum = *argnumptr;
-  cx = *proto;
 
-  numwanted = 0;
-  while (*cx >= '0' && *cx <= '9') {
-    numwanted = 10 * numwanted + (*cx - '0');
-    cx++;
-  }
-
-  for (argx = 0, ix = 0; argx < numwanted; argx++, ix++) {
-    char typeclass;
+  for (argx = 0, ix = 0, arg = args; argx < numwanted;
+       argx++, ix++, arg += arg->span) {
+    int flags = arg->flags;
     int skipval;
-    int isref, passin, passout, nullok, isarray, isretained, isreturn;
-    cx = read_prefix(cx, &isref, &isarray, &passin, &passout, &nullok,
-      &isretained, &isreturn);
-    
-    typeclass = *cx;
-    cx++;
 
     skipval = FALSE;
-    if (isref) {
-      if (!isreturn && varglist[ix] == 0) {
-        if (!nullok)
+    if (flags & glkarg_IsRef) {
+      if (!(flags & glkarg_IsReturn) && varglist[ix] == 0) {
+        if (!(flags & glkarg_NullOk))
           fatal_error("Zero passed invalidly to Glk function.");
         garglist[gargnum].ptrflag = FALSE;
         gargnum++;
@@ -546,17 +903,20 @@ static void parse_glk_args(dispatch_splot_t *splot, char **proto, int depth,
     if (!skipval) {
       glui32 thisval;
 
-      if (typeclass == '[') {
+      if (arg->typeclass == '[') {
 
-        parse_glk_args(splot, &cx, depth+1, &gargnum, varglist[ix], passin);
+        parse_glk_args(splot, arg+1, arg->numsub, depth+1, &gargnum,
+          varglist[ix], (flags & glkarg_PassIn));
 
       }
-      else if (isarray) {
+      else if (flags & glkarg_IsArray) {
         /* definitely isref */
+        int passin = (flags & glkarg_PassIn);
+        int passout = (flags & glkarg_PassOut);
 
-        switch (typeclass) {
+        switch (arg->typeclass) {
         case 'C':
-          /* This test checks for a giant array length, which is 
+          /* This test checks for a giant array length, which is
              deprecated. It displays a warning and cuts it down to
              something reasonable. Future releases of this interpreter
              may remove this test and go on to verify_array_addresses(),
@@ -567,12 +927,14 @@ static void parse_glk_args(dispatch_splot_t *splot, char **proto, int depth,
               varglist[ix+1] = endmem - varglist[ix];
           }
           verify_array_addresses(varglist[ix], varglist[ix+1], 1);
-          garglist[gargnum].array = CaptureCArray(varglist[ix], varglist[ix+1], passin);
+          if (flags & glkarg_Retained)
+            garglist[gargnum].array = CaptureCArray(varglist[ix], varglist[ix+1], passin);
+          else
+            garglist[gargnum].array = CaptureDirectCArray(varglist[ix], varglist[ix+1], passout);
           gargnum++;
           ix++;
           garglist[gargnum].uint = varglist[ix];
           gargnum++;
-          cx++;
           break;
         case 'I':
           /* See comment above. */
@@ -587,19 +949,17 @@ static void parse_glk_args(dispatch_splot_t *splot, char **proto, int depth,
           ix++;
           garglist[gargnum].uint = varglist[ix];
           gargnum++;
-          cx++;
           break;
         case 'Q':
           /* This case was added after the giant arrays were deprecated,
              so we don't bother to allow for that case. We just verify
              the length. */
           verify_array_addresses(varglist[ix], varglist[ix+1], 4);
-          garglist[gargnum].array = CapturePtrArray(varglist[ix], varglist[ix+1], (*cx-'a'), passin);
+          garglist[gargnum].array = CapturePtrArray(varglist[ix], varglist[ix+1], (arg->subtype-'a'), passin);
           gargnum++;
           ix++;
           garglist[gargnum].uint = varglist[ix];
           gargnum++;
-          cx++;
           break;
         default:
           fatal_error("Illegal format string.");
@@ -609,7 +969,7 @@ static void parse_glk_args(dispatch_splot_t *splot, char **proto, int depth,
       else {
         /* a plain value or a reference to one. */
 
-        if (isreturn) {
+        if (flags & glkarg_IsReturn) {
           thisval = 0;
         }
         else if (depth > 0) {
@@ -619,8 +979,8 @@ static void parse_glk_args(dispatch_splot_t *splot, char **proto, int depth,
           else
             thisval = 0;
         }
-        else if (isref) {
-          if (passin)
+        else if (flags & glkarg_IsRef) {
+          if (flags & glkarg_PassIn)
             thisval = ReadMemory(varglist[ix]);
           else
             thisval = 0;
@@ -629,20 +989,17 @@ static void parse_glk_args(dispatch_splot_t *splot, char **proto, int depth,
           thisval = varglist[ix];
         }
 
-        switch (typeclass) {
+        switch (arg->typeclass) {
         case 'I':
-          if (*cx == 'u')
+          if (arg->subtype == 'u')
             garglist[gargnum].uint = (glui32)(thisval);
-          else if (*cx == 's')
-            garglist[gargnum].sint = (glsi32)(thisval);
           else
-            fatal_error("Illegal format string.");
+            garglist[gargnum].sint = (glsi32)(thisval);
           gargnum++;
-          cx++;
           break;
         case 'Q':
           if (thisval) {
-            opref = classes_get(*cx-'a', thisval);
+            opref = classes_get(arg->subtype-'a', thisval);
             if (!opref) {
               fatal_error("Reference to nonexistent Glk object.");
             }
@@ -652,19 +1009,15 @@ static void parse_glk_args(dispatch_splot_t *splot, char **proto, int depth,
           }
           garglist[gargnum].opaqueref = opref;
           gargnum++;
-          cx++;
           break;
         case 'C':
-          if (*cx == 'u') 
+          if (arg->subtype == 'u')
             garglist[gargnum].uch = (unsigned char)(thisval);
-          else if (*cx == 's')
+          else if (arg->subtype == 's')
             garglist[gargnum].sch = (signed char)(thisval);
-          else if (*cx == 'n')
-            garglist[gargnum].ch = (char)(thisval);
           else
-            fatal_error("Illegal format string.");
+            garglist[gargnum].ch = (char)(thisval);
           gargnum++;
-          cx++;
           break;
         case 'S':
           garglist[gargnum].charstr = DecodeVMString(thisval);
@@ -683,86 +1036,43 @@ static void parse_glk_args(dispatch_splot_t *splot, char **proto, int depth,
       }
     }
     else {
-      /* We got a null reference, so we have to skip the format element. */
-      if (typeclass == '[') {
-        int numsubwanted, refdepth;
-        numsubwanted = 0;
-        while (*cx >= '0' && *cx <= '9') {
-          numsubwanted = 10 * numsubwanted + (*cx - '0');
-          cx++;
-        }
-        refdepth = 1;
-        while (refdepth > 0) {
-          if (*cx == '[')
-            refdepth++;
-          else if (*cx == ']')
-            refdepth--;
-          cx++;
-        }
-      }
-      else if (typeclass == 'S' || typeclass == 'U') {
-        /* leave it */
-      }
-      else {
-        cx++;
-        if (isarray)
-          ix++;
-      }
-    }    
+      /* We got a null reference, so we skip the argument. An array
+         takes up two Glulx arguments. */
+      if ((flags & glkarg_IsArray) && arg->typeclass != '[')
+        ix++;
+    }
   }
 
-  if (depth > 0) {
-    if (*cx != ']')
-      fatal_error("Illegal format string.");
-    cx++;
-  }
-  else {
-    if (*cx != ':' && *cx != '\0')
-      fatal_error("Illegal format string.");
-  }
-  
-  *proto = cx;
   *argnumptr = gargnum;
 }
 
 /* unparse_glk_args():
-   This is about the reverse of parse_glk_args(). 
+   This is about the reverse of parse_glk_args().
 */
-static void unparse_glk_args(dispatch_splot_t *splot, char **proto, int depth,
-  int *argnumptr, glui32 subaddress, int subpassout)
+static void unparse_glk_args(dispatch_splot_t *splot, glkarg_t *args,
+  int numwanted, int depth, int *argnumptr, glui32 subaddress,
+  int subpassout)
 {
-  char *cx;
+  glkarg_t *arg;
   int ix, argx;
-  int gargnum, numwanted;
+  int gargnum;
   void *opref;
   gluniversal_t *garglist;
   glui32 *varglist;
-  
+
   garglist = splot->garglist;
   varglist = splot->varglist;
   gargnum = *argnumptr;
-  cx = *proto;
 
-  numwanted = 0;
-  while (*cx >= '0' && *cx <= '9') {
-    numwanted = 10 * numwanted + (*cx - '0');
-    cx++;
-  }
-
-  for (argx = 0, ix = 0; argx < numwanted; argx++, ix++) {
-    char typeclass;
+  for (argx = 0, ix = 0, arg = args; argx < numwanted;
+       argx++, ix++, arg += arg->span) {
+    int flags = arg->flags;
     int skipval;
-    int isref, passin, passout, nullok, isarray, isretained, isreturn;
-    cx = read_prefix(cx, &isref, &isarray, &passin, &passout, &nullok,
-      &isretained, &isreturn);
-    
-    typeclass = *cx;
-    cx++;
 
     skipval = FALSE;
-    if (isref) {
-      if (!isreturn && varglist[ix] == 0) {
-        if (!nullok)
+    if (flags & glkarg_IsRef) {
+      if (!(flags & glkarg_IsReturn) && varglist[ix] == 0) {
+        if (!(flags & glkarg_NullOk))
           fatal_error("Zero passed invalidly to Glk function.");
         garglist[gargnum].ptrflag = FALSE;
         gargnum++;
@@ -776,35 +1086,37 @@ static void unparse_glk_args(dispatch_splot_t *splot, char **proto, int depth,
     if (!skipval) {
       glui32 thisval = 0;
 
-      if (typeclass == '[') {
+      if (arg->typeclass == '[') {
 
-        unparse_glk_args(splot, &cx, depth+1, &gargnum, varglist[ix], passout);
+        unparse_glk_args(splot, arg+1, arg->numsub, depth+1, &gargnum,
+          varglist[ix], (flags & glkarg_PassOut));
 
       }
-      else if (isarray) {
+      else if (flags & glkarg_IsArray) {
         /* definitely isref */
+        int passout = (flags & glkarg_PassOut);
 
-        switch (typeclass) {
+        switch (arg->typeclass) {
         case 'C':
-          ReleaseCArray(garglist[gargnum].array, varglist[ix], varglist[ix+1], passout);
+          if (flags & glkarg_Retained)
+            ReleaseCArray(garglist[gargnum].array, varglist[ix], varglist[ix+1], passout);
+          else
+            ReleaseDirectCArray(garglist[gargnum].array, varglist[ix], varglist[ix+1], passout);
           gargnum++;
           ix++;
           gargnum++;
-          cx++;
           break;
         case 'I':
           ReleaseIArray(garglist[gargnum].array, varglist[ix], varglist[ix+1], passout);
           gargnum++;
           ix++;
           gargnum++;
-          cx++;
           break;
         case 'Q':
-          ReleasePtrArray(garglist[gargnum].array, varglist[ix], varglist[ix+1], (*cx-'a'), passout);
+          ReleasePtrArray(garglist[gargnum].array, varglist[ix], varglist[ix+1], (arg->subtype-'a'), passout);
           gargnum++;
           ix++;
           gargnum++;
-          cx++;
           break;
         default:
           fatal_error("Illegal format string.");
@@ -814,32 +1126,30 @@ static void unparse_glk_args(dispatch_splot_t *splot, char **proto, int depth,
       else {
         /* a plain value or a reference to one. */
 
-        if (isreturn || (depth > 0 && subpassout) || (isref && passout)) {
+        if ((flags & glkarg_IsReturn) || (depth > 0 && subpassout)
+          || ((flags & glkarg_IsRef) && (flags & glkarg_PassOut))) {
           skipval = FALSE;
         }
         else {
           skipval = TRUE;
         }
 
-        switch (typeclass) {
+        switch (arg->typeclass) {
         case 'I':
           if (!skipval) {
-            if (*cx == 'u')
+            if (arg->subtype == 'u')
               thisval = (glui32)garglist[gargnum].uint;
-            else if (*cx == 's')
-              thisval = (glui32)garglist[gargnum].sint;
             else
-              fatal_error("Illegal format string.");
+              thisval = (glui32)garglist[gargnum].sint;
           }
           gargnum++;
-          cx++;
           break;
         case 'Q':
           if (!skipval) {
             opref = garglist[gargnum].opaqueref;
             if (opref) {
-              gidispatch_rock_t objrock = 
-                gidispatch_get_objrock(opref, *cx-'a');
+              gidispatch_rock_t objrock =
+                gidispatch_get_objrock(opref, arg->subtype-'a');
               thisval = ((classref_t *)objrock.ptr)->id;
             }
             else {
@@ -847,21 +1157,17 @@ static void unparse_glk_args(dispatch_splot_t *splot, char **proto, int depth,
             }
           }
           gargnum++;
-          cx++;
           break;
         case 'C':
           if (!skipval) {
-            if (*cx == 'u') 
+            if (arg->subtype == 'u')
               thisval = (glui32)garglist[gargnum].uch;
-            else if (*cx == 's')
+            else if (arg->subtype == 's')
               thisval = (glui32)garglist[gargnum].sch;
-            else if (*cx == 'n')
-              thisval = (glui32)garglist[gargnum].ch;
             else
-              fatal_error("Illegal format string.");
+              thisval = (glui32)garglist[gargnum].ch;
           }
           gargnum++;
-          cx++;
           break;
         case 'S':
           if (garglist[gargnum].charstr)
@@ -880,7 +1186,7 @@ static void unparse_glk_args(dispatch_splot_t *splot, char **proto, int depth,
           break;
         }
 
-        if (isreturn) {
+        if (flags & glkarg_IsReturn) {
           *(splot->retval) = thisval;
         }
         else if (depth > 0) {
@@ -888,53 +1194,91 @@ static void unparse_glk_args(dispatch_splot_t *splot, char **proto, int depth,
           if (subpassout)
             WriteStructField(subaddress, ix, thisval);
         }
-        else if (isref) {
-          if (passout)
-            WriteMemory(varglist[ix], thisval); 
+        else if (flags & glkarg_IsRef) {
+          if (flags & glkarg_PassOut)
+            WriteMemory(varglist[ix], thisval);
         }
       }
     }
     else {
-      /* We got a null reference, so we have to skip the format element. */
-      if (typeclass == '[') {
-        int numsubwanted, refdepth;
-        numsubwanted = 0;
-        while (*cx >= '0' && *cx <= '9') {
-          numsubwanted = 10 * numsubwanted + (*cx - '0');
-          cx++;
-        }
-        refdepth = 1;
-        while (refdepth > 0) {
-          if (*cx == '[')
-            refdepth++;
-          else if (*cx == ']')
-            refdepth--;
-          cx++;
-        }
-      }
-      else if (typeclass == 'S' || typeclass == 'U') {
-        /* leave it */
-      }
-      else {
-        cx++;
-        if (isarray)
-          ix++;
-      }
-    }    
+      /* We got a null reference, so we skip the argument. An array
+         takes up two Glulx arguments. */
+      if ((flags & glkarg_IsArray) && arg->typeclass != '[')
+        ix++;
+    }
   }
 
-  if (depth > 0) {
-    if (*cx != ']')
-      fatal_error("Illegal format string.");
-    cx++;
+  *argnumptr = gargnum;
+}
+
+/* glkfast_check():
+   Mark each generated wrapper usable if its prototype matches the one
+   in the library's dispatch layer.
+*/
+static void glkfast_check()
+{
+  glkfast_proto_t *fast;
+  char *proto;
+
+  for (fast = glkfast_protos; fast->proto; fast++) {
+    proto = gidispatch_prototype(fast->funcnum);
+    fast->ok = (proto && !strcmp(proto, fast->proto));
   }
-  else {
-    if (*cx != ':' && *cx != '\0')
-      fatal_error("Illegal format string.");
+}
+
+/* glkfast_obj():
+   Find the Glk object for an ID, as parse_glk_args() does for a "Q"
+   argument. Zero means NULL.
+*/
+static void *glkfast_obj(int classid, glui32 objid)
+{
+  void *obj;
+
+  if (!objid)
+    return NULL;
+  obj = classes_get(classid, objid);
+  if (!obj)
+    fatal_error("Reference to nonexistent Glk object.");
+  return obj;
+}
+
+/* glkfast_objid():
+   Find the ID of a Glk object, as unparse_glk_args() does. NULL gives
+   zero.
+*/
+static glui32 glkfast_objid(int classid, void *obj)
+{
+  gidispatch_rock_t objrock;
+
+  if (!obj)
+    return 0;
+  objrock = gidispatch_get_objrock(obj, classid);
+  return ((classref_t *)objrock.ptr)->id;
+}
+
+/* glkfast_c_array(), glkfast_i_array():
+   Capture a read-only array argument, checking its length the way
+   parse_glk_args() does. (The length may be cut down, with a warning.)
+   A char array is passed in place.
+*/
+static char *glkfast_c_array(glui32 addr, glui32 *lenptr)
+{
+  if (*lenptr > endmem || addr+*lenptr > endmem) {
+    nonfatal_warning_i("Memory access was much too long -- perhaps a print_to_array call with only one argument", *lenptr);
+    *lenptr = endmem - addr;
   }
-  
-  *proto = cx;
-  *argnumptr = gargnum;
+  verify_array_addresses(addr, *lenptr, 1);
+  return CaptureDirectCArray(addr, *lenptr, FALSE);
+}
+
+static glui32 *glkfast_i_array(glui32 addr, glui32 *lenptr)
+{
+  if (*lenptr > endmem/4 || *lenptr > (endmem-addr)/4) {
+    nonfatal_warning_i("Memory access was much too long -- perhaps a print_to_array call with only one argument", *lenptr);
+    *lenptr = (endmem - addr) / 4;
+  }
+  verify_array_addresses(addr, *lenptr, 4);
+  return CaptureIArray(addr, *lenptr, TRUE);
 }
 
 /* find_stream_by_id():
@@ -1014,74 +1358,653 @@ glui32 find_id_for_schannel(schanid_t schan)
   return ((classref_t *)objrock.ptr)->id;
 }
 
-/* Build a hash table to hold a set of Glk objects. */
-static classtable_t *new_classtable(glui32 firstid)
+/* setup_glkstats():
+   Turn on Glk call statistics. The dumpfunc is called whenever a
+   report is wanted: at exit, and when glkstats_dump_requested is set.
+   It should open an output stream and pass it to glkstats_write().
+*/
+void setup_glkstats(void (*dumpfunc)(void))
 {
+  glkstats_dump_func = dumpfunc;
+  glkstats_enabled = (dumpfunc != NULL);
+}
+
+/* glkstats_quit():
+   Write the final report, if statistics are on. It's safe to call
+   this more than once.
+*/
+void glkstats_quit()
+{
+  if (!glkstats_enabled)
+    return;
+  glkstats_dump_func();
+}
+
+/* glkstats_record():
+   Charge one call of a Glk function.
+*/
+static void glkstats_record(glui32 funcnum, glui32 elapsed)
+{
+  int bucknum = (funcnum % GLKSTATS_HASH_SIZE);
+  glkstat_t *stat;
   int ix;
+
+  for (stat = glkstats[bucknum]; stat; stat = stat->next) {
+    if (stat->funcnum == funcnum)
+      break;
+  }
+  if (!stat) {
+    stat = (glkstat_t *)glulx_malloc(sizeof(glkstat_t));
+    if (!stat)
+      return;
+    stat->funcnum = funcnum;
+    stat->waits = (funcnum == 0x00C0 || funcnum == 0x0062);
+    stat->count = 0;
+    stat->total = 0.0;
+    stat->max = 0;
+    for (ix=0; ix<GLKSTATS_BUCKETS; ix++)
+      stat->hist[ix] = 0;
+    stat->next = glkstats[bucknum];
+    glkstats[bucknum] = stat;
+    glkstats_count++;
+  }
+
+  stat->count++;
+  stat->total += elapsed;
+  if (elapsed > stat->max)
+    stat->max = elapsed;
+
+  for (ix=0; elapsed && ix<GLKSTATS_BUCKETS-1; ix++)
+    elapsed >>= 1;
+  stat->hist[ix]++;
+}
+
+static int glkstats_compare(void *p1, void *p2)
+{
+  glkstat_t *s1 = *(glkstat_t **)p1;
+  glkstat_t *s2 = *(glkstat_t **)p2;
+
+  if (s1->waits != s2->waits)
+    return (s1->waits ? 1 : -1);
+  if (s1->total != s2->total)
+    return (s1->total < s2->total ? 1 : -1);
+  if (s1->funcnum != s2->funcnum)
+    return (s1->funcnum < s2->funcnum ? -1 : 1);
+  return 0;
+}
+
+/* glkstats_write():
+   Write a report of the Glk calls so far, one line per function, most
+   expensive first, with the waiting calls at the end. The histogram
+   columns are counts per bucket.
+*/
+void glkstats_write(strid_t str)
+{
+  glkstat_t **list;
+  glkstat_t *stat;
+  gidispatch_function_t *func;
+  double libtotal, waittotal;
+  int ix, jx, numbuckets, count;
+  char linebuf[512];
+
+  list = (glkstat_t **)glulx_malloc((glkstats_count+1) 
+    * sizeof(glkstat_t *));
+  if (!list)
+    return;
+  count = 0;
+  libtotal = 0.0;
+  waittotal = 0.0;
+  for (ix=0; ix<GLKSTATS_HASH_SIZE; ix++) {
+    for (stat = glkstats[ix]; stat; stat = stat->next) {
+      list[count++] = stat;
+      if (stat->waits)
+        waittotal += stat->total;
+      else
+        libtotal += stat->total;
+    }
+  }
+  glulx_sort(list, count, sizeof(glkstat_t *), &glkstats_compare);
+
+  sprintf(linebuf, "# Glk calls: library time %.0f us, waiting time %.0f us\n",
+    libtotal, waittotal);
+  glk_put_string_stream(str, linebuf);
+  glk_put_string_stream(str, "# selector name calls total_us mean_us max_us : histogram (<1us, <2us, <4us, ...)\n");
+
+  for (ix=0; ix<count; ix++) {
+    stat = list[ix];
+    if (ix == 0 || stat->waits != list[ix-1]->waits)
+      glk_put_string_stream(str, (stat->waits 
+        ? "# waiting for input:\n" : "# library calls:\n"));
+    if (stat->funcnum == GLKSTATS_FLUSH) {
+      glk_put_string_stream(str, "- (flush_output)");
+    }
+    else {
+      func = gidispatch_get_function_by_id(stat->funcnum);
+      sprintf(linebuf, "0x%04lx %s", (unsigned long)stat->funcnum,
+        (func ? func->name : "?"));
+      glk_put_string_stream(str, linebuf);
+    }
+    sprintf(linebuf, " %lu %.0f %.1f %lu :",
+      (unsigned long)stat->count, stat->total,
+      stat->total / stat->count, (unsigned long)stat->max);
+    glk_put_string_stream(str, linebuf);
+    /* Leave off the empty buckets at the long end. */
+    numbuckets = GLKSTATS_BUCKETS;
+    while (numbuckets > 0 && !stat->hist[numbuckets-1])
+      numbuckets--;
+    for (jx=0; jx<numbuckets; jx++) {
+      sprintf(linebuf, " %lu", (unsigned long)stat->hist[jx]);
+      glk_put_string_stream(str, linebuf);
+    }
+    glk_put_string_stream(str, "\n");
+  }
+
+  glulx_free(list);
+}
+
+/* setup_glkrecord():
+   Record events to the given stream, or (if replay is true) replay
+   them from it. This must be called before glk_main() starts.
+*/
+void setup_glkrecord(strid_t stream, int replay)
+{
+  glkrecord_stream = stream;
+  glkrecord_mode = (replay ? glkrecord_Replay : glkrecord_Record);
+}
+
+/* glkrecord_start():
+   Write or check the log header. This is called just before the RNG
+   is seeded. A recording needs a deterministic RNG, so the player must
+   have given a seed (see unixstrt.c); a replay uses the recorded seed.
+   Either way, the RNG stays seeded even if the game asks for native
+   randomness.
+*/
+int glkrecord_start()
+{
+  unsigned char buf[4];
+  glui32 val;
+
+  if (!glkrecord_mode)
+    return TRUE;
+
+  rand_always_seeded = TRUE;
+
+  if (glkrecord_mode == glkrecord_Record) {
+    if (!init_rng_seed) {
+      fatal_error("Recording requires a nonzero RNG seed.");
+      return FALSE;
+    }
+    glk_put_buffer_stream(glkrecord_stream, "GlkR", 4);
+    glkrecord_put_word(1);
+    glkrecord_put_word(init_rng_seed);
+  }
+  else {
+    if (glk_get_buffer_stream(glkrecord_stream, (char *)buf, 4) != 4
+      || buf[0] != 'G' || buf[1] != 'l' || buf[2] != 'k' || buf[3] != 'R') {
+      fatal_error("Replay file is not a Glk event log.");
+      return FALSE;
+    }
+    val = glkrecord_get_word();
+    if (val != 1) {
+      fatal_error_i("Replay file has an unknown version", val);
+      return FALSE;
+    }
+    init_rng_seed = glkrecord_get_word();
+  }
+  return TRUE;
+}
+
+/* glkrecord_quit():
+   Close the log, if there is one. It's safe to call this more than
+   once.
+*/
+void glkrecord_quit()
+{
+  if (!glkrecord_stream)
+    return;
+  glk_stream_close(glkrecord_stream, NULL);
+  glkrecord_stream = NULL;
+  glkrecord_mode = glkrecord_None;
+}
+
+static void glkrecord_put_word(glui32 val)
+{
+  unsigned char buf[4];
+  Write4(buf, val);
+  glk_put_buffer_stream(glkrecord_stream, (char *)buf, 4);
+}
+
+static glui32 glkrecord_get_word()
+{
+  unsigned char buf[4];
+  if (glk_get_buffer_stream(glkrecord_stream, (char *)buf, 4) != 4)
+    fatal_error("Replay file ended in the middle of an event.");
+  return Read4(buf);
+}
+
+/* glkrecord_note_range():
+   Remember that the library wrote into a stretch of VM memory during
+   the current select call.
+*/
+static void glkrecord_note_range(glui32 addr, glui32 len)
+{
+  if (!len)
+    return;
+  if (glkrecord_numranges >= glkrecord_maxranges) {
+    glkrecord_maxranges = (glkrecord_maxranges ? 2*glkrecord_maxranges : 4);
+    glkrecord_ranges = (glkrange_t *)glulx_realloc(glkrecord_ranges,
+      glkrecord_maxranges * sizeof(glkrange_t));
+    if (!glkrecord_ranges)
+      fatal_error("Unable to allocate space for the Glk event log.");
+  }
+  glkrecord_ranges[glkrecord_numranges].addr = addr;
+  glkrecord_ranges[glkrecord_numranges].len = len;
+  glkrecord_numranges++;
+}
+
+/* glkrecord_select():
+   Handle glk_select() or glk_select_poll() while recording or
+   replaying. The event is stored into the VM the same way
+   unparse_glk_args() would.
+*/
+static glui32 glkrecord_select(glui32 funcnum, glui32 numargs,
+  glui32 *arglist)
+{
+  event_t ev;
+  glui32 evtype, winid, val1, val2;
+  glui32 addr, len, ix;
+  glui32 *randarr;
+  glui32 randstate[4];
+  int usenative, randcount, tag;
+  winid_t win;
+
+  if (numargs != 1)
+    fatal_error("Wrong number of arguments to Glk function.");
+  if (!arglist[0])
+    fatal_error("Null event argument to Glk select.");
+
+  if (glkrecord_mode == glkrecord_Record) {
+    glkrecord_numranges = 0;
+    glkrecord_capturing = TRUE;
+    if (funcnum == 0x00C0)
+      glk_select(&ev);
+    else
+      glk_select_poll(&ev);
+    glkrecord_capturing = FALSE;
+
+    evtype = ev.type;
+    winid = find_id_for_window(ev.win);
+    val1 = ev.val1;
+    val2 = ev.val2;
+
+    /* The RNG is always seeded while recording, so the log can
+       capture its state. */
+    glulx_random_get_detstate(&usenative, &randarr, &randcount);
+
+    glk_put_char_stream(glkrecord_stream, 'E');
+    glkrecord_put_word(evtype);
+    glkrecord_put_word(winid);
+    glkrecord_put_word(val1);
+    glkrecord_put_word(val2);
+    glkrecord_put_word(usenative);
+    for (ix=0; ix<4; ix++)
+      glkrecord_put_word((ix < randcount) ? randarr[ix] : 0);
+    glkrecord_put_word(glkrecord_numranges);
+    for (ix=0; ix<glkrecord_numranges; ix++) {
+      addr = glkrecord_ranges[ix].addr;
+      len = glkrecord_ranges[ix].len;
+      glkrecord_put_word(addr);
+      glkrecord_put_word(len);
+      glk_put_buffer_stream(glkrecord_stream, (char *)(memmap+addr), len);
+    }
+  }
+  else {
+    stream_flush_output();
+    tag = glk_get_char_stream(glkrecord_stream);
+    if (tag < 0) {
+      /* The log has run out, so the session is over. We finish the
+         same way as when the game calls glk_exit(). */
+      perform_glk(0x0001, 0, NULL);
+    }
+    if (tag != 'E')
+      fatal_error("Replay file is damaged.");
+
+    evtype = glkrecord_get_word();
+    winid = glkrecord_get_word();
+    val1 = glkrecord_get_word();
+    val2 = glkrecord_get_word();
+    usenative = glkrecord_get_word();
+    for (ix=0; ix<4; ix++)
+      randstate[ix] = glkrecord_get_word();
+
+    /* The library still has the input request that this event
+       answered. Cancel it (so it lets go of the input buffer), then
+       fill in the buffer with what the player typed. */
+    win = (winid ? classes_get(gidisp_Class_Window, winid) : NULL);
+    if (win && evtype == evtype_LineInput)
+      glk_cancel_line_event(win, &ev);
+    else if (win && evtype == evtype_CharInput)
+      glk_cancel_char_event(win);
+
+    len = glkrecord_get_word();
+    for (ix=0; ix<len; ix++) {
+      glui32 rangelen, jx;
+      addr = glkrecord_get_word();
+      rangelen = glkrecord_get_word();
+      verify_array_addresses(addr, rangelen, 1);
+      for (jx=0; jx<rangelen; jx++) {
+        int ch = glk_get_char_stream(glkrecord_stream);
+        if (ch < 0)
+          fatal_error("Replay file ended in the middle of an event.");
+        MemW1(addr+jx, ch);
+      }
+    }
+
+    glulx_random_set_detstate(usenative, randstate, 4);
+  }
+
+  WriteStructField(arglist[0], 0, evtype);
+  WriteStructField(arglist[0], 1, winid);
+  WriteStructField(arglist[0], 2, val1);
+  WriteStructField(arglist[0], 3, val2);
+  return 0;
+}
+
+/* setup_glkdefer():
+   Turn on the deferred output queue. This must be called before
+   glk_main() starts.
+*/
+void setup_glkdefer()
+{
+  glkdefer_enabled = TRUE;
+}
+
+/* glkdefer_takes():
+   Say whether glkdefer_call() would queue this call, without doing it.
+   Bad arguments are left for the library call to catch, just as they
+   would be without the queue.
+*/
+static int glkdefer_takes(glui32 funcnum, glui32 numargs, glui32 *arglist)
+{
+  switch (funcnum) {
+  case 0x0082: /* put_string */
+  case 0x0086: /* set_style */
+  case 0x002A: /* window_clear */
+    return (numargs == 1);
+  case 0x0084: /* put_buffer */
+    return (numargs == 2 && arglist[0]);
+  case 0x002B: /* window_move_cursor */
+    return (numargs == 3);
+#ifdef GLK_MODULE_UNICODE
+  case 0x0129: /* put_string_uni */
+    return (numargs == 1 && glkdefer_unicode);
+  case 0x012A: /* put_buffer_uni */
+    return (numargs == 2 && arglist[0] && glkdefer_unicode);
+#endif /* GLK_MODULE_UNICODE */
+  default:
+    return FALSE;
+  }
+}
+
+/* glkdefer_call():
+   Queue a Glk call, if it's one which only produces output. Returns
+   FALSE (having done nothing) if the call should go to the library
+   now.
+*/
+static int glkdefer_call(glui32 funcnum, glui32 numargs, glui32 *arglist)
+{
+  glkdefer_t *cmd;
+  glui32 len;
+
+  if (!glkdefer_takes(funcnum, numargs, arglist))
+    return FALSE;
+
+  switch (funcnum) {
+
+  case 0x0082: /* put_string */
+    {
+      char *str = DecodeVMString(arglist[0]);
+      stream_buffer_text(str, strlen(str), FALSE);
+    }
+    reset_temp_strings();
+    return TRUE;
+
+  case 0x0084: /* put_buffer */
+    len = arglist[1];
+    {
+      char *arr = glkfast_c_array(arglist[0], &len);
+      stream_buffer_text(arr, len, FALSE);
+      ReleaseDirectCArray(arr, arglist[0], len, FALSE);
+    }
+    return TRUE;
+
+#ifdef GLK_MODULE_UNICODE
+  case 0x0129: /* put_string_uni */
+    {
+      glui32 *ustr = DecodeVMUstring(arglist[0]);
+      len = 0;
+      while (ustr[len])
+        len++;
+      stream_buffer_text(ustr, len, TRUE);
+    }
+    reset_temp_strings();
+    return TRUE;
+
+  case 0x012A: /* put_buffer_uni */
+    len = arglist[1];
+    {
+      glui32 *arr = glkfast_i_array(arglist[0], &len);
+      stream_buffer_text(arr, len, TRUE);
+      ReleaseIArray(arr, arglist[0], len, FALSE);
+    }
+    return TRUE;
+#endif /* GLK_MODULE_UNICODE */
+
+  case 0x0086: /* set_style */
+    cmd = glkdefer_last(glkdefer_Style);
+    if (!cmd)
+      cmd = glkdefer_add(glkdefer_Style);
+    cmd->val1 = arglist[0];
+    return TRUE;
+
+  case 0x002A: /* window_clear */
+    {
+      winid_t win = (winid_t)glkfast_obj(gidisp_Class_Window, arglist[0]);
+      cmd = glkdefer_add(glkdefer_Clear);
+      cmd->win = win;
+    }
+    return TRUE;
+
+  case 0x002B: /* window_move_cursor */
+    {
+      winid_t win = (winid_t)glkfast_obj(gidisp_Class_Window, arglist[0]);
+      cmd = glkdefer_last(glkdefer_Cursor);
+      if (!cmd || cmd->win != win)
+        cmd = glkdefer_add(glkdefer_Cursor);
+      cmd->win = win;
+      cmd->val1 = arglist[1];
+      cmd->val2 = arglist[2];
+    }
+    return TRUE;
+
+  default:
+    return FALSE;
+  }
+}
+
+/* glkdefer_add():
+   Append a command to the queue, after all the text printed so far.
+   The queue is sent over first if it's full.
+*/
+static glkdefer_t *glkdefer_add(int op)
+{
+  glkdefer_t *cmd;
+
+  if (glkdefer_numcmds >= GLKDEFER_MAXCMDS)
+    stream_flush_output();
+  cmd = &glkdefer_cmds[glkdefer_numcmds++];
+  cmd->op = op;
+  cmd->textpos = stream_output_pos();
+  cmd->win = NULL;
+  cmd->val1 = 0;
+  cmd->val2 = 0;
+  return cmd;
+}
+
+/* glkdefer_last():
+   If the last command in the queue is of the given kind, with no text
+   printed since, return it (so that the caller can replace it).
+   Otherwise return NULL.
+*/
+static glkdefer_t *glkdefer_last(int op)
+{
+  glkdefer_t *cmd;
+
+  if (!glkdefer_numcmds)
+    return NULL;
+  cmd = &glkdefer_cmds[glkdefer_numcmds-1];
+  if (cmd->op != op || cmd->textpos != stream_output_pos())
+    return NULL;
+  return cmd;
+}
+
+/* glkdefer_flush():
+   Send every queued call to the library, in order, with the text that
+   comes before each one, and empty the queue. Returns how much of the
+   output buffer has been sent; stream_flush_output() sends the rest.
+*/
+glui32 glkdefer_flush()
+{
+  glui32 ix;
+  glui32 pos = 0;
+  glkdefer_t *cmd;
+
+  for (ix=0; ix<glkdefer_numcmds; ix++) {
+    cmd = &glkdefer_cmds[ix];
+    stream_send_output(pos, cmd->textpos);
+    pos = cmd->textpos;
+    switch (cmd->op) {
+    case glkdefer_Style:
+      glk_set_style(cmd->val1);
+      break;
+    case glkdefer_Clear:
+      glk_window_clear(cmd->win);
+      break;
+    case glkdefer_Cursor:
+      glk_window_move_cursor(cmd->win, cmd->val1, cmd->val2);
+      break;
+    }
+  }
+  glkdefer_numcmds = 0;
+  return pos;
+}
+
+/* Build a table to hold a set of Glk objects. No pages are allocated
+   until objects are registered. */
+static classtable_t *new_classtable(glui32 firstid)
+{
   classtable_t *ctab = (classtable_t *)glulx_malloc(sizeof(classtable_t));
   if (!ctab)
     return NULL;
     
-  for (ix=0; ix<CLASSHASH_SIZE; ix++)
-    ctab->bucket[ix] = NULL;
-    
+  ctab->numpages = 0;
+  ctab->pages = NULL;
   ctab->lastid = firstid;
     
   return ctab;
 }
 
-/* Find a Glk object in the appropriate hash table. */
+/* Find a Glk object in the appropriate table. */
 static void *classes_get(int classid, glui32 objid)
 {
   classtable_t *ctab;
-  classref_t *cref;
+  classpage_t *page;
+  glui32 pagenum;
   if (classid < 0 || classid >= num_classes)
     return NULL;
   ctab = classes[classid];
-  cref = ctab->bucket[objid % CLASSHASH_SIZE];
-  for (; cref; cref = cref->next) {
-    if (cref->id == objid)
-      return cref->obj;
-  }
-  return NULL;
+  pagenum = objid >> CLASSPAGE_SHIFT;
+  if (pagenum >= ctab->numpages)
+    return NULL;
+  page = ctab->pages[pagenum];
+  if (!page)
+    return NULL;
+  /* An empty slot has obj NULL, so no need to check the id. */
+  return page->slot[objid & CLASSPAGE_MASK].obj;
 }
 
-/* Put a Glk object in the appropriate hash table. If origid is zero,
+/* Put a Glk object in the appropriate table. If origid is zero,
    invent a new unique ID for it. */
 static classref_t *classes_put(int classid, void *obj, glui32 origid)
 {
-  int bucknum;
   classtable_t *ctab;
+  classpage_t *page;
   classref_t *cref;
+  glui32 id, pagenum, newsize, ix;
   if (classid < 0 || classid >= num_classes)
     return NULL;
   ctab = classes[classid];
-  cref = (classref_t *)glulx_malloc(sizeof(classref_t));
-  if (!cref)
-    return NULL;
-  cref->obj = obj;
   if (!origid) {
-    cref->id = ctab->lastid;
+    id = ctab->lastid;
     ctab->lastid++;
   }
   else {
-    cref->id = origid;
+    id = origid;
     if (ctab->lastid <= origid)
       ctab->lastid = origid+1;
   }
-  bucknum = cref->id % CLASSHASH_SIZE;
-  cref->bucknum = bucknum;
-  cref->next = ctab->bucket[bucknum];
-  ctab->bucket[bucknum] = cref;
+
+  pagenum = id >> CLASSPAGE_SHIFT;
+  if (pagenum >= ctab->numpages) {
+    classpage_t **newpages;
+    newsize = (ctab->numpages ? ctab->numpages * 2 : 4);
+    while (newsize <= pagenum)
+      newsize *= 2;
+    if (!ctab->pages)
+      newpages = (classpage_t **)glulx_malloc(newsize 
+        * sizeof(classpage_t *));
+    else
+      newpages = (classpage_t **)glulx_realloc(ctab->pages, newsize
+        * sizeof(classpage_t *));
+    if (!newpages)
+      return NULL;
+    for (ix=ctab->numpages; ix<newsize; ix++)
+      newpages[ix] = NULL;
+    ctab->pages = newpages;
+    ctab->numpages = newsize;
+  }
+
+  page = ctab->pages[pagenum];
+  if (!page) {
+    page = (classpage_t *)glulx_malloc(sizeof(classpage_t));
+    if (!page)
+      return NULL;
+    page->count = 0;
+    for (ix=0; ix<CLASSPAGE_SIZE; ix++) {
+      page->slot[ix].obj = NULL;
+      page->slot[ix].id = 0;
+    }
+    ctab->pages[pagenum] = page;
+  }
+
+  cref = &(page->slot[id & CLASSPAGE_MASK]);
+  if (cref->obj) {
+    nonfatal_warning_i("Glk object ID registered twice", id);
+    return NULL;
+  }
+  cref->obj = obj;
+  cref->id = id;
+  page->count++;
   return cref;
 }
 
-/* Delete a Glk object from the appropriate hash table. */
+/* Delete a Glk object from the appropriate table. */
 static void classes_remove(int classid, void *obj)
 {
   classtable_t *ctab;
+  classpage_t *page;
   classref_t *cref;
-  classref_t **crefp;
+  glui32 pagenum;
   gidispatch_rock_t objrock;
   if (classid < 0 || classid >= num_classes)
     return;
@@ -1090,25 +2013,26 @@ static void classes_remove(int classid, void *obj)
   cref = objrock.ptr;
   if (!cref)
     return;
-  crefp = &(ctab->bucket[cref->bucknum]);
-  for (; *crefp; crefp = &((*crefp)->next)) {
-    if ((*crefp) == cref) {
-      *crefp = cref->next;
-      if (!cref->obj) {
-        nonfatal_warning("attempt to free NULL object!");
-      }
-      cref->obj = NULL;
-      cref->id = 0;
-      cref->next = NULL;
-      glulx_free(cref);
-      return;
-    }
+  pagenum = cref->id >> CLASSPAGE_SHIFT;
+  if (pagenum >= ctab->numpages)
+    return;
+  page = ctab->pages[pagenum];
+  if (!page || cref != &(page->slot[cref->id & CLASSPAGE_MASK]))
+    return;
+  if (!cref->obj) {
+    nonfatal_warning("attempt to free NULL object!");
+  }
+  cref->obj = NULL;
+  cref->id = 0;
+  page->count--;
+  if (page->count <= 0) {
+    ctab->pages[pagenum] = NULL;
+    glulx_free(page);
   }
-  return;
 }
 
 /* The object registration/unregistration callbacks that the library calls
-    to keep the hash tables up to date. */
+    to keep the tables up to date. */
     
 static gidispatch_rock_t glulxe_classtable_register(void *obj, 
   glui32 objclass)
@@ -1136,6 +2060,71 @@ gidispatch_rock_t glulxe_classtable_register_existing(void *obj,
   return objrock;
 }
 
+/* new_arrayref():
+   Register a native array, taking a node from the free list (and
+   refilling the free list a block at a time when it runs dry).
+*/
+static arrayref_t *new_arrayref(void *array, glui32 addr, glui32 elemsize,
+  glui32 len)
+{
+  arrayref_t *arref;
+  int ix;
+
+  if (!free_arrayrefs) {
+    arref = (arrayref_t *)glulx_malloc(ARRAYREF_BLOCK * sizeof(arrayref_t));
+    if (!arref)
+      fatal_error("Unable to allocate space for array argument to Glk call.");
+    for (ix=0; ix<ARRAYREF_BLOCK; ix++) {
+      arref[ix].next = free_arrayrefs;
+      free_arrayrefs = &arref[ix];
+    }
+  }
+
+  arref = free_arrayrefs;
+  free_arrayrefs = arref->next;
+
+  arref->array = array;
+  arref->addr = addr;
+  arref->elemsize = elemsize;
+  arref->retained = FALSE;
+  arref->len = len;
+
+  ix = ((uintptr_t)array >> 4) % ARRAYHASH_SIZE;
+  arref->next = arrays[ix];
+  arrays[ix] = arref;
+  return arref;
+}
+
+/* find_arrayref():
+   Find the hash chain link which points at a native array's node. If
+   the array isn't registered, the link points at NULL.
+*/
+static arrayref_t **find_arrayref(void *array)
+{
+  arrayref_t **aptr;
+
+  aptr = &arrays[((uintptr_t)array >> 4) % ARRAYHASH_SIZE];
+  for (; (*aptr); aptr=(&((*aptr)->next))) {
+    if ((*aptr)->array == array)
+      break;
+  }
+  return aptr;
+}
+
+/* free_arrayref():
+   Unlink a node (found by find_arrayref()) and return it to the free
+   list.
+*/
+static void free_arrayref(arrayref_t **aptr)
+{
+  arrayref_t *arref = *aptr;
+
+  *aptr = arref->next;
+  arref->array = NULL;
+  arref->next = free_arrayrefs;
+  free_arrayrefs = arref;
+}
+
 static char *grab_temp_c_array(glui32 addr, glui32 len, int passin)
 {
   arrayref_t *arref = NULL;
@@ -1144,17 +2133,10 @@ static char *grab_temp_c_array(glui32 addr, glui32 len, int passin)
 
   if (len) {
     arr = (char *)glulx_malloc(len * sizeof(char));
-    arref = (arrayref_t *)glulx_malloc(sizeof(arrayref_t));
-    if (!arr || !arref) 
+    if (!arr) 
       fatal_error("Unable to allocate space for array argument to Glk call.");
 
-    arref->array = arr;
-    arref->addr = addr;
-    arref->elemsize = 1;
-    arref->retained = FALSE;
-    arref->len = len;
-    arref->next = arrays;
-    arrays = arref;
+    arref = new_arrayref(arr, addr, 1, len);
 
     if (passin) {
       for (ix=0, addr2=addr; ix<len; ix++, addr2+=1) {
@@ -1173,10 +2155,7 @@ static void release_temp_c_array(char *arr, glui32 addr, glui32 len, int passout
   glui32 ix, val, addr2;
 
   if (arr) {
-    for (aptr=(&arrays); (*aptr); aptr=(&((*aptr)->next))) {
-      if ((*aptr)->array == arr)
-        break;
-    }
+    aptr = find_arrayref(arr);
     arref = *aptr;
     if (!arref)
       fatal_error("Unable to re-find array argument in Glk call.");
@@ -1187,9 +2166,6 @@ static void release_temp_c_array(char *arr, glui32 addr, glui32 len, int passout
       return;
     }
 
-    *aptr = arref->next;
-    arref->next = NULL;
-
     if (passout) {
       for (ix=0, addr2=addr; ix<len; ix++, addr2+=1) {
         val = arr[ix];
@@ -1197,34 +2173,53 @@ static void release_temp_c_array(char *arr, glui32 addr, glui32 len, int passout
       }
     }
     glulx_free(arr);
-    glulx_free(arref);
+    free_arrayref(aptr);
   }
 }
 
+/* grab_direct_c_array():
+   Return a pointer straight into VM memory for a char array which the
+   library won't retain. No copy is needed, since bytes have no byte
+   order to fix. The caller has already checked the array's range with
+   verify_array_addresses(). If the library is going to write into an
+   array which starts below ramstart, we make a copy after all, so that
+   the writes are checked by MemW1() as they always were.
+*/
+static char *grab_direct_c_array(glui32 addr, glui32 len, int passout)
+{
+  if (!len)
+    return NULL;
+  if (passout && addr < ramstart)
+    return grab_temp_c_array(addr, len, TRUE);
+  return (char *)(memmap + addr);
+}
+
+/* release_direct_c_array():
+   If grab_direct_c_array() made a copy, write it back. Otherwise,
+   there's nothing to do; the library has written into VM memory
+   directly.
+*/
+static void release_direct_c_array(char *arr, glui32 addr, glui32 len, int passout)
+{
+  if (arr && passout && addr < ramstart)
+    release_temp_c_array(arr, addr, len, passout);
+}
+
 static glui32 *grab_temp_i_array(glui32 addr, glui32 len, int passin)
 {
   arrayref_t *arref = NULL;
   glui32 *arr = NULL;
-  glui32 ix, addr2;
 
   if (len) {
     arr = (glui32 *)glulx_malloc(len * sizeof(glui32));
-    arref = (arrayref_t *)glulx_malloc(sizeof(arrayref_t));
-    if (!arr || !arref) 
+    if (!arr) 
       fatal_error("Unable to allocate space for array argument to Glk call.");
 
-    arref->array = arr;
-    arref->addr = addr;
-    arref->elemsize = 4;
-    arref->retained = FALSE;
-    arref->len = len;
-    arref->next = arrays;
-    arrays = arref;
+    arref = new_arrayref(arr, addr, 4, len);
 
+    /* The caller has already checked the range. */
     if (passin) {
-      for (ix=0, addr2=addr; ix<len; ix++, addr2+=4) {
-        arr[ix] = Mem4(addr2);
-      }
+      read_word_array(arr, memmap+addr, len);
     }
   }
 
@@ -1235,13 +2230,9 @@ static void release_temp_i_array(glui32 *arr, glui32 addr, glui32 len, int passo
 {
   arrayref_t *arref = NULL;
   arrayref_t **aptr;
-  glui32 ix, val, addr2;
 
   if (arr) {
-    for (aptr=(&arrays); (*aptr); aptr=(&((*aptr)->next))) {
-      if ((*aptr)->array == arr)
-        break;
-    }
+    aptr = find_arrayref(arr);
     arref = *aptr;
     if (!arref)
       fatal_error("Unable to re-find array argument in Glk call.");
@@ -1252,17 +2243,14 @@ static void release_temp_i_array(glui32 *arr, glui32 addr, glui32 len, int passo
       return;
     }
 
-    *aptr = arref->next;
-    arref->next = NULL;
-
     if (passout) {
-      for (ix=0, addr2=addr; ix<len; ix++, addr2+=4) {
-        val = arr[ix];
-        MemW4(addr2, val);
-      }
+#ifdef VERIFY_MEMORY_ACCESS
+      verify_address_write(addr, len*4);
+#endif /* VERIFY_MEMORY_ACCESS */
+      write_word_array(memmap+addr, arr, len);
     }
     glulx_free(arr);
-    glulx_free(arref);
+    free_arrayref(aptr);
   }
 }
 
@@ -1274,17 +2262,10 @@ static void **grab_temp_ptr_array(glui32 addr, glui32 len, int objclass, int pas
 
   if (len) {
     arr = (void **)glulx_malloc(len * sizeof(void *));
-    arref = (arrayref_t *)glulx_malloc(sizeof(arrayref_t));
-    if (!arr || !arref) 
+    if (!arr) 
       fatal_error("Unable to allocate space for array argument to Glk call.");
 
-    arref->array = arr;
-    arref->addr = addr;
-    arref->elemsize = sizeof(void *);
-    arref->retained = FALSE;
-    arref->len = len;
-    arref->next = arrays;
-    arrays = arref;
+    arref = new_arrayref(arr, addr, sizeof(void *), len);
 
     if (passin) {
       for (ix=0, addr2=addr; ix<len; ix++, addr2+=4) {
@@ -1307,10 +2288,7 @@ static void release_temp_ptr_array(void **arr, glui32 addr, glui32 len, int objc
   glui32 ix, val, addr2;
 
   if (arr) {
-    for (aptr=(&arrays); (*aptr); aptr=(&((*aptr)->next))) {
-      if ((*aptr)->array == arr)
-        break;
-    }
+    aptr = find_arrayref(arr);
     arref = *aptr;
     if (!arref)
       fatal_error("Unable to re-find array argument in Glk call.");
@@ -1321,9 +2299,6 @@ static void release_temp_ptr_array(void **arr, glui32 addr, glui32 len, int objc
       return;
     }
 
-    *aptr = arref->next;
-    arref->next = NULL;
-
     if (passout) {
       for (ix=0, addr2=addr; ix<len; ix++, addr2+=4) {
         void *opref = arr[ix];
@@ -1339,7 +2314,7 @@ static void release_temp_ptr_array(void **arr, glui32 addr, glui32 len, int objc
       }
     }
     glulx_free(arr);
-    glulx_free(arref);
+    free_arrayref(aptr);
   }
 }
 
@@ -1361,10 +2336,7 @@ static gidispatch_rock_t glulxe_retained_register(void *array,
     return rock;
   }
 
-  for (aptr=(&arrays); (*aptr); aptr=(&((*aptr)->next))) {
-    if ((*aptr)->array == array)
-      break;
-  }
+  aptr = find_arrayref(array);
   arref = *aptr;
   if (!arref)
     fatal_error("Unable to re-find array argument in Glk call.");
@@ -1394,10 +2366,7 @@ static void glulxe_retained_unregister(void *array, glui32 len,
     return;
   }
 
-  for (aptr=(&arrays); (*aptr); aptr=(&((*aptr)->next))) {
-    if ((*aptr)->array == array)
-      break;
-  }
+  aptr = find_arrayref(array);
   arref = *aptr;
   if (!arref)
     fatal_error("Unable to re-find array argument in Glk call.");
@@ -1408,24 +2377,24 @@ static void glulxe_retained_unregister(void *array, glui32 len,
   if (arref->elemsize != elemsize || arref->len != len)
     fatal_error("Mismatched array argument in Glk call.");
 
-  *aptr = arref->next;
-  arref->next = NULL;
-
   if (elemsize == 1) {
     for (ix=0, addr2=arref->addr; ix<arref->len; ix++, addr2+=1) {
       val = ((char *)array)[ix];
       MemW1(addr2, val);
     }
   }
-  else if (elemsize == 4) {
-    for (ix=0, addr2=arref->addr; ix<arref->len; ix++, addr2+=4) {
-      val = ((glui32 *)array)[ix];
-      MemW4(addr2, val);
-    }
+  else if (elemsize == 4 && arref->len) {
+#ifdef VERIFY_MEMORY_ACCESS
+    verify_address_write(arref->addr, arref->len*4);
+#endif /* VERIFY_MEMORY_ACCESS */
+    write_word_array(memmap+arref->addr, (glui32 *)array, arref->len);
   }
 
+  if (glkrecord_capturing)
+    glkrecord_note_range(arref->addr, arref->len*elemsize);
+
   glulx_free(array);
-  glulx_free(arref);
+  free_arrayref(aptr);
 }
 
 static long glulxe_array_locate(void *array, glui32 len,
@@ -1445,10 +2414,7 @@ static long glulxe_array_locate(void *array, glui32 len,
     return (unsigned char *)array - memmap;
   }
   
-  for (aptr=(&arrays); (*aptr); aptr=(&((*aptr)->next))) {
-    if ((*aptr)->array == array)
-      break;
-  }
+  aptr = find_arrayref(array);
   arref = *aptr;
   if (!arref)
     fatal_error("Unable to re-find array argument in array_locate.");
@@ -38,6 +38,9 @@
 typedef uint16_t glui16;
 typedef int16_t glsi16;
 
+/* For sig_atomic_t. */
+#include <signal.h>
+
 /* Comment this definition to turn off memory-address checking. With
    verification on, all reads and writes to main memory will be checked
    to ensure they're in range. This is slower, but prevents malformed
@@ -56,6 +59,23 @@ typedef int16_t glsi16;
    _BSD_SOURCE or _DEFAULT_SOURCE or both for the timeradd() macro.) */
 /* #define VM_PROFILING (1) */
 
+/* Uncomment this definition to allow decoding compressed strings in
+   the background. With the "--predecode" option, a worker thread walks
+   ROM when the game starts, decodes every compressed string it finds,
+   and builds an index that string.c prints from. The game starts
+   running at once; strings printed before the index is ready are
+   decoded the ordinary way.
+   (Build note: uncomment PREDECODEOBJS and PTHREADLIB in the Makefile
+   as well.) */
+/* #define STRING_PREDECODE (1) */
+
+/* Uncomment this definition to allow loading accelerator plugins (see
+   accelplugin.h) with the "--accelplugin" option. Plugins are loaded
+   with dlopen().
+   (Build note: on Linux, you'll need to link with -ldl; see the
+   Makefile.) */
+/* #define ACCEL_PLUGINS (1) */
+
 /* Uncomment this definition to turn on the Glulx debugger. You should
    only do this when debugging facilities are desired; it slows down
    the interpreter. If you do, you will need to build with libxml2;
@@ -78,6 +98,13 @@ typedef int16_t glsi16;
    every time. */
 #define SERIALIZE_CACHE_RAM (1)
 
+/* The width, in bits, of the lookup window used to decode compressed
+   strings (when the string table is in ROM). Each table lookup consumes
+   up to this many bits and can emit several characters at once. The
+   top-level table has 2^TABLECACHE_BITS entries of 16 bytes each, so
+   this must be between 8 and 12. */
+#define TABLECACHE_BITS (10)
+
 /* Some macros to read and write integers to memory, always in big-endian
    format. */
 #define Read4(ptr)    \
@@ -221,6 +248,8 @@ extern void verify_address(glui32 addr, glui32 count);
 extern void verify_address_write(glui32 addr, glui32 count);
 extern void verify_address_stack(glui32 stackpos, glui32 count);
 extern void verify_array_addresses(glui32 addr, glui32 count, glui32 size);
+extern void read_word_array(glui32 *dest, unsigned char *src, glui32 count);
+extern void write_word_array(unsigned char *dest, glui32 *src, glui32 count);
 
 /* exec.c */
 extern void execute_loop(void);
@@ -242,16 +271,21 @@ extern void pop_callstub(glui32 returnvalue);
 extern glui32 pop_callstub_string(int *bitnum);
 
 /* string.c */
+extern glui32 string_memo_budget;
 extern void stream_num(glsi32 val, int inmiddle, int charnum);
 extern void stream_string(glui32 addr, int inmiddle, int bitnum);
 extern glui32 stream_get_table(void);
 extern void stream_set_table(glui32 addr);
 extern void stream_get_iosys(glui32 *mode, glui32 *rock);
 extern void stream_set_iosys(glui32 mode, glui32 rock);
+extern void stream_buffer_char(glui32 ch);
+extern void stream_buffer_text(void *text, glui32 len, int isuni);
+extern glui32 stream_output_pos(void);
+extern void stream_flush_output(void);
+extern void stream_send_output(glui32 start, glui32 end);
 extern char *make_temp_string(glui32 addr);
 extern glui32 *make_temp_ustring(glui32 addr);
-extern void free_temp_string(char *str);
-extern void free_temp_ustring(glui32 *str);
+extern void reset_temp_strings(void);
 
 /* heap.c */
 extern void heap_clear(void);
@@ -290,10 +324,12 @@ extern glui32 linked_search(glui32 key, glui32 keysize,
 extern void *glulx_malloc(glui32 len);
 extern void *glulx_realloc(void *ptr, glui32 len);
 extern void glulx_free(void *ptr);
+extern int rand_always_seeded;
 extern void glulx_setrandom(glui32 seed);
 extern glui32 glulx_random(void);
 extern void glulx_random_get_detstate(int *usenative, glui32 **arr, int *count);
 extern void glulx_random_set_detstate(int usenative, glui32 *arr, int count);
+extern glui32 glulx_microseconds(void);
 extern void glulx_sort(void *addr, int count, int size, 
   int (*comparefunc)(void *p1, void *p2));
 
@@ -309,25 +345,50 @@ extern glui32 find_id_for_window(winid_t win);
 extern glui32 find_id_for_stream(strid_t str);
 extern glui32 find_id_for_fileref(frefid_t fref);
 extern glui32 find_id_for_schannel(schanid_t schan);
+extern volatile sig_atomic_t glkstats_dump_requested;
+extern void setup_glkstats(void (*dumpfunc)(void));
+extern void glkstats_write(strid_t str);
+extern void glkstats_quit(void);
+extern void setup_glkrecord(strid_t stream, int replay);
+extern int glkrecord_start(void);
+extern void glkrecord_quit(void);
+extern int glkdefer_enabled;
+extern void setup_glkdefer(void);
+extern glui32 glkdefer_flush(void);
 
 /* profile.c */
 extern void setup_profile(strid_t stream, char *filename);
+extern void setup_string_profile(strid_t stream);
 extern int init_profile(void);
 extern void profile_set_call_counts(int flag);
+/* The things counted for each string by the string profiler. */
+#define profstr_Chars (0)
+#define profstr_CacheHits (1)
+#define profstr_MemoHits (2)
+#define profstr_TreeWalks (3)
+#define profstr_Indirect (4)
+#define profstr_Count (5)
 #if VM_PROFILING
 extern glui32 profile_opcount;
 #define profile_tick() (profile_opcount++)
+extern glui32 profile_strcounts[profstr_Count];
+#define profile_strcount(which, num) (profile_strcounts[which] += (num))
 extern int profile_profiling_active(void);
 extern void profile_in(glui32 addr, glui32 stackuse, int accel);
 extern void profile_out(glui32 stackuse);
 extern void profile_fail(char *reason);
+extern void profile_string_in(glui32 addr);
+extern void profile_string_out(void);
 extern void profile_quit(void);
 #else /* VM_PROFILING */
 #define profile_tick()         (0)
+#define profile_strcount(which, num)  (0)
 #define profile_profiling_active()         (0)
 #define profile_in(addr, stackuse, accel)  (0)
 #define profile_out(stackuse)  (0)
 #define profile_fail(reason)   (0)
+#define profile_string_in(addr)  (0)
+#define profile_string_out()   (0)
 #define profile_quit()         (0)
 #endif /* VM_PROFILING */
 
@@ -359,14 +420,57 @@ extern void debugger_handle_quit(void);
 
 /* accel.c */
 typedef glui32 (*acceleration_func)(glui32 argc, glui32 *argv);
+extern int accel_fallback;
 extern void init_accel(void);
 extern acceleration_func accel_find_func(glui32 index);
+extern glui32 accel_func_params(glui32 index);
 extern acceleration_func accel_get_func(glui32 addr);
 extern void accel_set_func(glui32 index, glui32 addr);
 extern void accel_set_param(glui32 index, glui32 val);
 extern glui32 accel_get_param_count(void);
 extern glui32 accel_get_param(glui32 index);
 extern void accel_iterate_funcs(void (*func)(glui32 index, glui32 addr));
+#if ACCEL_PLUGINS
+#include "accelplugin.h"
+extern int accel_load_plugin(glulxe_accel_plugin_init_t initfunc);
+extern void accel_start_plugins(void);
+#else /* ACCEL_PLUGINS */
+#define accel_start_plugins()  (0)
+#endif /* ACCEL_PLUGINS */
+
+/* predecode.c */
+#if STRING_PREDECODE
+/* predecoded_t:
+   The text at the start of one compressed string, up to its terminator
+   or its first indirect reference. The fields are as in string.c's
+   memo.
+*/
+typedef struct predecoded_struct {
+  glui32 addr; /* the first byte after the E1 */
+  glui32 resaddr; /* where decoding resumes, if not done */
+  int resbit;
+  int done;
+  int isuni; /* text is an array of glui32 rather than char */
+  glui32 len;
+  void *text;
+  struct predecoded_struct *hashnext;
+} predecoded_t;
+extern int predecode_enabled;
+extern void predecode_start(void);
+extern void predecode_stop(void);
+extern predecoded_t *predecode_find(glui32 addr);
+#else /* STRING_PREDECODE */
+#define predecode_enabled      (0)
+#define predecode_start()      (0)
+#define predecode_stop()       (0)
+#endif /* STRING_PREDECODE */
+
+/* accelscan.c */
+extern int accel_builtin_scan;
+extern int accel_load_fingerprints(strid_t stream);
+extern void accel_set_train_stream(strid_t stream);
+extern void accel_scan_functions(void);
+extern void accel_train_func(glui32 index, glui32 addr);
 
 #ifdef FLOAT_SUPPORT
 
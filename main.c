@@ -51,6 +51,9 @@ void glk_main()
     return;
   }
 
+  if (!glkrecord_start()) {
+    return;
+  }
   glulx_setrandom(init_rng_seed);
 #ifdef FLOAT_SUPPORT
   if (!init_float()) {
@@ -68,6 +71,7 @@ void glk_main()
   if (library_autorestore_hook)
     library_autorestore_hook();
   execute_loop();
+  stream_flush_output();
   finalize_vm();
 
   gamefile = NULL;
@@ -77,6 +81,8 @@ void glk_main()
   vm_exited_cleanly = TRUE;
   
   profile_quit();
+  glkstats_quit();
+  glkrecord_quit();
   glk_exit();
 }
 
@@ -122,6 +128,8 @@ void fatal_error_handler(char *str, char *arg, int useval, glsi32 val)
 {
   winid_t win;
 
+  stream_flush_output();
+
   /* If the debugger is compiled in, send the error message to the debug
      console. This may also block for debug commands, depending on 
      preferences. */
@@ -152,7 +160,11 @@ void fatal_error_handler(char *str, char *arg, int useval, glsi32 val)
 */
 void nonfatal_warning_handler(char *str, char *arg, int useval, glsi32 val)
 {
-  winid_t win = get_error_win();
+  winid_t win;
+
+  stream_flush_output();
+
+  win = get_error_win();
   if (win) {
     strid_t oldstr = glk_stream_get_current();
     glk_set_window(win);
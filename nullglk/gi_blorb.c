@@ -0,0 +1,259 @@
+/* gi_blorb.c: Blorb library layer for the null Glk library.
+    This reads the chunk list and resource index of a Blorb file, which
+    is enough for an interpreter to find its executable chunk. It
+    follows the interface of the gi_blorb layer designed by
+    Andrew Plotkin.
+*/
+
+#include <stdlib.h>
+#include "glk.h"
+#include "gi_blorb.h"
+
+#ifndef TRUE
+#define TRUE (1)
+#endif
+#ifndef FALSE
+#define FALSE (0)
+#endif
+
+typedef struct chunkdesc_struct {
+  glui32 type;
+  glui32 len;
+  glui32 startpos; /* start of chunk header */
+  glui32 datpos; /* start of data */
+  void *ptr; /* loaded data, if any */
+} chunkdesc_t;
+
+typedef struct resdesc_struct {
+  glui32 usage;
+  glui32 resnum;
+  glui32 chunknum;
+} resdesc_t;
+
+struct giblorb_map_struct {
+  strid_t file;
+  int numchunks;
+  chunkdesc_t *chunks;
+  int numresources;
+  resdesc_t *resources;
+};
+
+static giblorb_map_t *blorbmap = NULL;
+
+static int read_word(strid_t file, glui32 *val)
+{
+  unsigned char buf[4];
+  if (glk_get_buffer_stream(file, (char *)buf, 4) != 4)
+    return FALSE;
+  *val = ((glui32)buf[0] << 24) | ((glui32)buf[1] << 16)
+    | ((glui32)buf[2] << 8) | (glui32)buf[3];
+  return TRUE;
+}
+
+giblorb_err_t giblorb_create_map(strid_t file, giblorb_map_t **newmap)
+{
+  giblorb_map_t *map;
+  glui32 type, len, totallen, pos;
+  glui32 val, ix, jx;
+  int maxchunks;
+
+  *newmap = NULL;
+
+  glk_stream_set_position(file, 0, seekmode_Start);
+  if (!read_word(file, &type) || !read_word(file, &totallen)
+    || !read_word(file, &val))
+    return giblorb_err_Read;
+  if (type != giblorb_make_id('F', 'O', 'R', 'M')
+    || val != giblorb_make_id('I', 'F', 'R', 'S'))
+    return giblorb_err_Format;
+
+  map = (giblorb_map_t *)malloc(sizeof(giblorb_map_t));
+  if (!map)
+    return giblorb_err_Alloc;
+  map->file = file;
+  map->numchunks = 0;
+  map->numresources = 0;
+  map->resources = NULL;
+  maxchunks = 8;
+  map->chunks = (chunkdesc_t *)malloc(maxchunks * sizeof(chunkdesc_t));
+  if (!map->chunks) {
+    free(map);
+    return giblorb_err_Alloc;
+  }
+
+  pos = 12;
+  while (pos < totallen + 8) {
+    glk_stream_set_position(file, pos, seekmode_Start);
+    if (!read_word(file, &type) || !read_word(file, &len))
+      break;
+    if (map->numchunks >= maxchunks) {
+      maxchunks *= 2;
+      map->chunks = (chunkdesc_t *)realloc(map->chunks,
+        maxchunks * sizeof(chunkdesc_t));
+      if (!map->chunks)
+        return giblorb_err_Alloc;
+    }
+    map->chunks[map->numchunks].type = type;
+    map->chunks[map->numchunks].len = len;
+    map->chunks[map->numchunks].startpos = pos;
+    map->chunks[map->numchunks].datpos = pos+8;
+    map->chunks[map->numchunks].ptr = NULL;
+    map->numchunks++;
+
+    if (type == giblorb_make_id('R', 'I', 'd', 'x') && !map->resources) {
+      if (!read_word(file, &val))
+        return giblorb_err_Read;
+      map->resources = (resdesc_t *)malloc((val+1) * sizeof(resdesc_t));
+      if (!map->resources)
+        return giblorb_err_Alloc;
+      map->numresources = val;
+      for (ix=0; ix<val; ix++) {
+        glui32 usage, resnum, start;
+        if (!read_word(file, &usage) || !read_word(file, &resnum)
+          || !read_word(file, &start))
+          return giblorb_err_Read;
+        map->resources[ix].usage = usage;
+        map->resources[ix].resnum = resnum;
+        /* Store the position for now; it becomes a chunk number once
+           all the chunks are known. */
+        map->resources[ix].chunknum = start;
+      }
+    }
+
+    pos += 8 + len;
+    if (pos & 1)
+      pos++;
+  }
+
+  for (ix=0; ix<(glui32)map->numresources; ix++) {
+    glui32 start = map->resources[ix].chunknum;
+    map->resources[ix].chunknum = (glui32)-1;
+    for (jx=0; jx<(glui32)map->numchunks; jx++) {
+      if (map->chunks[jx].startpos == start) {
+        map->resources[ix].chunknum = jx;
+        break;
+      }
+    }
+  }
+
+  *newmap = map;
+  return giblorb_err_None;
+}
+
+giblorb_err_t giblorb_destroy_map(giblorb_map_t *map)
+{
+  int ix;
+  if (!map)
+    return giblorb_err_NotAMap;
+  for (ix=0; ix<map->numchunks; ix++) {
+    if (map->chunks[ix].ptr)
+      free(map->chunks[ix].ptr);
+  }
+  free(map->chunks);
+  if (map->resources)
+    free(map->resources);
+  free(map);
+  return giblorb_err_None;
+}
+
+giblorb_err_t giblorb_load_chunk_by_number(giblorb_map_t *map,
+  glui32 method, giblorb_result_t *res, glui32 chunknum)
+{
+  chunkdesc_t *chu;
+
+  if (!map)
+    return giblorb_err_NotAMap;
+  if (chunknum >= (glui32)map->numchunks)
+    return giblorb_err_NotFound;
+
+  chu = &(map->chunks[chunknum]);
+  res->chunknum = chunknum;
+  res->length = chu->len;
+  res->chunktype = chu->type;
+
+  switch (method) {
+    case giblorb_method_DontLoad:
+      break;
+    case giblorb_method_FilePos:
+      res->data.startpos = chu->datpos;
+      break;
+    case giblorb_method_Memory:
+      if (!chu->ptr) {
+        chu->ptr = malloc(chu->len ? chu->len : 1);
+        if (!chu->ptr)
+          return giblorb_err_Alloc;
+        glk_stream_set_position(map->file, chu->datpos, seekmode_Start);
+        if (glk_get_buffer_stream(map->file, (char *)chu->ptr, chu->len)
+          != chu->len)
+          return giblorb_err_Read;
+      }
+      res->data.ptr = chu->ptr;
+      break;
+  }
+  return giblorb_err_None;
+}
+
+giblorb_err_t giblorb_load_chunk_by_type(giblorb_map_t *map,
+  glui32 method, giblorb_result_t *res, glui32 chunktype, glui32 count)
+{
+  int ix;
+
+  if (!map)
+    return giblorb_err_NotAMap;
+  for (ix=0; ix<map->numchunks; ix++) {
+    if (map->chunks[ix].type == chunktype) {
+      if (count == 0)
+        return giblorb_load_chunk_by_number(map, method, res, ix);
+      count--;
+    }
+  }
+  return giblorb_err_NotFound;
+}
+
+giblorb_err_t giblorb_load_resource(giblorb_map_t *map, glui32 method,
+  giblorb_result_t *res, glui32 usage, glui32 resnum)
+{
+  int ix;
+
+  if (!map)
+    return giblorb_err_NotAMap;
+  for (ix=0; ix<map->numresources; ix++) {
+    if (map->resources[ix].usage == usage
+      && map->resources[ix].resnum == resnum) {
+      if (map->resources[ix].chunknum == (glui32)-1)
+        return giblorb_err_NotFound;
+      return giblorb_load_chunk_by_number(map, method, res,
+        map->resources[ix].chunknum);
+    }
+  }
+  return giblorb_err_NotFound;
+}
+
+giblorb_err_t giblorb_set_resource_map(strid_t file)
+{
+  giblorb_err_t err;
+
+  if (blorbmap) {
+    giblorb_destroy_map(blorbmap);
+    blorbmap = NULL;
+  }
+  err = giblorb_create_map(file, &blorbmap);
+  if (err) {
+    blorbmap = NULL;
+    return err;
+  }
+  return giblorb_err_None;
+}
+
+void giblorb_unset_resource_map()
+{
+  if (blorbmap) {
+    giblorb_destroy_map(blorbmap);
+    blorbmap = NULL;
+  }
+}
+
+giblorb_map_t *giblorb_get_resource_map()
+{
+  return blorbmap;
+}
@@ -0,0 +1,58 @@
+#ifndef _GI_BLORB_H
+#define _GI_BLORB_H
+
+/* gi_blorb.h: Blorb library layer for the null Glk library.
+    This follows the interface of the gi_blorb layer designed by
+    Andrew Plotkin. Only the calls an interpreter needs to find its
+    executable chunk are provided.
+*/
+
+typedef glui32 giblorb_err_t;
+
+#define giblorb_err_None (0)
+#define giblorb_err_CompileTime (1)
+#define giblorb_err_Alloc (2)
+#define giblorb_err_Read (3)
+#define giblorb_err_NotAMap (4)
+#define giblorb_err_Format (5)
+#define giblorb_err_NotFound (6)
+
+#define giblorb_make_id(c1, c2, c3, c4)  \
+  (((c1) << 24) | ((c2) << 16) | ((c3) << 8) | (c4))
+
+#define giblorb_ID_Exec      (giblorb_make_id('E', 'x', 'e', 'c'))
+#define giblorb_ID_Snd       (giblorb_make_id('S', 'n', 'd', ' '))
+#define giblorb_ID_Pict      (giblorb_make_id('P', 'i', 'c', 't'))
+#define giblorb_ID_Data      (giblorb_make_id('D', 'a', 't', 'a'))
+
+#define giblorb_method_DontLoad (0)
+#define giblorb_method_Memory (1)
+#define giblorb_method_FilePos (2)
+
+typedef struct giblorb_map_struct giblorb_map_t;
+
+typedef struct giblorb_result_struct {
+  glui32 chunknum;
+  union {
+    void *ptr;
+    glui32 startpos;
+  } data;
+  glui32 length;
+  glui32 chunktype;
+} giblorb_result_t;
+
+extern giblorb_err_t giblorb_create_map(strid_t file, giblorb_map_t **newmap);
+extern giblorb_err_t giblorb_destroy_map(giblorb_map_t *map);
+
+extern giblorb_err_t giblorb_load_chunk_by_type(giblorb_map_t *map,
+  glui32 method, giblorb_result_t *res, glui32 chunktype, glui32 count);
+extern giblorb_err_t giblorb_load_chunk_by_number(giblorb_map_t *map,
+  glui32 method, giblorb_result_t *res, glui32 chunknum);
+extern giblorb_err_t giblorb_load_resource(giblorb_map_t *map,
+  glui32 method, giblorb_result_t *res, glui32 usage, glui32 resnum);
+
+extern giblorb_err_t giblorb_set_resource_map(strid_t file);
+extern void giblorb_unset_resource_map(void);
+extern giblorb_map_t *giblorb_get_resource_map(void);
+
+#endif /* _GI_BLORB_H */
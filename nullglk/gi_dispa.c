@@ -0,0 +1,742 @@
+/* gi_dispa.c: Dispatch layer for the null Glk library.
+    This lets an interpreter call Glk functions by number, using the
+    prototype strings and argument-list conventions of the gi_dispa
+    layer designed by Andrew Plotkin.
+
+    Only the functions that the null library implements are listed;
+    gidispatch_prototype() returns NULL for any other number.
+*/
+
+#include <stddef.h>
+#include "glk.h"
+#include "gi_dispa.h"
+
+#ifndef NULL
+#define NULL 0
+#endif
+
+static gidispatch_intconst_t class_table[] = {
+  { "window", (0) },   /* "Qa" */
+  { "stream", (1) },   /* "Qb" */
+  { "fileref", (2) },  /* "Qc" */
+  { "schannel", (3) }, /* "Qd" */
+};
+
+static gidispatch_function_t function_table[] = {
+  { 0x0001, glk_exit, "exit" },
+  { 0x0003, glk_tick, "tick" },
+  { 0x0004, glk_gestalt, "gestalt" },
+  { 0x0005, glk_gestalt_ext, "gestalt_ext" },
+  { 0x0020, glk_window_iterate, "window_iterate" },
+  { 0x0021, glk_window_get_rock, "window_get_rock" },
+  { 0x0022, glk_window_get_root, "window_get_root" },
+  { 0x0023, glk_window_open, "window_open" },
+  { 0x0024, glk_window_close, "window_close" },
+  { 0x0025, glk_window_get_size, "window_get_size" },
+  { 0x0026, glk_window_set_arrangement, "window_set_arrangement" },
+  { 0x0027, glk_window_get_arrangement, "window_get_arrangement" },
+  { 0x0028, glk_window_get_type, "window_get_type" },
+  { 0x0029, glk_window_get_parent, "window_get_parent" },
+  { 0x002A, glk_window_clear, "window_clear" },
+  { 0x002B, glk_window_move_cursor, "window_move_cursor" },
+  { 0x002C, glk_window_get_stream, "window_get_stream" },
+  { 0x002D, glk_window_set_echo_stream, "window_set_echo_stream" },
+  { 0x002E, glk_window_get_echo_stream, "window_get_echo_stream" },
+  { 0x002F, glk_set_window, "set_window" },
+  { 0x0030, glk_window_get_sibling, "window_get_sibling" },
+  { 0x0040, glk_stream_iterate, "stream_iterate" },
+  { 0x0041, glk_stream_get_rock, "stream_get_rock" },
+  { 0x0042, glk_stream_open_file, "stream_open_file" },
+  { 0x0043, glk_stream_open_memory, "stream_open_memory" },
+  { 0x0044, glk_stream_close, "stream_close" },
+  { 0x0045, glk_stream_set_position, "stream_set_position" },
+  { 0x0046, glk_stream_get_position, "stream_get_position" },
+  { 0x0047, glk_stream_set_current, "stream_set_current" },
+  { 0x0048, glk_stream_get_current, "stream_get_current" },
+  { 0x0060, glk_fileref_create_temp, "fileref_create_temp" },
+  { 0x0061, glk_fileref_create_by_name, "fileref_create_by_name" },
+  { 0x0062, glk_fileref_create_by_prompt, "fileref_create_by_prompt" },
+  { 0x0063, glk_fileref_destroy, "fileref_destroy" },
+  { 0x0064, glk_fileref_iterate, "fileref_iterate" },
+  { 0x0065, glk_fileref_get_rock, "fileref_get_rock" },
+  { 0x0066, glk_fileref_delete_file, "fileref_delete_file" },
+  { 0x0067, glk_fileref_does_file_exist, "fileref_does_file_exist" },
+  { 0x0068, glk_fileref_create_from_fileref, "fileref_create_from_fileref" },
+  { 0x0080, glk_put_char, "put_char" },
+  { 0x0081, glk_put_char_stream, "put_char_stream" },
+  { 0x0082, glk_put_string, "put_string" },
+  { 0x0083, glk_put_string_stream, "put_string_stream" },
+  { 0x0084, glk_put_buffer, "put_buffer" },
+  { 0x0085, glk_put_buffer_stream, "put_buffer_stream" },
+  { 0x0086, glk_set_style, "set_style" },
+  { 0x0087, glk_set_style_stream, "set_style_stream" },
+  { 0x0090, glk_get_char_stream, "get_char_stream" },
+  { 0x0091, glk_get_line_stream, "get_line_stream" },
+  { 0x0092, glk_get_buffer_stream, "get_buffer_stream" },
+  { 0x00A0, glk_char_to_lower, "char_to_lower" },
+  { 0x00A1, glk_char_to_upper, "char_to_upper" },
+  { 0x00B0, glk_stylehint_set, "stylehint_set" },
+  { 0x00B1, glk_stylehint_clear, "stylehint_clear" },
+  { 0x00B2, glk_style_distinguish, "style_distinguish" },
+  { 0x00B3, glk_style_measure, "style_measure" },
+  { 0x00C0, glk_select, "select" },
+  { 0x00C1, glk_select_poll, "select_poll" },
+  { 0x00D0, glk_request_line_event, "request_line_event" },
+  { 0x00D1, glk_cancel_line_event, "cancel_line_event" },
+  { 0x00D2, glk_request_char_event, "request_char_event" },
+  { 0x00D3, glk_cancel_char_event, "cancel_char_event" },
+  { 0x00D4, glk_request_mouse_event, "request_mouse_event" },
+  { 0x00D5, glk_cancel_mouse_event, "cancel_mouse_event" },
+  { 0x00D6, glk_request_timer_events, "request_timer_events" },
+#ifdef GLK_MODULE_UNICODE
+  { 0x0120, glk_buffer_to_lower_case_uni, "buffer_to_lower_case_uni" },
+  { 0x0121, glk_buffer_to_upper_case_uni, "buffer_to_upper_case_uni" },
+  { 0x0122, glk_buffer_to_title_case_uni, "buffer_to_title_case_uni" },
+  { 0x0128, glk_put_char_uni, "put_char_uni" },
+  { 0x0129, glk_put_string_uni, "put_string_uni" },
+  { 0x012A, glk_put_buffer_uni, "put_buffer_uni" },
+  { 0x012B, glk_put_char_stream_uni, "put_char_stream_uni" },
+  { 0x012C, glk_put_string_stream_uni, "put_string_stream_uni" },
+  { 0x012D, glk_put_buffer_stream_uni, "put_buffer_stream_uni" },
+  { 0x0130, glk_get_char_stream_uni, "get_char_stream_uni" },
+  { 0x0131, glk_get_buffer_stream_uni, "get_buffer_stream_uni" },
+  { 0x0132, glk_get_line_stream_uni, "get_line_stream_uni" },
+  { 0x0138, glk_stream_open_file_uni, "stream_open_file_uni" },
+  { 0x0139, glk_stream_open_memory_uni, "stream_open_memory_uni" },
+  { 0x0140, glk_request_char_event_uni, "request_char_event_uni" },
+  { 0x0141, glk_request_line_event_uni, "request_line_event_uni" },
+#endif /* GLK_MODULE_UNICODE */
+};
+
+#define NUMCLASSES \
+  (sizeof(class_table) / sizeof(gidispatch_intconst_t))
+
+#define NUMFUNCTIONS \
+  (sizeof(function_table) / sizeof(gidispatch_function_t))
+
+glui32 gidispatch_count_classes()
+{
+  return NUMCLASSES;
+}
+
+gidispatch_intconst_t *gidispatch_get_class(glui32 index)
+{
+  if (index >= NUMCLASSES)
+    return NULL;
+  return &(class_table[index]);
+}
+
+glui32 gidispatch_count_intconst()
+{
+  return 0;
+}
+
+gidispatch_intconst_t *gidispatch_get_intconst(glui32 index)
+{
+  return NULL;
+}
+
+glui32 gidispatch_count_functions()
+{
+  return NUMFUNCTIONS;
+}
+
+gidispatch_function_t *gidispatch_get_function(glui32 index)
+{
+  if (index >= NUMFUNCTIONS)
+    return NULL;
+  return &(function_table[index]);
+}
+
+gidispatch_function_t *gidispatch_get_function_by_id(glui32 id)
+{
+  int top, bot, val;
+  gidispatch_function_t *func;
+
+  bot = 0;
+  top = NUMFUNCTIONS;
+
+  while (1) {
+    val = (top+bot) / 2;
+    func = &(function_table[val]);
+    if (func->id == id)
+      return func;
+    if (bot >= top-1)
+      break;
+    if (func->id < id) {
+      bot = val+1;
+    }
+    else {
+      top = val;
+    }
+  }
+
+  return NULL;
+}
+
+char *gidispatch_prototype(glui32 funcnum)
+{
+  switch (funcnum) {
+    case 0x0001: /* exit */
+      return "0:";
+    case 0x0003: /* tick */
+      return "0:";
+    case 0x0004: /* gestalt */
+      return "3IuIu:Iu";
+    case 0x0005: /* gestalt_ext */
+      return "4IuIu&#Iu:Iu";
+    case 0x0020: /* window_iterate */
+      return "3Qa<Iu:Qa";
+    case 0x0021: /* window_get_rock */
+      return "2Qa:Iu";
+    case 0x0022: /* window_get_root */
+      return "1:Qa";
+    case 0x0023: /* window_open */
+      return "6QaIuIuIuIu:Qa";
+    case 0x0024: /* window_close */
+      return "2Qa<[2IuIu]:";
+    case 0x0025: /* window_get_size */
+      return "3Qa<Iu<Iu:";
+    case 0x0026: /* window_set_arrangement */
+      return "4QaIuIuQa:";
+    case 0x0027: /* window_get_arrangement */
+      return "4Qa<Iu<Iu<Qa:";
+    case 0x0028: /* window_get_type */
+      return "2Qa:Iu";
+    case 0x0029: /* window_get_parent */
+      return "2Qa:Qa";
+    case 0x002A: /* window_clear */
+      return "1Qa:";
+    case 0x002B: /* window_move_cursor */
+      return "3QaIuIu:";
+    case 0x002C: /* window_get_stream */
+      return "2Qa:Qb";
+    case 0x002D: /* window_set_echo_stream */
+      return "2QaQb:";
+    case 0x002E: /* window_get_echo_stream */
+      return "2Qa:Qb";
+    case 0x002F: /* set_window */
+      return "1Qa:";
+    case 0x0030: /* window_get_sibling */
+      return "2Qa:Qa";
+    case 0x0040: /* stream_iterate */
+      return "3Qb<Iu:Qb";
+    case 0x0041: /* stream_get_rock */
+      return "2Qb:Iu";
+    case 0x0042: /* stream_open_file */
+      return "4QcIuIu:Qb";
+    case 0x0043: /* stream_open_memory */
+      return "4&+#!CnIuIu:Qb";
+    case 0x0044: /* stream_close */
+      return "2Qb<[2IuIu]:";
+    case 0x0045: /* stream_set_position */
+      return "3QbIsIu:";
+    case 0x0046: /* stream_get_position */
+      return "2Qb:Iu";
+    case 0x0047: /* stream_set_current */
+      return "1Qb:";
+    case 0x0048: /* stream_get_current */
+      return "1:Qb";
+    case 0x0060: /* fileref_create_temp */
+      return "3IuIu:Qc";
+    case 0x0061: /* fileref_create_by_name */
+      return "4IuSIu:Qc";
+    case 0x0062: /* fileref_create_by_prompt */
+      return "4IuIuIu:Qc";
+    case 0x0063: /* fileref_destroy */
+      return "1Qc:";
+    case 0x0064: /* fileref_iterate */
+      return "3Qc<Iu:Qc";
+    case 0x0065: /* fileref_get_rock */
+      return "2Qc:Iu";
+    case 0x0066: /* fileref_delete_file */
+      return "1Qc:";
+    case 0x0067: /* fileref_does_file_exist */
+      return "2Qc:Iu";
+    case 0x0068: /* fileref_create_from_fileref */
+      return "4IuQcIu:Qc";
+    case 0x0080: /* put_char */
+      return "1Cu:";
+    case 0x0081: /* put_char_stream */
+      return "2QbCu:";
+    case 0x0082: /* put_string */
+      return "1S:";
+    case 0x0083: /* put_string_stream */
+      return "2QbS:";
+    case 0x0084: /* put_buffer */
+      return "1>+#Cn:";
+    case 0x0085: /* put_buffer_stream */
+      return "2Qb>+#Cn:";
+    case 0x0086: /* set_style */
+      return "1Iu:";
+    case 0x0087: /* set_style_stream */
+      return "2QbIu:";
+    case 0x0090: /* get_char_stream */
+      return "2Qb:Is";
+    case 0x0091: /* get_line_stream */
+      return "3Qb<+#Cn:Iu";
+    case 0x0092: /* get_buffer_stream */
+      return "3Qb<+#Cn:Iu";
+    case 0x00A0: /* char_to_lower */
+      return "2Cu:Cu";
+    case 0x00A1: /* char_to_upper */
+      return "2Cu:Cu";
+    case 0x00B0: /* stylehint_set */
+      return "4IuIuIuIs:";
+    case 0x00B1: /* stylehint_clear */
+      return "3IuIuIu:";
+    case 0x00B2: /* style_distinguish */
+      return "4QaIuIu:Iu";
+    case 0x00B3: /* style_measure */
+      return "5QaIuIu<Iu:Iu";
+    case 0x00C0: /* select */
+      return "1<+[4IuQaIuIu]:";
+    case 0x00C1: /* select_poll */
+      return "1<+[4IuQaIuIu]:";
+    case 0x00D0: /* request_line_event */
+      return "3Qa&+#!CnIu:";
+    case 0x00D1: /* cancel_line_event */
+      return "2Qa<[4IuQaIuIu]:";
+    case 0x00D2: /* request_char_event */
+      return "1Qa:";
+    case 0x00D3: /* cancel_char_event */
+      return "1Qa:";
+    case 0x00D4: /* request_mouse_event */
+      return "1Qa:";
+    case 0x00D5: /* cancel_mouse_event */
+      return "1Qa:";
+    case 0x00D6: /* request_timer_events */
+      return "1Iu:";
+#ifdef GLK_MODULE_UNICODE
+    case 0x0120: /* buffer_to_lower_case_uni */
+      return "3&+#IuIu:Iu";
+    case 0x0121: /* buffer_to_upper_case_uni */
+      return "3&+#IuIu:Iu";
+    case 0x0122: /* buffer_to_title_case_uni */
+      return "4&+#IuIuIu:Iu";
+    case 0x0128: /* put_char_uni */
+      return "1Iu:";
+    case 0x0129: /* put_string_uni */
+      return "1U:";
+    case 0x012A: /* put_buffer_uni */
+      return "1>+#Iu:";
+    case 0x012B: /* put_char_stream_uni */
+      return "2QbIu:";
+    case 0x012C: /* put_string_stream_uni */
+      return "2QbU:";
+    case 0x012D: /* put_buffer_stream_uni */
+      return "2Qb>+#Iu:";
+    case 0x0130: /* get_char_stream_uni */
+      return "2Qb:Is";
+    case 0x0131: /* get_buffer_stream_uni */
+      return "3Qb<+#Iu:Iu";
+    case 0x0132: /* get_line_stream_uni */
+      return "3Qb<+#Iu:Iu";
+    case 0x0138: /* stream_open_file_uni */
+      return "4QcIuIu:Qb";
+    case 0x0139: /* stream_open_memory_uni */
+      return "4&+#!IuIuIu:Qb";
+    case 0x0140: /* request_char_event_uni */
+      return "1Qa:";
+    case 0x0141: /* request_line_event_uni */
+      return "3Qa&+#!IuIu:";
+#endif /* GLK_MODULE_UNICODE */
+    default:
+      return NULL;
+  }
+}
+
+/* A reference argument occupies a flag slot, followed by a value slot
+   if the flag is set. These pick up a pointer to the value (or NULL),
+   and advance ix past the argument. */
+#define GET_REF(ptr, field)  \
+  if (arglist[ix].ptrflag) { \
+    ix++; \
+    ptr = &(arglist[ix].field); \
+  } \
+  else { \
+    ptr = NULL; \
+  } \
+  ix++;
+
+/* An array argument occupies a flag slot, then the array pointer and
+   its length. */
+#define GET_ARRAY(arr, len, type)  \
+  if (arglist[ix].ptrflag) { \
+    ix++; \
+    arr = (type *)(arglist[ix].array); \
+    ix++; \
+    len = arglist[ix].uint; \
+  } \
+  else { \
+    arr = NULL; \
+    len = 0; \
+  } \
+  ix++;
+
+/* A returned value occupies a flag slot (always set) and a value slot. */
+#define RETURN_SLOT  (arglist[ix+1])
+
+void gidispatch_call(glui32 funcnum, glui32 numargs, gluniversal_t *arglist)
+{
+  int ix;
+  glui32 *uptr1, *uptr2;
+  void **optr;
+  char *carr;
+  glui32 *uarr;
+  glui32 len;
+  event_t ev;
+  stream_result_t res;
+
+  switch (funcnum) {
+    case 0x0001: /* exit */
+      glk_exit();
+      break;
+    case 0x0003: /* tick */
+      glk_tick();
+      break;
+    case 0x0004: /* gestalt */
+      arglist[3].uint = glk_gestalt(arglist[0].uint, arglist[1].uint);
+      break;
+    case 0x0005: /* gestalt_ext */
+      ix = 2;
+      GET_ARRAY(uarr, len, glui32);
+      RETURN_SLOT.uint = glk_gestalt_ext(arglist[0].uint, arglist[1].uint,
+        uarr, len);
+      break;
+
+    case 0x0020: /* window_iterate */
+    case 0x0040: /* stream_iterate */
+    case 0x0064: /* fileref_iterate */
+      ix = 1;
+      GET_REF(uptr1, uint);
+      if (funcnum == 0x0020)
+        RETURN_SLOT.opaqueref = glk_window_iterate(
+          (winid_t)arglist[0].opaqueref, uptr1);
+      else if (funcnum == 0x0040)
+        RETURN_SLOT.opaqueref = glk_stream_iterate(
+          (strid_t)arglist[0].opaqueref, uptr1);
+      else
+        RETURN_SLOT.opaqueref = glk_fileref_iterate(
+          (frefid_t)arglist[0].opaqueref, uptr1);
+      break;
+    case 0x0021: /* window_get_rock */
+      arglist[2].uint = glk_window_get_rock((winid_t)arglist[0].opaqueref);
+      break;
+    case 0x0022: /* window_get_root */
+      arglist[1].opaqueref = glk_window_get_root();
+      break;
+    case 0x0023: /* window_open */
+      arglist[6].opaqueref = glk_window_open((winid_t)arglist[0].opaqueref,
+        arglist[1].uint, arglist[2].uint, arglist[3].uint, arglist[4].uint);
+      break;
+    case 0x0024: /* window_close */
+    case 0x0044: /* stream_close */
+      if (funcnum == 0x0024)
+        glk_window_close((winid_t)arglist[0].opaqueref, &res);
+      else
+        glk_stream_close((strid_t)arglist[0].opaqueref, &res);
+      if (arglist[1].ptrflag) {
+        arglist[2].uint = res.readcount;
+        arglist[3].uint = res.writecount;
+      }
+      break;
+    case 0x0025: /* window_get_size */
+      ix = 1;
+      GET_REF(uptr1, uint);
+      GET_REF(uptr2, uint);
+      glk_window_get_size((winid_t)arglist[0].opaqueref, uptr1, uptr2);
+      break;
+    case 0x0026: /* window_set_arrangement */
+      glk_window_set_arrangement((winid_t)arglist[0].opaqueref,
+        arglist[1].uint, arglist[2].uint, (winid_t)arglist[3].opaqueref);
+      break;
+    case 0x0027: /* window_get_arrangement */
+      ix = 1;
+      GET_REF(uptr1, uint);
+      GET_REF(uptr2, uint);
+      GET_REF(optr, opaqueref);
+      glk_window_get_arrangement((winid_t)arglist[0].opaqueref, uptr1, uptr2,
+        (winid_t *)optr);
+      break;
+    case 0x0028: /* window_get_type */
+      arglist[2].uint = glk_window_get_type((winid_t)arglist[0].opaqueref);
+      break;
+    case 0x0029: /* window_get_parent */
+      arglist[2].opaqueref = glk_window_get_parent(
+        (winid_t)arglist[0].opaqueref);
+      break;
+    case 0x002A: /* window_clear */
+      glk_window_clear((winid_t)arglist[0].opaqueref);
+      break;
+    case 0x002B: /* window_move_cursor */
+      glk_window_move_cursor((winid_t)arglist[0].opaqueref, arglist[1].uint,
+        arglist[2].uint);
+      break;
+    case 0x002C: /* window_get_stream */
+      arglist[2].opaqueref = glk_window_get_stream(
+        (winid_t)arglist[0].opaqueref);
+      break;
+    case 0x002D: /* window_set_echo_stream */
+      glk_window_set_echo_stream((winid_t)arglist[0].opaqueref,
+        (strid_t)arglist[1].opaqueref);
+      break;
+    case 0x002E: /* window_get_echo_stream */
+      arglist[2].opaqueref = glk_window_get_echo_stream(
+        (winid_t)arglist[0].opaqueref);
+      break;
+    case 0x002F: /* set_window */
+      glk_set_window((winid_t)arglist[0].opaqueref);
+      break;
+    case 0x0030: /* window_get_sibling */
+      arglist[2].opaqueref = glk_window_get_sibling(
+        (winid_t)arglist[0].opaqueref);
+      break;
+
+    case 0x0041: /* stream_get_rock */
+      arglist[2].uint = glk_stream_get_rock((strid_t)arglist[0].opaqueref);
+      break;
+    case 0x0042: /* stream_open_file */
+      arglist[4].opaqueref = glk_stream_open_file(
+        (frefid_t)arglist[0].opaqueref, arglist[1].uint, arglist[2].uint);
+      break;
+    case 0x0043: /* stream_open_memory */
+      ix = 0;
+      GET_ARRAY(carr, len, char);
+      arglist[ix+3].opaqueref = glk_stream_open_memory(carr, len,
+        arglist[ix].uint, arglist[ix+1].uint);
+      break;
+    case 0x0045: /* stream_set_position */
+      glk_stream_set_position((strid_t)arglist[0].opaqueref,
+        arglist[1].sint, arglist[2].uint);
+      break;
+    case 0x0046: /* stream_get_position */
+      arglist[2].uint = glk_stream_get_position(
+        (strid_t)arglist[0].opaqueref);
+      break;
+    case 0x0047: /* stream_set_current */
+      glk_stream_set_current((strid_t)arglist[0].opaqueref);
+      break;
+    case 0x0048: /* stream_get_current */
+      arglist[1].opaqueref = glk_stream_get_current();
+      break;
+
+    case 0x0060: /* fileref_create_temp */
+      arglist[3].opaqueref = glk_fileref_create_temp(arglist[0].uint,
+        arglist[1].uint);
+      break;
+    case 0x0061: /* fileref_create_by_name */
+      arglist[4].opaqueref = glk_fileref_create_by_name(arglist[0].uint,
+        arglist[1].charstr, arglist[2].uint);
+      break;
+    case 0x0062: /* fileref_create_by_prompt */
+      arglist[4].opaqueref = glk_fileref_create_by_prompt(arglist[0].uint,
+        arglist[1].uint, arglist[2].uint);
+      break;
+    case 0x0063: /* fileref_destroy */
+      glk_fileref_destroy((frefid_t)arglist[0].opaqueref);
+      break;
+    case 0x0065: /* fileref_get_rock */
+      arglist[2].uint = glk_fileref_get_rock((frefid_t)arglist[0].opaqueref);
+      break;
+    case 0x0066: /* fileref_delete_file */
+      glk_fileref_delete_file((frefid_t)arglist[0].opaqueref);
+      break;
+    case 0x0067: /* fileref_does_file_exist */
+      arglist[2].uint = glk_fileref_does_file_exist(
+        (frefid_t)arglist[0].opaqueref);
+      break;
+    case 0x0068: /* fileref_create_from_fileref */
+      arglist[4].opaqueref = glk_fileref_create_from_fileref(arglist[0].uint,
+        (frefid_t)arglist[1].opaqueref, arglist[2].uint);
+      break;
+
+    case 0x0080: /* put_char */
+      glk_put_char(arglist[0].uch);
+      break;
+    case 0x0081: /* put_char_stream */
+      glk_put_char_stream((strid_t)arglist[0].opaqueref, arglist[1].uch);
+      break;
+    case 0x0082: /* put_string */
+      glk_put_string(arglist[0].charstr);
+      break;
+    case 0x0083: /* put_string_stream */
+      glk_put_string_stream((strid_t)arglist[0].opaqueref,
+        arglist[1].charstr);
+      break;
+    case 0x0084: /* put_buffer */
+      ix = 0;
+      GET_ARRAY(carr, len, char);
+      glk_put_buffer(carr, len);
+      break;
+    case 0x0085: /* put_buffer_stream */
+      ix = 1;
+      GET_ARRAY(carr, len, char);
+      glk_put_buffer_stream((strid_t)arglist[0].opaqueref, carr, len);
+      break;
+    case 0x0086: /* set_style */
+      glk_set_style(arglist[0].uint);
+      break;
+    case 0x0087: /* set_style_stream */
+      glk_set_style_stream((strid_t)arglist[0].opaqueref, arglist[1].uint);
+      break;
+    case 0x0090: /* get_char_stream */
+      arglist[2].sint = glk_get_char_stream((strid_t)arglist[0].opaqueref);
+      break;
+    case 0x0091: /* get_line_stream */
+    case 0x0092: /* get_buffer_stream */
+      ix = 1;
+      GET_ARRAY(carr, len, char);
+      if (funcnum == 0x0091)
+        RETURN_SLOT.uint = glk_get_line_stream(
+          (strid_t)arglist[0].opaqueref, carr, len);
+      else
+        RETURN_SLOT.uint = glk_get_buffer_stream(
+          (strid_t)arglist[0].opaqueref, carr, len);
+      break;
+    case 0x00A0: /* char_to_lower */
+      arglist[2].uch = glk_char_to_lower(arglist[0].uch);
+      break;
+    case 0x00A1: /* char_to_upper */
+      arglist[2].uch = glk_char_to_upper(arglist[0].uch);
+      break;
+    case 0x00B0: /* stylehint_set */
+      glk_stylehint_set(arglist[0].uint, arglist[1].uint, arglist[2].uint,
+        arglist[3].sint);
+      break;
+    case 0x00B1: /* stylehint_clear */
+      glk_stylehint_clear(arglist[0].uint, arglist[1].uint, arglist[2].uint);
+      break;
+    case 0x00B2: /* style_distinguish */
+      arglist[4].uint = glk_style_distinguish((winid_t)arglist[0].opaqueref,
+        arglist[1].uint, arglist[2].uint);
+      break;
+    case 0x00B3: /* style_measure */
+      ix = 3;
+      GET_REF(uptr1, uint);
+      RETURN_SLOT.uint = glk_style_measure((winid_t)arglist[0].opaqueref,
+        arglist[1].uint, arglist[2].uint, uptr1);
+      break;
+
+    case 0x00C0: /* select */
+    case 0x00C1: /* select_poll */
+    case 0x00D1: /* cancel_line_event */
+      if (funcnum == 0x00C0)
+        glk_select(&ev);
+      else if (funcnum == 0x00C1)
+        glk_select_poll(&ev);
+      else
+        glk_cancel_line_event((winid_t)arglist[0].opaqueref, &ev);
+      ix = (funcnum == 0x00D1) ? 1 : 0;
+      if (arglist[ix].ptrflag) {
+        arglist[ix+1].uint = ev.type;
+        arglist[ix+2].opaqueref = ev.win;
+        arglist[ix+3].uint = ev.val1;
+        arglist[ix+4].uint = ev.val2;
+      }
+      break;
+    case 0x00D0: /* request_line_event */
+      ix = 1;
+      GET_ARRAY(carr, len, char);
+      glk_request_line_event((winid_t)arglist[0].opaqueref, carr, len,
+        arglist[ix].uint);
+      break;
+    case 0x00D2: /* request_char_event */
+      glk_request_char_event((winid_t)arglist[0].opaqueref);
+      break;
+    case 0x00D3: /* cancel_char_event */
+      glk_cancel_char_event((winid_t)arglist[0].opaqueref);
+      break;
+    case 0x00D4: /* request_mouse_event */
+      glk_request_mouse_event((winid_t)arglist[0].opaqueref);
+      break;
+    case 0x00D5: /* cancel_mouse_event */
+      glk_cancel_mouse_event((winid_t)arglist[0].opaqueref);
+      break;
+    case 0x00D6: /* request_timer_events */
+      glk_request_timer_events(arglist[0].uint);
+      break;
+
+#ifdef GLK_MODULE_UNICODE
+    case 0x0120: /* buffer_to_lower_case_uni */
+    case 0x0121: /* buffer_to_upper_case_uni */
+      ix = 0;
+      GET_ARRAY(uarr, len, glui32);
+      if (funcnum == 0x0120)
+        arglist[ix+2].uint = glk_buffer_to_lower_case_uni(uarr, len,
+          arglist[ix].uint);
+      else
+        arglist[ix+2].uint = glk_buffer_to_upper_case_uni(uarr, len,
+          arglist[ix].uint);
+      break;
+    case 0x0122: /* buffer_to_title_case_uni */
+      ix = 0;
+      GET_ARRAY(uarr, len, glui32);
+      arglist[ix+3].uint = glk_buffer_to_title_case_uni(uarr, len,
+        arglist[ix].uint, arglist[ix+1].uint);
+      break;
+    case 0x0128: /* put_char_uni */
+      glk_put_char_uni(arglist[0].uint);
+      break;
+    case 0x0129: /* put_string_uni */
+      glk_put_string_uni(arglist[0].unicharstr);
+      break;
+    case 0x012A: /* put_buffer_uni */
+      ix = 0;
+      GET_ARRAY(uarr, len, glui32);
+      glk_put_buffer_uni(uarr, len);
+      break;
+    case 0x012B: /* put_char_stream_uni */
+      glk_put_char_stream_uni((strid_t)arglist[0].opaqueref,
+        arglist[1].uint);
+      break;
+    case 0x012C: /* put_string_stream_uni */
+      glk_put_string_stream_uni((strid_t)arglist[0].opaqueref,
+        arglist[1].unicharstr);
+      break;
+    case 0x012D: /* put_buffer_stream_uni */
+      ix = 1;
+      GET_ARRAY(uarr, len, glui32);
+      glk_put_buffer_stream_uni((strid_t)arglist[0].opaqueref, uarr, len);
+      break;
+    case 0x0130: /* get_char_stream_uni */
+      arglist[2].sint = glk_get_char_stream_uni(
+        (strid_t)arglist[0].opaqueref);
+      break;
+    case 0x0131: /* get_buffer_stream_uni */
+    case 0x0132: /* get_line_stream_uni */
+      ix = 1;
+      GET_ARRAY(uarr, len, glui32);
+      if (funcnum == 0x0131)
+        RETURN_SLOT.uint = glk_get_buffer_stream_uni(
+          (strid_t)arglist[0].opaqueref, uarr, len);
+      else
+        RETURN_SLOT.uint = glk_get_line_stream_uni(
+          (strid_t)arglist[0].opaqueref, uarr, len);
+      break;
+    case 0x0138: /* stream_open_file_uni */
+      arglist[4].opaqueref = glk_stream_open_file_uni(
+        (frefid_t)arglist[0].opaqueref, arglist[1].uint, arglist[2].uint);
+      break;
+    case 0x0139: /* stream_open_memory_uni */
+      ix = 0;
+      GET_ARRAY(uarr, len, glui32);
+      arglist[ix+3].opaqueref = glk_stream_open_memory_uni(uarr, len,
+        arglist[ix].uint, arglist[ix+1].uint);
+      break;
+    case 0x0140: /* request_char_event_uni */
+      glk_request_char_event_uni((winid_t)arglist[0].opaqueref);
+      break;
+    case 0x0141: /* request_line_event_uni */
+      ix = 1;
+      GET_ARRAY(uarr, len, glui32);
+      glk_request_line_event_uni((winid_t)arglist[0].opaqueref, uarr, len,
+        arglist[ix].uint);
+      break;
+#endif /* GLK_MODULE_UNICODE */
+
+    default:
+      /* do nothing */
+      break;
+  }
+}
@@ -0,0 +1,68 @@
+#ifndef _GI_DISPA_H
+#define _GI_DISPA_H
+
+/* gi_dispa.h: Header file for the dispatch layer of the null Glk library.
+    This follows the interface of the gi_dispa layer designed by
+    Andrew Plotkin, which is what lets an interpreter call Glk functions
+    by number.
+*/
+
+#define gidisp_Class_Window (0)
+#define gidisp_Class_Stream (1)
+#define gidisp_Class_Fileref (2)
+#define gidisp_Class_Schannel (3)
+
+typedef union gluniversal_union {
+  glui32 uint; /* Iu */
+  glsi32 sint; /* Is */
+  void *opaqueref; /* Qa, Qb, Qc... */
+  unsigned char uch; /* Cu */
+  signed char sch; /* Cs */
+  char ch; /* Cn */
+  char *charstr; /* S */
+  glui32 *unicharstr; /* U */
+  void *array; /* all # arguments */
+  glui32 ptrflag; /* [ ... ] or *? */
+} gluniversal_t;
+
+typedef struct gidispatch_function_struct {
+  glui32 id;
+  void *fnptr;
+  char *name;
+} gidispatch_function_t;
+
+typedef struct gidispatch_intconst_struct {
+  char *name;
+  glui32 val;
+} gidispatch_intconst_t;
+
+typedef union glk_objrock_union {
+  glui32 num;
+  void *ptr;
+} gidispatch_rock_t;
+
+/* The following functions are part of the Glk library itself, not the
+   dispatch layer (whose code is in gi_dispa.c). These functions are
+   simply given the ability to store a dispatch rock in each object. */
+extern void gidispatch_set_object_registry(
+  gidispatch_rock_t (*regi)(void *obj, glui32 objclass),
+  void (*unregi)(void *obj, glui32 objclass, gidispatch_rock_t objrock));
+extern gidispatch_rock_t gidispatch_get_objrock(void *obj, glui32 objclass);
+extern void gidispatch_set_retained_registry(
+  gidispatch_rock_t (*regi)(void *array, glui32 len, char *typecode),
+  void (*unregi)(void *array, glui32 len, char *typecode,
+    gidispatch_rock_t objrock));
+
+/* The following functions make up the Glk dispatch layer. */
+extern void gidispatch_call(glui32 funcnum, glui32 numargs,
+  gluniversal_t *arglist);
+extern char *gidispatch_prototype(glui32 funcnum);
+extern glui32 gidispatch_count_classes(void);
+extern gidispatch_intconst_t *gidispatch_get_class(glui32 index);
+extern glui32 gidispatch_count_intconst(void);
+extern gidispatch_intconst_t *gidispatch_get_intconst(glui32 index);
+extern glui32 gidispatch_count_functions(void);
+extern gidispatch_function_t *gidispatch_get_function(glui32 index);
+extern gidispatch_function_t *gidispatch_get_function_by_id(glui32 id);
+
+#endif /* _GI_DISPA_H */
@@ -0,0 +1,38 @@
+#ifndef GT_START_H
+#define GT_START_H
+
+/* glkstart.h: Unix-specific startup interface for the null Glk library.
+    This is the same interface that the Unix Glk libraries (cheapglk,
+    glkterm, and so on) offer: the program supplies a table of
+    command-line arguments and a startup function, and the library
+    supplies main().
+*/
+
+#define glkunix_arg_End (0)
+#define glkunix_arg_ValueFollows (1)
+#define glkunix_arg_NoValue (2)
+#define glkunix_arg_ValueCanFollow (3)
+#define glkunix_arg_NumberValue (4)
+
+typedef struct glkunix_argumentlist_struct {
+  char *name;
+  int argtype;
+  char *desc;
+} glkunix_argumentlist_t;
+
+typedef struct glkunix_startup_struct {
+  int argc;
+  char **argv;
+} glkunix_startup_t;
+
+extern glkunix_argumentlist_t glkunix_arguments[];
+
+extern int glkunix_startup_code(glkunix_startup_t *data);
+
+extern void glkunix_set_base_file(char *filename);
+extern strid_t glkunix_stream_open_pathname_gen(char *pathname,
+  glui32 writemode, glui32 textmode, glui32 rock);
+extern strid_t glkunix_stream_open_pathname(char *pathname, glui32 textmode,
+  glui32 rock);
+
+#endif /* GT_START_H */
@@ -0,0 +1,1641 @@
+/* nullglk.c: A headless Glk library for benchmarking Glulxe.
+    Window output is counted and discarded (or echoed to stdout, for
+    checking that a run went where it should). Line and character input
+    come from a script file, one line per input event. When the script
+    runs out, or the game waits for input that can never arrive, the
+    library exits.
+
+    Memory and file streams are real, so games that print to buffers,
+    save, restore, or write transcripts behave as they would under any
+    other library.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "glk.h"
+#include "gi_dispa.h"
+#include "glkstart.h"
+
+#ifndef TRUE
+#define TRUE (1)
+#endif
+#ifndef FALSE
+#define FALSE (0)
+#endif
+
+#define strtype_Window (1)
+#define strtype_File (2)
+#define strtype_Memory (3)
+
+struct glk_window_struct {
+  glui32 rock;
+  glui32 type;
+  winid_t parent;
+  winid_t child1, child2; /* pair windows only */
+  glui32 method, size;
+  winid_t key;
+
+  strid_t str;
+  strid_t echostr;
+
+  int line_request;
+  int line_request_uni;
+  int char_request;
+  int char_request_uni;
+  void *inbuf;
+  glui32 inmax;
+  gidispatch_rock_t inarrayrock;
+
+  gidispatch_rock_t disprock;
+  winid_t next, prev;
+};
+
+struct glk_stream_struct {
+  glui32 rock;
+  int type;
+  int unicode;
+  int readable, writable;
+  glui32 readcount, writecount;
+
+  winid_t win;
+
+  FILE *file;
+  int textmode;
+  int lastop; /* 0, filemode_Read, or filemode_Write */
+
+  char *buf;
+  glui32 *ubuf;
+  glui32 buflen, bufpos, bufeof;
+  gidispatch_rock_t arrayrock;
+
+  gidispatch_rock_t disprock;
+  strid_t next, prev;
+};
+
+struct glk_fileref_struct {
+  glui32 rock;
+  char *filename;
+  int textmode;
+  gidispatch_rock_t disprock;
+  frefid_t next, prev;
+};
+
+static winid_t windowlist = NULL;
+static strid_t streamlist = NULL;
+static frefid_t filereflist = NULL;
+static winid_t rootwin = NULL;
+static strid_t currentstr = NULL;
+
+static glui32 timer_interval = 0;
+
+static FILE *scriptfile = NULL;
+static int pref_echo = FALSE;
+static int pref_stats = FALSE;
+static char *basedir = NULL;
+
+static glui32 count_output = 0;
+static glui32 count_inputs = 0;
+static glui32 count_tempfiles = 0;
+
+static gidispatch_rock_t (*gli_register_obj)(void *obj, glui32 objclass) = NULL;
+static void (*gli_unregister_obj)(void *obj, glui32 objclass,
+  gidispatch_rock_t objrock) = NULL;
+static gidispatch_rock_t (*gli_register_arr)(void *array, glui32 len,
+  char *typecode) = NULL;
+static void (*gli_unregister_arr)(void *array, glui32 len, char *typecode,
+  gidispatch_rock_t objrock) = NULL;
+
+static void gli_fatal(char *msg);
+static strid_t gli_new_stream(int type, int readable, int writable,
+  glui32 rock);
+static void gli_delete_stream(strid_t str);
+static void gli_put_char(strid_t str, glui32 ch);
+static glsi32 gli_get_char(strid_t str);
+static void gli_echo_char(glui32 ch);
+static char *gli_read_script_line(void);
+
+/* Startup and shutdown. */
+
+int main(int argc, char *argv[])
+{
+  glkunix_startup_t startdata;
+  glkunix_argumentlist_t *argform;
+  char **newargv;
+  int newargc;
+  int ix;
+
+  scriptfile = stdin;
+
+  newargv = (char **)malloc((argc+1) * sizeof(char *));
+  if (!newargv)
+    gli_fatal("Unable to allocate argument list.");
+  newargv[0] = argv[0];
+  newargc = 1;
+
+  for (ix=1; ix<argc; ix++) {
+    if (!strcmp(argv[ix], "--script") || !strcmp(argv[ix], "-s")) {
+      ix++;
+      if (ix >= argc)
+        gli_fatal("--script requires a filename.");
+      scriptfile = fopen(argv[ix], "r");
+      if (!scriptfile) {
+        fprintf(stderr, "nullglk: unable to open script %s\n", argv[ix]);
+        exit(1);
+      }
+      continue;
+    }
+    if (!strcmp(argv[ix], "--echo")) {
+      pref_echo = TRUE;
+      continue;
+    }
+    if (!strcmp(argv[ix], "--stats")) {
+      pref_stats = TRUE;
+      continue;
+    }
+
+    /* Check the argument against the program's table, so that the
+       program only sees arguments it declared. */
+    for (argform = glkunix_arguments; argform->argtype != glkunix_arg_End;
+      argform++) {
+      if (argform->name[0] == '\0') {
+        if (argv[ix][0] != '-')
+          break;
+      }
+      else if (!strcmp(argv[ix], argform->name)) {
+        break;
+      }
+    }
+    if (argform->argtype == glkunix_arg_End) {
+      fprintf(stderr, "usage: %s [--script file] [--echo] [--stats]",
+        argv[0]);
+      for (argform = glkunix_arguments;
+        argform->argtype != glkunix_arg_End; argform++) {
+        if (argform->name[0])
+          fprintf(stderr, " [%s]", argform->name);
+      }
+      fprintf(stderr, " file\n");
+      for (argform = glkunix_arguments;
+        argform->argtype != glkunix_arg_End; argform++) {
+        fprintf(stderr, "  %s %s\n",
+          (argform->name[0] ? argform->name : "file"), argform->desc);
+      }
+      exit(1);
+    }
+
+    newargv[newargc++] = argv[ix];
+    if (argform->name[0] && (argform->argtype == glkunix_arg_ValueFollows
+      || argform->argtype == glkunix_arg_NumberValue)) {
+      ix++;
+      if (ix >= argc) {
+        fprintf(stderr, "nullglk: %s requires a value.\n", argform->name);
+        exit(1);
+      }
+      newargv[newargc++] = argv[ix];
+    }
+    else if (argform->name[0]
+      && argform->argtype == glkunix_arg_ValueCanFollow) {
+      if (ix+1 < argc && argv[ix+1][0] != '-') {
+        ix++;
+        newargv[newargc++] = argv[ix];
+      }
+    }
+  }
+  newargv[newargc] = NULL;
+
+  startdata.argc = newargc;
+  startdata.argv = newargv;
+  if (!glkunix_startup_code(&startdata))
+    glk_exit();
+
+  glk_main();
+  glk_exit();
+  return 0;
+}
+
+void glk_exit()
+{
+  if (pref_echo)
+    fflush(stdout);
+  if (pref_stats) {
+    fprintf(stderr, "nullglk: %lu characters output, %lu input events\n",
+      (unsigned long)count_output, (unsigned long)count_inputs);
+  }
+  exit(0);
+}
+
+void glk_set_interrupt_handler(void (*func)(void))
+{
+  /* There is no way to interrupt us, so the handler is never called. */
+}
+
+void glk_tick()
+{
+}
+
+static void gli_fatal(char *msg)
+{
+  fprintf(stderr, "nullglk: %s\n", msg);
+  exit(1);
+}
+
+glui32 glk_gestalt(glui32 sel, glui32 val)
+{
+  return glk_gestalt_ext(sel, val, NULL, 0);
+}
+
+glui32 glk_gestalt_ext(glui32 sel, glui32 val, glui32 *arr, glui32 arrlen)
+{
+  switch (sel) {
+    case gestalt_Version:
+      return 0x00070500;
+    case gestalt_LineInput:
+      return (val >= 32 && val < 0x10FFFF);
+    case gestalt_CharInput:
+      return (val >= 32 && val < 0x10FFFF) || val == keycode_Return;
+    case gestalt_CharOutput:
+      if (arr && arrlen >= 1)
+        arr[0] = 1;
+      if (val >= 32 && val < 0x10FFFF)
+        return gestalt_CharOutput_ExactPrint;
+      return gestalt_CharOutput_CannotPrint;
+    case gestalt_Timer:
+    case gestalt_Unicode:
+      return TRUE;
+    default:
+      return 0;
+  }
+}
+
+unsigned char glk_char_to_lower(unsigned char ch)
+{
+  if (ch >= 'A' && ch <= 'Z')
+    return ch + ('a' - 'A');
+  if ((ch >= 0xC0 && ch <= 0xDE) && ch != 0xD7)
+    return ch + 0x20;
+  return ch;
+}
+
+unsigned char glk_char_to_upper(unsigned char ch)
+{
+  if (ch >= 'a' && ch <= 'z')
+    return ch - ('a' - 'A');
+  if ((ch >= 0xE0 && ch <= 0xFE) && ch != 0xF7)
+    return ch - 0x20;
+  return ch;
+}
+
+/* The dispatch registry. */
+
+void gidispatch_set_object_registry(
+  gidispatch_rock_t (*regi)(void *obj, glui32 objclass),
+  void (*unregi)(void *obj, glui32 objclass, gidispatch_rock_t objrock))
+{
+  winid_t win;
+  strid_t str;
+  frefid_t fref;
+
+  gli_register_obj = regi;
+  gli_unregister_obj = unregi;
+
+  /* Objects which already exist need rocks too. */
+  if (gli_register_obj) {
+    for (win = windowlist; win; win = win->next)
+      win->disprock = (*gli_register_obj)(win, gidisp_Class_Window);
+    for (str = streamlist; str; str = str->next)
+      str->disprock = (*gli_register_obj)(str, gidisp_Class_Stream);
+    for (fref = filereflist; fref; fref = fref->next)
+      fref->disprock = (*gli_register_obj)(fref, gidisp_Class_Fileref);
+  }
+}
+
+gidispatch_rock_t gidispatch_get_objrock(void *obj, glui32 objclass)
+{
+  gidispatch_rock_t dummy;
+
+  switch (objclass) {
+    case gidisp_Class_Window:
+      return ((winid_t)obj)->disprock;
+    case gidisp_Class_Stream:
+      return ((strid_t)obj)->disprock;
+    case gidisp_Class_Fileref:
+      return ((frefid_t)obj)->disprock;
+    default:
+      dummy.num = 0;
+      return dummy;
+  }
+}
+
+void gidispatch_set_retained_registry(
+  gidispatch_rock_t (*regi)(void *array, glui32 len, char *typecode),
+  void (*unregi)(void *array, glui32 len, char *typecode,
+    gidispatch_rock_t objrock))
+{
+  gli_register_arr = regi;
+  gli_unregister_arr = unregi;
+}
+
+/* Windows. Output to a window goes nowhere, except into the character
+   count (and stdout, if --echo was given). The window tree is kept
+   properly, because games inspect it. */
+
+static winid_t gli_new_window(glui32 type, glui32 rock)
+{
+  winid_t win = (winid_t)malloc(sizeof(struct glk_window_struct));
+  if (!win)
+    gli_fatal("Unable to allocate window.");
+  memset(win, 0, sizeof(struct glk_window_struct));
+  win->type = type;
+  win->rock = rock;
+
+  win->prev = NULL;
+  win->next = windowlist;
+  windowlist = win;
+  if (win->next)
+    win->next->prev = win;
+
+  if (type != wintype_Pair) {
+    win->str = gli_new_stream(strtype_Window, FALSE, TRUE, 0);
+    win->str->win = win;
+  }
+
+  if (gli_register_obj)
+    win->disprock = (*gli_register_obj)(win, gidisp_Class_Window);
+  return win;
+}
+
+static void gli_delete_window(winid_t win)
+{
+  winid_t prev, next;
+
+  if (win->line_request && gli_unregister_arr) {
+    (*gli_unregister_arr)(win->inbuf, win->inmax,
+      (win->line_request_uni ? "&+#!Iu" : "&+#!Cn"), win->inarrayrock);
+  }
+  win->line_request = FALSE;
+
+  if (gli_unregister_obj)
+    (*gli_unregister_obj)(win, gidisp_Class_Window, win->disprock);
+
+  if (win->str) {
+    gli_delete_stream(win->str);
+    win->str = NULL;
+  }
+
+  prev = win->prev;
+  next = win->next;
+  if (prev)
+    prev->next = next;
+  else
+    windowlist = next;
+  if (next)
+    next->prev = prev;
+  free(win);
+}
+
+winid_t glk_window_get_root()
+{
+  return rootwin;
+}
+
+winid_t glk_window_open(winid_t split, glui32 method, glui32 size,
+  glui32 wintype, glui32 rock)
+{
+  winid_t win, pairwin, oldparent;
+
+  if (!rootwin) {
+    if (split)
+      return NULL;
+  }
+  else {
+    if (!split)
+      return NULL;
+  }
+
+  if (wintype != wintype_Blank && wintype != wintype_TextBuffer
+    && wintype != wintype_TextGrid && wintype != wintype_Graphics)
+    return NULL;
+
+  win = gli_new_window(wintype, rock);
+
+  if (!split) {
+    rootwin = win;
+    return win;
+  }
+
+  oldparent = split->parent;
+  pairwin = gli_new_window(wintype_Pair, 0);
+  pairwin->method = method;
+  pairwin->size = size;
+  pairwin->key = win;
+  pairwin->child1 = split;
+  pairwin->child2 = win;
+  pairwin->parent = oldparent;
+  split->parent = pairwin;
+  win->parent = pairwin;
+
+  if (oldparent) {
+    if (oldparent->child1 == split)
+      oldparent->child1 = pairwin;
+    else
+      oldparent->child2 = pairwin;
+  }
+  else {
+    rootwin = pairwin;
+  }
+
+  return win;
+}
+
+static void gli_close_subtree(winid_t win)
+{
+  if (win->type == wintype_Pair) {
+    gli_close_subtree(win->child1);
+    gli_close_subtree(win->child2);
+  }
+  gli_delete_window(win);
+}
+
+void glk_window_close(winid_t win, stream_result_t *result)
+{
+  winid_t pairwin, sibling, grandparent;
+
+  if (!win)
+    return;
+
+  if (result) {
+    if (win->str) {
+      result->readcount = win->str->readcount;
+      result->writecount = win->str->writecount;
+    }
+    else {
+      result->readcount = 0;
+      result->writecount = 0;
+    }
+  }
+
+  if (currentstr && currentstr->win == win)
+    currentstr = NULL;
+
+  pairwin = win->parent;
+  if (!pairwin) {
+    rootwin = NULL;
+    gli_close_subtree(win);
+    return;
+  }
+
+  sibling = (pairwin->child1 == win) ? pairwin->child2 : pairwin->child1;
+  grandparent = pairwin->parent;
+  sibling->parent = grandparent;
+  if (!grandparent) {
+    rootwin = sibling;
+  }
+  else {
+    if (grandparent->child1 == pairwin)
+      grandparent->child1 = sibling;
+    else
+      grandparent->child2 = sibling;
+  }
+
+  gli_close_subtree(win);
+  gli_delete_window(pairwin);
+}
+
+void glk_window_get_size(winid_t win, glui32 *widthptr, glui32 *heightptr)
+{
+  glui32 wid = 0, hgt = 0;
+
+  if (win) {
+    switch (win->type) {
+      case wintype_TextBuffer:
+      case wintype_TextGrid:
+        wid = 80;
+        hgt = 24;
+        break;
+      case wintype_Graphics:
+        wid = 640;
+        hgt = 480;
+        break;
+    }
+  }
+  if (widthptr)
+    *widthptr = wid;
+  if (heightptr)
+    *heightptr = hgt;
+}
+
+void glk_window_set_arrangement(winid_t win, glui32 method, glui32 size,
+  winid_t keywin)
+{
+  if (!win || win->type != wintype_Pair)
+    return;
+  win->method = method;
+  win->size = size;
+  if (keywin)
+    win->key = keywin;
+}
+
+void glk_window_get_arrangement(winid_t win, glui32 *methodptr,
+  glui32 *sizeptr, winid_t *keywinptr)
+{
+  if (!win || win->type != wintype_Pair) {
+    if (methodptr) *methodptr = 0;
+    if (sizeptr) *sizeptr = 0;
+    if (keywinptr) *keywinptr = NULL;
+    return;
+  }
+  if (methodptr) *methodptr = win->method;
+  if (sizeptr) *sizeptr = win->size;
+  if (keywinptr) *keywinptr = win->key;
+}
+
+winid_t glk_window_iterate(winid_t win, glui32 *rockptr)
+{
+  win = (win ? win->next : windowlist);
+  if (rockptr)
+    *rockptr = (win ? win->rock : 0);
+  return win;
+}
+
+glui32 glk_window_get_rock(winid_t win)
+{
+  return (win ? win->rock : 0);
+}
+
+glui32 glk_window_get_type(winid_t win)
+{
+  return (win ? win->type : 0);
+}
+
+winid_t glk_window_get_parent(winid_t win)
+{
+  return (win ? win->parent : NULL);
+}
+
+winid_t glk_window_get_sibling(winid_t win)
+{
+  if (!win || !win->parent)
+    return NULL;
+  if (win->parent->child1 == win)
+    return win->parent->child2;
+  return win->parent->child1;
+}
+
+void glk_window_clear(winid_t win)
+{
+}
+
+void glk_window_move_cursor(winid_t win, glui32 xpos, glui32 ypos)
+{
+}
+
+strid_t glk_window_get_stream(winid_t win)
+{
+  return (win ? win->str : NULL);
+}
+
+void glk_window_set_echo_stream(winid_t win, strid_t str)
+{
+  if (win)
+    win->echostr = str;
+}
+
+strid_t glk_window_get_echo_stream(winid_t win)
+{
+  return (win ? win->echostr : NULL);
+}
+
+void glk_set_window(winid_t win)
+{
+  currentstr = (win ? win->str : NULL);
+}
+
+/* Streams. */
+
+static strid_t gli_new_stream(int type, int readable, int writable,
+  glui32 rock)
+{
+  strid_t str = (strid_t)malloc(sizeof(struct glk_stream_struct));
+  if (!str)
+    gli_fatal("Unable to allocate stream.");
+  memset(str, 0, sizeof(struct glk_stream_struct));
+  str->type = type;
+  str->rock = rock;
+  str->readable = readable;
+  str->writable = writable;
+
+  str->prev = NULL;
+  str->next = streamlist;
+  streamlist = str;
+  if (str->next)
+    str->next->prev = str;
+
+  if (gli_register_obj)
+    str->disprock = (*gli_register_obj)(str, gidisp_Class_Stream);
+  return str;
+}
+
+static void gli_delete_stream(strid_t str)
+{
+  strid_t prev, next;
+  winid_t win;
+
+  if (str == currentstr)
+    currentstr = NULL;
+  for (win = windowlist; win; win = win->next) {
+    if (win->echostr == str)
+      win->echostr = NULL;
+  }
+
+  if (gli_unregister_obj)
+    (*gli_unregister_obj)(str, gidisp_Class_Stream, str->disprock);
+
+  if (str->type == strtype_Memory && gli_unregister_arr) {
+    if (str->unicode && str->ubuf)
+      (*gli_unregister_arr)(str->ubuf, str->buflen, "&+#!Iu",
+        str->arrayrock);
+    else if (!str->unicode && str->buf)
+      (*gli_unregister_arr)(str->buf, str->buflen, "&+#!Cn",
+        str->arrayrock);
+  }
+  if (str->type == strtype_File && str->file) {
+    fclose(str->file);
+    str->file = NULL;
+  }
+
+  prev = str->prev;
+  next = str->next;
+  if (prev)
+    prev->next = next;
+  else
+    streamlist = next;
+  if (next)
+    next->prev = prev;
+  free(str);
+}
+
+static strid_t gli_open_file(char *filename, int textmode, glui32 fmode,
+  int unicode, glui32 rock)
+{
+  char modestr[4];
+  FILE *fl;
+  strid_t str;
+
+  if (fmode == filemode_ReadWrite) {
+    /* Create the file if it doesn't exist, without truncating it. */
+    fl = fopen(filename, "ab");
+    if (fl)
+      fclose(fl);
+  }
+
+  switch (fmode) {
+    case filemode_Write:
+      strcpy(modestr, "w");
+      break;
+    case filemode_Read:
+      strcpy(modestr, "r");
+      break;
+    case filemode_ReadWrite:
+      strcpy(modestr, "r+");
+      break;
+    case filemode_WriteAppend:
+      strcpy(modestr, "a");
+      break;
+    default:
+      return NULL;
+  }
+  if (!textmode)
+    strcat(modestr, "b");
+
+  fl = fopen(filename, modestr);
+  if (!fl)
+    return NULL;
+
+  str = gli_new_stream(strtype_File,
+    (fmode != filemode_Write && fmode != filemode_WriteAppend),
+    (fmode != filemode_Read), rock);
+  str->file = fl;
+  str->textmode = textmode;
+  str->unicode = unicode;
+  return str;
+}
+
+strid_t glk_stream_open_file(frefid_t fref, glui32 fmode, glui32 rock)
+{
+  if (!fref)
+    return NULL;
+  return gli_open_file(fref->filename, fref->textmode, fmode, FALSE, rock);
+}
+
+strid_t glk_stream_open_file_uni(frefid_t fref, glui32 fmode, glui32 rock)
+{
+  if (!fref)
+    return NULL;
+  return gli_open_file(fref->filename, fref->textmode, fmode, TRUE, rock);
+}
+
+static strid_t gli_open_memory(void *buf, glui32 buflen, glui32 fmode,
+  int unicode, glui32 rock)
+{
+  strid_t str;
+
+  if (fmode != filemode_Read && fmode != filemode_Write
+    && fmode != filemode_ReadWrite)
+    return NULL;
+
+  str = gli_new_stream(strtype_Memory, (fmode != filemode_Write),
+    (fmode != filemode_Read), rock);
+  str->unicode = unicode;
+  if (buf && buflen) {
+    if (unicode)
+      str->ubuf = (glui32 *)buf;
+    else
+      str->buf = (char *)buf;
+    str->buflen = buflen;
+    if (fmode != filemode_Write)
+      str->bufeof = buflen;
+    if (gli_register_arr) {
+      str->arrayrock = (*gli_register_arr)(buf, buflen,
+        (unicode ? "&+#!Iu" : "&+#!Cn"));
+    }
+  }
+  return str;
+}
+
+strid_t glk_stream_open_memory(char *buf, glui32 buflen, glui32 fmode,
+  glui32 rock)
+{
+  return gli_open_memory(buf, buflen, fmode, FALSE, rock);
+}
+
+strid_t glk_stream_open_memory_uni(glui32 *buf, glui32 buflen, glui32 fmode,
+  glui32 rock)
+{
+  return gli_open_memory(buf, buflen, fmode, TRUE, rock);
+}
+
+strid_t glkunix_stream_open_pathname_gen(char *pathname, glui32 writemode,
+  glui32 textmode, glui32 rock)
+{
+  return gli_open_file(pathname, textmode,
+    (writemode ? filemode_Write : filemode_Read), FALSE, rock);
+}
+
+strid_t glkunix_stream_open_pathname(char *pathname, glui32 textmode,
+  glui32 rock)
+{
+  return gli_open_file(pathname, textmode, filemode_Read, FALSE, rock);
+}
+
+void glk_stream_close(strid_t str, stream_result_t *result)
+{
+  if (!str)
+    return;
+  if (str->type == strtype_Window)
+    return; /* Window streams are closed with their window. */
+  if (result) {
+    result->readcount = str->readcount;
+    result->writecount = str->writecount;
+  }
+  gli_delete_stream(str);
+}
+
+strid_t glk_stream_iterate(strid_t str, glui32 *rockptr)
+{
+  str = (str ? str->next : streamlist);
+  if (rockptr)
+    *rockptr = (str ? str->rock : 0);
+  return str;
+}
+
+glui32 glk_stream_get_rock(strid_t str)
+{
+  return (str ? str->rock : 0);
+}
+
+void glk_stream_set_position(strid_t str, glsi32 pos, glui32 seekmode)
+{
+  if (!str)
+    return;
+
+  switch (str->type) {
+    case strtype_Memory:
+      if (seekmode == seekmode_Current)
+        pos = str->bufpos + pos;
+      else if (seekmode == seekmode_End)
+        pos = str->bufeof + pos;
+      if (pos < 0)
+        pos = 0;
+      if (pos > str->bufeof)
+        pos = str->bufeof;
+      str->bufpos = pos;
+      break;
+    case strtype_File:
+      if (str->unicode && !str->textmode)
+        pos *= 4;
+      fseek(str->file, pos,
+        (seekmode == seekmode_Current) ? SEEK_CUR :
+        ((seekmode == seekmode_End) ? SEEK_END : SEEK_SET));
+      str->lastop = 0;
+      break;
+  }
+}
+
+glui32 glk_stream_get_position(strid_t str)
+{
+  if (!str)
+    return 0;
+
+  switch (str->type) {
+    case strtype_Memory:
+      return str->bufpos;
+    case strtype_File:
+      if (str->unicode && !str->textmode)
+        return (glui32)ftell(str->file) / 4;
+      return (glui32)ftell(str->file);
+    default:
+      return 0;
+  }
+}
+
+void glk_stream_set_current(strid_t str)
+{
+  currentstr = str;
+}
+
+strid_t glk_stream_get_current()
+{
+  return currentstr;
+}
+
+static void gli_file_prepare(strid_t str, int op)
+{
+  /* C stdio requires a seek between reading and writing. */
+  if (str->lastop != 0 && str->lastop != op)
+    fseek(str->file, 0, SEEK_CUR);
+  str->lastop = op;
+}
+
+static void gli_put_utf8(FILE *fl, glui32 ch)
+{
+  if (ch < 0x80) {
+    putc(ch, fl);
+  }
+  else if (ch < 0x800) {
+    putc(0xC0 | (ch >> 6), fl);
+    putc(0x80 | (ch & 0x3F), fl);
+  }
+  else if (ch < 0x10000) {
+    putc(0xE0 | (ch >> 12), fl);
+    putc(0x80 | ((ch >> 6) & 0x3F), fl);
+    putc(0x80 | (ch & 0x3F), fl);
+  }
+  else {
+    putc(0xF0 | (ch >> 18), fl);
+    putc(0x80 | ((ch >> 12) & 0x3F), fl);
+    putc(0x80 | ((ch >> 6) & 0x3F), fl);
+    putc(0x80 | (ch & 0x3F), fl);
+  }
+}
+
+static glsi32 gli_get_utf8(FILE *fl)
+{
+  int ch, ch2;
+  glui32 res;
+  int count, ix;
+
+  ch = getc(fl);
+  if (ch == EOF)
+    return -1;
+  if (ch < 0x80)
+    return ch;
+  if ((ch & 0xE0) == 0xC0) {
+    res = ch & 0x1F;
+    count = 1;
+  }
+  else if ((ch & 0xF0) == 0xE0) {
+    res = ch & 0x0F;
+    count = 2;
+  }
+  else if ((ch & 0xF8) == 0xF0) {
+    res = ch & 0x07;
+    count = 3;
+  }
+  else {
+    return '?';
+  }
+  for (ix=0; ix<count; ix++) {
+    ch2 = getc(fl);
+    if (ch2 == EOF)
+      return -1;
+    res = (res << 6) | (ch2 & 0x3F);
+  }
+  return res;
+}
+
+static void gli_echo_char(glui32 ch)
+{
+  if (pref_echo)
+    gli_put_utf8(stdout, ch);
+}
+
+static void gli_put_char(strid_t str, glui32 ch)
+{
+  if (!str || !str->writable)
+    return;
+
+  str->writecount++;
+
+  switch (str->type) {
+    case strtype_Window:
+      count_output++;
+      gli_echo_char(ch);
+      if (str->win && str->win->echostr)
+        gli_put_char(str->win->echostr, ch);
+      break;
+    case strtype_Memory:
+      if (str->bufpos < str->buflen) {
+        if (str->unicode)
+          str->ubuf[str->bufpos] = ch;
+        else
+          str->buf[str->bufpos] = (ch < 0x100) ? ch : '?';
+        str->bufpos++;
+        if (str->bufpos > str->bufeof)
+          str->bufeof = str->bufpos;
+      }
+      break;
+    case strtype_File:
+      gli_file_prepare(str, filemode_Write);
+      if (!str->unicode) {
+        putc((ch < 0x100) ? ch : '?', str->file);
+      }
+      else if (str->textmode) {
+        gli_put_utf8(str->file, ch);
+      }
+      else {
+        putc((ch >> 24) & 0xFF, str->file);
+        putc((ch >> 16) & 0xFF, str->file);
+        putc((ch >> 8) & 0xFF, str->file);
+        putc(ch & 0xFF, str->file);
+      }
+      break;
+  }
+}
+
+static glsi32 gli_get_char(strid_t str)
+{
+  glsi32 ch;
+  int ix, byte;
+
+  if (!str || !str->readable)
+    return -1;
+
+  switch (str->type) {
+    case strtype_Memory:
+      if (str->bufpos >= str->bufeof)
+        return -1;
+      if (str->unicode)
+        ch = str->ubuf[str->bufpos];
+      else
+        ch = (unsigned char)str->buf[str->bufpos];
+      str->bufpos++;
+      str->readcount++;
+      return ch;
+    case strtype_File:
+      gli_file_prepare(str, filemode_Read);
+      if (!str->unicode) {
+        ch = getc(str->file);
+        if (ch == EOF)
+          return -1;
+      }
+      else if (str->textmode) {
+        ch = gli_get_utf8(str->file);
+        if (ch == -1)
+          return -1;
+      }
+      else {
+        ch = 0;
+        for (ix=0; ix<4; ix++) {
+          byte = getc(str->file);
+          if (byte == EOF)
+            return -1;
+          ch = (ch << 8) | (byte & 0xFF);
+        }
+      }
+      str->readcount++;
+      return ch;
+    default:
+      return -1;
+  }
+}
+
+void glk_put_char(unsigned char ch)
+{
+  gli_put_char(currentstr, ch);
+}
+
+void glk_put_char_stream(strid_t str, unsigned char ch)
+{
+  gli_put_char(str, ch);
+}
+
+void glk_put_string(char *s)
+{
+  glk_put_string_stream(currentstr, s);
+}
+
+void glk_put_string_stream(strid_t str, char *s)
+{
+  for (; *s; s++)
+    gli_put_char(str, (unsigned char)*s);
+}
+
+void glk_put_buffer(char *buf, glui32 len)
+{
+  glk_put_buffer_stream(currentstr, buf, len);
+}
+
+void glk_put_buffer_stream(strid_t str, char *buf, glui32 len)
+{
+  glui32 ix;
+  for (ix=0; ix<len; ix++)
+    gli_put_char(str, (unsigned char)buf[ix]);
+}
+
+void glk_put_char_uni(glui32 ch)
+{
+  gli_put_char(currentstr, ch);
+}
+
+void glk_put_char_stream_uni(strid_t str, glui32 ch)
+{
+  gli_put_char(str, ch);
+}
+
+void glk_put_string_uni(glui32 *s)
+{
+  glk_put_string_stream_uni(currentstr, s);
+}
+
+void glk_put_string_stream_uni(strid_t str, glui32 *s)
+{
+  for (; *s; s++)
+    gli_put_char(str, *s);
+}
+
+void glk_put_buffer_uni(glui32 *buf, glui32 len)
+{
+  glk_put_buffer_stream_uni(currentstr, buf, len);
+}
+
+void glk_put_buffer_stream_uni(strid_t str, glui32 *buf, glui32 len)
+{
+  glui32 ix;
+  for (ix=0; ix<len; ix++)
+    gli_put_char(str, buf[ix]);
+}
+
+void glk_set_style(glui32 styl)
+{
+}
+
+void glk_set_style_stream(strid_t str, glui32 styl)
+{
+}
+
+glsi32 glk_get_char_stream(strid_t str)
+{
+  glsi32 ch = gli_get_char(str);
+  if (ch >= 0x100)
+    return '?';
+  return ch;
+}
+
+glsi32 glk_get_char_stream_uni(strid_t str)
+{
+  return gli_get_char(str);
+}
+
+glui32 glk_get_buffer_stream(strid_t str, char *buf, glui32 len)
+{
+  glui32 ix;
+  glsi32 ch;
+
+  if (str && str->type == strtype_File && !str->unicode) {
+    /* The common case, and the one that game loading relies on. */
+    if (!str->readable)
+      return 0;
+    gli_file_prepare(str, filemode_Read);
+    ix = fread(buf, 1, len, str->file);
+    str->readcount += ix;
+    return ix;
+  }
+
+  for (ix=0; ix<len; ix++) {
+    ch = gli_get_char(str);
+    if (ch == -1)
+      break;
+    buf[ix] = (ch < 0x100) ? ch : '?';
+  }
+  return ix;
+}
+
+glui32 glk_get_buffer_stream_uni(strid_t str, glui32 *buf, glui32 len)
+{
+  glui32 ix;
+  glsi32 ch;
+
+  for (ix=0; ix<len; ix++) {
+    ch = gli_get_char(str);
+    if (ch == -1)
+      break;
+    buf[ix] = ch;
+  }
+  return ix;
+}
+
+glui32 glk_get_line_stream(strid_t str, char *buf, glui32 len)
+{
+  glui32 ix;
+  glsi32 ch;
+
+  if (!len)
+    return 0;
+  for (ix=0; ix<len-1; ) {
+    ch = gli_get_char(str);
+    if (ch == -1)
+      break;
+    buf[ix++] = (ch < 0x100) ? ch : '?';
+    if (ch == '\n')
+      break;
+  }
+  buf[ix] = '\0';
+  return ix;
+}
+
+glui32 glk_get_line_stream_uni(strid_t str, glui32 *buf, glui32 len)
+{
+  glui32 ix;
+  glsi32 ch;
+
+  if (!len)
+    return 0;
+  for (ix=0; ix<len-1; ) {
+    ch = gli_get_char(str);
+    if (ch == -1)
+      break;
+    buf[ix++] = ch;
+    if (ch == '\n')
+      break;
+  }
+  buf[ix] = 0;
+  return ix;
+}
+
+void glk_stylehint_set(glui32 wintype, glui32 styl, glui32 hint, glsi32 val)
+{
+}
+
+void glk_stylehint_clear(glui32 wintype, glui32 styl, glui32 hint)
+{
+}
+
+glui32 glk_style_distinguish(winid_t win, glui32 styl1, glui32 styl2)
+{
+  return FALSE;
+}
+
+glui32 glk_style_measure(winid_t win, glui32 styl, glui32 hint,
+  glui32 *result)
+{
+  return FALSE;
+}
+
+/* File references. */
+
+static frefid_t gli_new_fileref(char *filename, glui32 usage, glui32 rock)
+{
+  frefid_t fref;
+  char *name;
+  size_t len;
+
+  if (basedir && filename[0] != '/') {
+    len = strlen(basedir) + strlen(filename) + 2;
+    name = (char *)malloc(len);
+    if (name)
+      sprintf(name, "%s/%s", basedir, filename);
+  }
+  else {
+    name = (char *)malloc(strlen(filename) + 1);
+    if (name)
+      strcpy(name, filename);
+  }
+  fref = (frefid_t)malloc(sizeof(struct glk_fileref_struct));
+  if (!fref || !name)
+    gli_fatal("Unable to allocate file reference.");
+  fref->filename = name;
+  fref->rock = rock;
+  fref->textmode = ((usage & fileusage_TextMode) != 0);
+
+  fref->prev = NULL;
+  fref->next = filereflist;
+  filereflist = fref;
+  if (fref->next)
+    fref->next->prev = fref;
+
+  if (gli_register_obj)
+    fref->disprock = (*gli_register_obj)(fref, gidisp_Class_Fileref);
+  return fref;
+}
+
+frefid_t glk_fileref_create_temp(glui32 usage, glui32 rock)
+{
+  char buf[64];
+  sprintf(buf, "/tmp/nullglk-%ld-%lu", (long)getpid(),
+    (unsigned long)count_tempfiles++);
+  return gli_new_fileref(buf, usage, rock);
+}
+
+frefid_t glk_fileref_create_by_name(glui32 usage, char *name, glui32 rock)
+{
+  char buf[256];
+  int ix, jx;
+
+  /* Strip out characters that don't belong in a filename, the way
+     the Glk spec recommends. */
+  for (ix=0, jx=0; name[ix] && jx < 240; ix++) {
+    char ch = name[ix];
+    if (ch == '/' || ch == '\\' || ch == ':' || ch == '"' || ch == '<'
+      || ch == '>' || ch == '|' || ch == '?' || ch == '*')
+      continue;
+    buf[jx++] = ch;
+  }
+  buf[jx] = '\0';
+  if (!jx)
+    strcpy(buf, "null");
+  return gli_new_fileref(buf, usage, rock);
+}
+
+frefid_t glk_fileref_create_by_prompt(glui32 usage, glui32 fmode,
+  glui32 rock)
+{
+  /* The "prompt" is answered by the next script line. An empty line
+     cancels. */
+  char *line = gli_read_script_line();
+  if (!line || !line[0])
+    return NULL;
+  return gli_new_fileref(line, usage, rock);
+}
+
+frefid_t glk_fileref_create_from_fileref(glui32 usage, frefid_t fref,
+  glui32 rock)
+{
+  frefid_t newfref;
+  if (!fref)
+    return NULL;
+  newfref = gli_new_fileref(fref->filename, usage, rock);
+  return newfref;
+}
+
+void glk_fileref_destroy(frefid_t fref)
+{
+  frefid_t prev, next;
+
+  if (!fref)
+    return;
+  if (gli_unregister_obj)
+    (*gli_unregister_obj)(fref, gidisp_Class_Fileref, fref->disprock);
+
+  prev = fref->prev;
+  next = fref->next;
+  if (prev)
+    prev->next = next;
+  else
+    filereflist = next;
+  if (next)
+    next->prev = prev;
+  free(fref->filename);
+  free(fref);
+}
+
+frefid_t glk_fileref_iterate(frefid_t fref, glui32 *rockptr)
+{
+  fref = (fref ? fref->next : filereflist);
+  if (rockptr)
+    *rockptr = (fref ? fref->rock : 0);
+  return fref;
+}
+
+glui32 glk_fileref_get_rock(frefid_t fref)
+{
+  return (fref ? fref->rock : 0);
+}
+
+void glk_fileref_delete_file(frefid_t fref)
+{
+  if (fref)
+    remove(fref->filename);
+}
+
+glui32 glk_fileref_does_file_exist(frefid_t fref)
+{
+  FILE *fl;
+  if (!fref)
+    return FALSE;
+  fl = fopen(fref->filename, "rb");
+  if (!fl)
+    return FALSE;
+  fclose(fl);
+  return TRUE;
+}
+
+void glkunix_set_base_file(char *filename)
+{
+  char *slash;
+  size_t len;
+
+  slash = strrchr(filename, '/');
+  if (!slash)
+    return;
+  len = slash - filename;
+  basedir = (char *)malloc(len + 1);
+  if (!basedir)
+    return;
+  memcpy(basedir, filename, len);
+  basedir[len] = '\0';
+}
+
+/* Events. Input comes from the script file. */
+
+static char *gli_read_script_line()
+{
+  static char linebuf[1024];
+  size_t len;
+
+  if (!scriptfile)
+    return NULL;
+  if (!fgets(linebuf, sizeof(linebuf), scriptfile))
+    return NULL;
+  len = strlen(linebuf);
+  while (len && (linebuf[len-1] == '\n' || linebuf[len-1] == '\r'))
+    linebuf[--len] = '\0';
+  return linebuf;
+}
+
+static glui32 gli_decode_utf8(char *src, glui32 *dest, glui32 maxlen)
+{
+  unsigned char *pos = (unsigned char *)src;
+  glui32 count = 0;
+  glui32 ch;
+
+  while (*pos && count < maxlen) {
+    ch = *pos++;
+    if (ch >= 0xC0 && ch < 0xE0 && (pos[0] & 0xC0) == 0x80) {
+      ch = ((ch & 0x1F) << 6) | (pos[0] & 0x3F);
+      pos += 1;
+    }
+    else if (ch >= 0xE0 && ch < 0xF0 && (pos[0] & 0xC0) == 0x80
+      && (pos[1] & 0xC0) == 0x80) {
+      ch = ((ch & 0x0F) << 12) | ((pos[0] & 0x3F) << 6) | (pos[1] & 0x3F);
+      pos += 2;
+    }
+    else if (ch >= 0xF0 && (pos[0] & 0xC0) == 0x80
+      && (pos[1] & 0xC0) == 0x80 && (pos[2] & 0xC0) == 0x80) {
+      ch = ((ch & 0x07) << 18) | ((pos[0] & 0x3F) << 12)
+        | ((pos[1] & 0x3F) << 6) | (pos[2] & 0x3F);
+      pos += 3;
+    }
+    dest[count++] = ch;
+  }
+  return count;
+}
+
+static void gli_event_clear(event_t *event)
+{
+  event->type = evtype_None;
+  event->win = NULL;
+  event->val1 = 0;
+  event->val2 = 0;
+}
+
+static void gli_end_line_input(winid_t win, glui32 len)
+{
+  glui32 ix;
+
+  if (pref_echo) {
+    if (win->line_request_uni) {
+      glui32 *ubuf = (glui32 *)win->inbuf;
+      for (ix=0; ix<len; ix++)
+        gli_echo_char(ubuf[ix]);
+    }
+    else {
+      char *buf = (char *)win->inbuf;
+      for (ix=0; ix<len; ix++)
+        gli_echo_char((unsigned char)buf[ix]);
+    }
+    gli_echo_char('\n');
+  }
+
+  if (gli_unregister_arr) {
+    (*gli_unregister_arr)(win->inbuf, win->inmax,
+      (win->line_request_uni ? "&+#!Iu" : "&+#!Cn"), win->inarrayrock);
+  }
+  win->line_request = FALSE;
+  win->line_request_uni = FALSE;
+  win->inbuf = NULL;
+  win->inmax = 0;
+}
+
+void glk_select(event_t *event)
+{
+  winid_t win;
+  char *line;
+  glui32 len, ix;
+
+  gli_event_clear(event);
+
+  for (win = windowlist; win; win = win->next) {
+    if (win->line_request)
+      break;
+  }
+  if (!win) {
+    for (win = windowlist; win; win = win->next) {
+      if (win->char_request)
+        break;
+    }
+  }
+
+  if (!win) {
+    if (timer_interval) {
+      event->type = evtype_Timer;
+      return;
+    }
+    /* Nothing can ever happen. */
+    glk_exit();
+  }
+
+  line = gli_read_script_line();
+  if (!line)
+    glk_exit();
+  count_inputs++;
+
+  if (win->line_request) {
+    if (win->line_request_uni) {
+      len = gli_decode_utf8(line, (glui32 *)win->inbuf, win->inmax);
+    }
+    else {
+      glui32 ubuf[1024];
+      char *buf = (char *)win->inbuf;
+      len = gli_decode_utf8(line, ubuf, 1024);
+      if (len > win->inmax)
+        len = win->inmax;
+      for (ix=0; ix<len; ix++)
+        buf[ix] = (ubuf[ix] < 0x100) ? ubuf[ix] : '?';
+    }
+    gli_end_line_input(win, len);
+    event->type = evtype_LineInput;
+    event->win = win;
+    event->val1 = len;
+    return;
+  }
+
+  /* Character input takes the first character of the line, or Return
+     for an empty line. */
+  if (line[0]) {
+    glui32 ch;
+    gli_decode_utf8(line, &ch, 1);
+    if (!win->char_request_uni && ch >= 0x100)
+      ch = '?';
+    event->val1 = ch;
+  }
+  else {
+    event->val1 = keycode_Return;
+  }
+  win->char_request = FALSE;
+  win->char_request_uni = FALSE;
+  event->type = evtype_CharInput;
+  event->win = win;
+}
+
+void glk_select_poll(event_t *event)
+{
+  gli_event_clear(event);
+}
+
+void glk_request_timer_events(glui32 millisecs)
+{
+  timer_interval = millisecs;
+}
+
+void glk_request_line_event(winid_t win, char *buf, glui32 maxlen,
+  glui32 initlen)
+{
+  if (!win || win->line_request || win->char_request)
+    return;
+  win->line_request = TRUE;
+  win->line_request_uni = FALSE;
+  win->inbuf = buf;
+  win->inmax = maxlen;
+  if (gli_register_arr)
+    win->inarrayrock = (*gli_register_arr)(buf, maxlen, "&+#!Cn");
+}
+
+void glk_request_line_event_uni(winid_t win, glui32 *buf, glui32 maxlen,
+  glui32 initlen)
+{
+  if (!win || win->line_request || win->char_request)
+    return;
+  win->line_request = TRUE;
+  win->line_request_uni = TRUE;
+  win->inbuf = buf;
+  win->inmax = maxlen;
+  if (gli_register_arr)
+    win->inarrayrock = (*gli_register_arr)(buf, maxlen, "&+#!Iu");
+}
+
+void glk_request_char_event(winid_t win)
+{
+  if (!win || win->line_request || win->char_request)
+    return;
+  win->char_request = TRUE;
+  win->char_request_uni = FALSE;
+}
+
+void glk_request_char_event_uni(winid_t win)
+{
+  if (!win || win->line_request || win->char_request)
+    return;
+  win->char_request = TRUE;
+  win->char_request_uni = TRUE;
+}
+
+void glk_request_mouse_event(winid_t win)
+{
+}
+
+void glk_cancel_line_event(winid_t win, event_t *event)
+{
+  event_t dummy;
+  if (!event)
+    event = &dummy;
+  gli_event_clear(event);
+  if (!win || !win->line_request)
+    return;
+  gli_end_line_input(win, 0);
+  event->type = evtype_LineInput;
+  event->win = win;
+}
+
+void glk_cancel_char_event(winid_t win)
+{
+  if (win) {
+    win->char_request = FALSE;
+    win->char_request_uni = FALSE;
+  }
+}
+
+void glk_cancel_mouse_event(winid_t win)
+{
+}
+
+/* Unicode case conversion. Only Latin-1 letters are handled; anything
+   else passes through unchanged. */
+
+glui32 glk_buffer_to_lower_case_uni(glui32 *buf, glui32 len,
+  glui32 numchars)
+{
+  glui32 ix;
+  if (numchars > len)
+    numchars = len;
+  for (ix=0; ix<numchars; ix++) {
+    if (buf[ix] < 0x100)
+      buf[ix] = glk_char_to_lower(buf[ix]);
+  }
+  return numchars;
+}
+
+glui32 glk_buffer_to_upper_case_uni(glui32 *buf, glui32 len,
+  glui32 numchars)
+{
+  glui32 ix;
+  if (numchars > len)
+    numchars = len;
+  for (ix=0; ix<numchars; ix++) {
+    if (buf[ix] < 0x100)
+      buf[ix] = glk_char_to_upper(buf[ix]);
+  }
+  return numchars;
+}
+
+glui32 glk_buffer_to_title_case_uni(glui32 *buf, glui32 len,
+  glui32 numchars, glui32 lowerrest)
+{
+  if (numchars > len)
+    numchars = len;
+  if (lowerrest)
+    glk_buffer_to_lower_case_uni(buf, len, numchars);
+  if (numchars && buf[0] < 0x100)
+    buf[0] = glk_char_to_upper(buf[0]);
+  return numchars;
+}
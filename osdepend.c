@@ -7,8 +7,8 @@
 #include "glulxe.h"
 
 /* This file contains definitions for platform-dependent code. Since
-   Glk takes care of I/O, this is a short list -- memory allocation
-   and random numbers.
+   Glk takes care of I/O, this is a short list -- memory allocation,
+   random numbers, and a clock for timing.
 
    The Makefile (or whatever) should define OS_UNIX, or some other
    symbol. Code contributions welcome. 
@@ -217,6 +217,61 @@ static glui32 msc_random()
 
 #endif /* OS_WINDOWS */
 
+/* glulx_microseconds():
+   Read a monotonic clock, in microseconds, for timing short operations.
+   The value wraps around every 71 minutes or so; only the difference
+   between two readings is meaningful.
+*/
+#if defined(OS_UNIX) || defined(OS_MAC)
+
+#include <time.h>
+#include <sys/time.h>
+
+glui32 glulx_microseconds()
+{
+  struct timeval tv;
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+    return (glui32)ts.tv_sec * 1000000 + (glui32)(ts.tv_nsec / 1000);
+#endif /* CLOCK_MONOTONIC */
+  /* gettimeofday() isn't monotonic, but it's the best we have. */
+  gettimeofday(&tv, NULL);
+  return (glui32)tv.tv_sec * 1000000 + (glui32)tv.tv_usec;
+}
+
+#elif defined(OS_WINDOWS)
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+glui32 glulx_microseconds()
+{
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER count;
+
+  if (!freq.QuadPart)
+    QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&count);
+  /* Split the division, so that the multiplication can't overflow. */
+  return (glui32)((count.QuadPart / freq.QuadPart) * 1000000
+    + (count.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart);
+}
+
+#else /* OS_UNIX || OS_MAC || OS_WINDOWS */
+
+#include <time.h>
+
+glui32 glulx_microseconds()
+{
+  /* This is a last resort: it only ticks once a second, so most short
+     operations will time as zero. (clock() is no better, since it
+     counts processor time, and stops while we wait for input.) */
+  return (glui32)time(NULL) * 1000000;
+}
+
+#endif /* OS_UNIX || OS_MAC || OS_WINDOWS */
+
 
 /* If no native RNG is defined above, use the xoshiro128** implementation. */
 #ifndef RAND_SET_SEED
@@ -226,10 +281,19 @@ static glui32 msc_random()
 
 static int rand_use_native = TRUE;
 
+/* If this is set (when recording or replaying Glk events), the native
+   RNG is never used. A seed of 0 reseeds the xoshiro128** RNG from its
+   own output instead, so that the numbers come out the same on every
+   run. */
+int rand_always_seeded = FALSE;
+
 /* Set the random-number seed, and also select which RNG to use.
 */
 void glulx_setrandom(glui32 seed)
 {
+    if (seed == 0 && rand_always_seeded) {
+        seed = xo_random() | 1;
+    }
     if (seed == 0) {
         rand_use_native = TRUE;
         RAND_SET_SEED();
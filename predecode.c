@@ -0,0 +1,501 @@
+/* predecode.c: Glulxe code for decoding strings in the background.
+    Designed by Andrew Plotkin <erkyrath@eblong.com>
+    http://eblong.com/zarf/glulx/index.html
+*/
+
+#include "glk.h"
+#include "glulxe.h"
+
+#if STRING_PREDECODE
+
+/*
+When the "--predecode" option is given, predecode_start() makes a copy
+of ROM and hands it to a worker thread. The worker walks the copy the
+way glulxdump does -- skipping functions and uncompressed strings --
+and decodes each compressed string it finds, using the string table
+that was current at startup. The results go into a hash table, which
+is handed back once the whole walk is done.
+
+The worker never touches the interpreter's memory map or its decoding
+cache, so the VM can start running at once. Until the index is ready,
+string.c carries on decoding strings itself; once it's ready,
+predecode_find() takes it over and the worker exits. Only the VM
+thread ever looks at the finished index, so it needs no locking. If
+the game quits while the worker is still walking, predecode_stop()
+tells it to give up, and waits for it.
+
+Since ROM can't change, the index stays good for the whole run. It's
+only consulted while the game is using the startup string table; if
+the game switches tables, strings are decoded the ordinary way. A
+string which runs past the end of ROM, or whose table doesn't lie
+entirely in ROM, is never predecoded.
+
+The walk may mistake some other data for a compressed string. That
+does no harm: a predecoded string is only looked up when the game
+prints a string at that address, which a real one has.
+*/
+
+#include <pthread.h>
+
+#define PREDECODE_HASHSIZE (4096)
+#define PREDECODE_HASH(addr) (((glui32)(addr) * 0x9E3779B1) >> 20)
+
+/* Strings longer than this are left alone. */
+#define PREDECODE_MAXLEN (0x10000)
+
+int predecode_enabled = FALSE;
+
+/* The VM thread's view. */
+static int predecode_running = FALSE;
+static predecoded_t **predecode_index = NULL;
+static glui32 predecode_table = 0;
+
+/* Shared with the worker. The worker owns everything else below until
+   it sets predecode_published (under predecode_lock); after that, it
+   touches nothing. The VM thread sets predecode_stopping (also under
+   the lock) to make the worker give up early. */
+static pthread_t predecode_thread;
+static pthread_mutex_t predecode_lock = PTHREAD_MUTEX_INITIALIZER;
+static int predecode_published = FALSE;
+static int predecode_stopping = FALSE;
+
+/* How many objects the worker walks between checks of
+   predecode_stopping. */
+#define PREDECODE_STOPCHECK (1024)
+
+/* The worker's state. */
+static unsigned char *rom = NULL;
+static glui32 romlen = 0;
+static predecoded_t **workindex = NULL;
+static glui32 *workbuf = NULL;
+static glui32 workbufsize = 0;
+
+#define Rom1(addr) (rom[addr])
+#define Rom4(addr)  \
+  (((glui32)rom[addr] << 24) | ((glui32)rom[(addr)+1] << 16)  \
+    | ((glui32)rom[(addr)+2] << 8) | (glui32)rom[(addr)+3])
+
+static void *predecode_worker(void *arg);
+static int worker_stopping(void);
+static glui32 skip_function(glui32 pos);
+static int decode_string(glui32 addr);
+static int workbuf_addchar(glui32 *lenp, glui32 ch);
+static void free_index(predecoded_t **index);
+
+/* predecode_start():
+   Begin decoding strings in the background, if the "--predecode" option
+   was given and the string table is in ROM. This is called once, when
+   the game is loaded.
+*/
+void predecode_start()
+{
+  glui32 ix;
+
+  if (!predecode_enabled || predecode_running || predecode_index)
+    return;
+
+  if (!stringtable || stringtable+12 > ramstart
+    || Mem4(stringtable) > ramstart - stringtable)
+    return;
+
+  rom = (unsigned char *)glulx_malloc(ramstart);
+  if (!rom)
+    return;
+  for (ix=0; ix<ramstart; ix++)
+    rom[ix] = memmap[ix];
+  romlen = ramstart;
+  predecode_table = stringtable;
+
+  predecode_published = FALSE;
+  predecode_stopping = FALSE;
+  if (pthread_create(&predecode_thread, NULL, predecode_worker, NULL)) {
+    glulx_free(rom);
+    rom = NULL;
+    return;
+  }
+  predecode_running = TRUE;
+}
+
+/* predecode_find():
+   Look up the compressed string at addr (the first byte after the E1)
+   in the predecoded index. Returns NULL if the index isn't ready yet,
+   or doesn't apply, or doesn't have that string.
+*/
+predecoded_t *predecode_find(glui32 addr)
+{
+  predecoded_t *pre;
+  int ready;
+
+  if (!predecode_index) {
+    if (!predecode_running)
+      return NULL;
+
+    pthread_mutex_lock(&predecode_lock);
+    ready = predecode_published;
+    pthread_mutex_unlock(&predecode_lock);
+    if (!ready)
+      return NULL;
+
+    /* The worker is finished; take over its results. */
+    pthread_join(predecode_thread, NULL);
+    predecode_running = FALSE;
+    predecode_index = workindex;
+    workindex = NULL;
+    if (!predecode_index)
+      return NULL;
+  }
+
+  if (stringtable != predecode_table)
+    return NULL;
+
+  for (pre = predecode_index[PREDECODE_HASH(addr)]; pre; pre = pre->hashnext) {
+    if (pre->addr == addr)
+      return pre;
+  }
+  return NULL;
+}
+
+/* predecode_stop():
+   Shut down the worker, if it's still running, and throw away the
+   index. This is called when the VM shuts down.
+*/
+void predecode_stop()
+{
+  if (predecode_running) {
+    pthread_mutex_lock(&predecode_lock);
+    predecode_stopping = TRUE;
+    pthread_mutex_unlock(&predecode_lock);
+    pthread_join(predecode_thread, NULL);
+    predecode_running = FALSE;
+    if (workindex) {
+      free_index(workindex);
+      workindex = NULL;
+    }
+  }
+
+  if (predecode_index) {
+    free_index(predecode_index);
+    predecode_index = NULL;
+  }
+}
+
+/* predecode_worker():
+   The body of the worker thread. Walk the copy of ROM, decode every
+   compressed string, and publish the index. If memory runs out (or the
+   VM is shutting down), the index is simply dropped.
+*/
+static void *predecode_worker(void *arg)
+{
+  glui32 pos;
+  int ch, ix;
+  int count = 0;
+
+  workindex = (predecoded_t **)glulx_malloc(PREDECODE_HASHSIZE
+    * sizeof(predecoded_t *));
+  if (workindex) {
+    for (ix=0; ix<PREDECODE_HASHSIZE; ix++)
+      workindex[ix] = NULL;
+  }
+
+  pos = 36; /* skip the header */
+  while (workindex && pos < romlen) {
+    count++;
+    if (count >= PREDECODE_STOPCHECK) {
+      count = 0;
+      if (worker_stopping()) {
+        free_index(workindex);
+        workindex = NULL;
+        break;
+      }
+    }
+
+    ch = Rom1(pos);
+
+    if (ch == 0xE0) {
+      for (pos++; pos < romlen && Rom1(pos); pos++) { };
+      pos++;
+      continue;
+    }
+    if (ch == 0xE2) {
+      for (pos += 4; pos+4 <= romlen && Rom4(pos); pos += 4) { };
+      pos += 4;
+      continue;
+    }
+    if (ch == 0xC0 || ch == 0xC1) {
+      pos = skip_function(pos);
+      continue;
+    }
+    if (ch == 0xE1) {
+      if (!decode_string(pos+1)) {
+        free_index(workindex);
+        workindex = NULL;
+        break;
+      }
+    }
+    pos++;
+  }
+
+  glulx_free(workbuf);
+  workbuf = NULL;
+  workbufsize = 0;
+  glulx_free(rom);
+  rom = NULL;
+
+  pthread_mutex_lock(&predecode_lock);
+  predecode_published = TRUE;
+  pthread_mutex_unlock(&predecode_lock);
+  return NULL;
+}
+
+/* worker_stopping():
+   Check whether the VM thread has asked the worker to give up.
+*/
+static int worker_stopping()
+{
+  int res;
+
+  pthread_mutex_lock(&predecode_lock);
+  res = predecode_stopping;
+  pthread_mutex_unlock(&predecode_lock);
+  return res;
+}
+
+/* skip_function():
+   Step over the function that starts at pos, stopping at the first
+   byte that looks like the start of another object (or at anything
+   that doesn't parse as an instruction). Returns the new position.
+*/
+static glui32 skip_function(glui32 pos)
+{
+  glui32 opcode, modepos;
+  const operandlist_t *oplist;
+  int ch, ix, mode;
+
+  pos++;
+  /* The local-format list. */
+  while (1) {
+    if (pos+2 > romlen)
+      return romlen;
+    ch = Rom1(pos);
+    pos += 2;
+    if (ch == 0)
+      break;
+  }
+
+  while (pos < romlen) {
+    ch = Rom1(pos);
+    if (ch == 0xC0 || ch == 0xC1 || ch == 0xE0 || ch == 0xE1 || ch == 0xE2)
+      break;
+
+    if ((ch & 0x80) == 0) {
+      opcode = ch;
+      pos++;
+    }
+    else if ((ch & 0x40) == 0) {
+      if (pos+2 > romlen)
+        return romlen;
+      opcode = ((ch << 8) | Rom1(pos+1)) & 0x7FFF;
+      pos += 2;
+    }
+    else {
+      if (pos+4 > romlen)
+        return romlen;
+      opcode = Rom4(pos) & 0x0FFFFFFF;
+      pos += 4;
+    }
+
+    /* lookup_operandlist() only reads constant tables, so it's safe to
+       call from this thread. */
+    oplist = lookup_operandlist(opcode);
+    if (!oplist)
+      break;
+
+    /* Step over the addressing-mode bytes, and then the operands
+       they describe. */
+    modepos = pos;
+    pos += (oplist->num_ops+1)/2;
+    if (pos > romlen)
+      return romlen;
+    for (ix=0; ix<oplist->num_ops; ix++) {
+      mode = Rom1(modepos + ix/2);
+      if (ix & 1)
+        mode >>= 4;
+      mode &= 0x0F;
+      if (mode == 0x4 || mode == 0xC)
+        return pos; /* illegal */
+      if (mode != 0 && mode != 8)
+        pos += ((mode & 3) == 3) ? 4 : (mode & 3);
+    }
+  }
+
+  return pos;
+}
+
+/* decode_string():
+   Decode the compressed string at addr as far as its terminator or its
+   first indirect reference, and add it to the index. Strings which
+   can't be decoded from ROM are skipped. Returns FALSE only if memory
+   runs out.
+*/
+static int decode_string(glui32 addr)
+{
+  glui32 table = predecode_table;
+  glui32 root, node, pos, symaddr, len, ix, ch;
+  int bitnum, symbit, type, done, isuni;
+  predecoded_t *pre;
+
+  root = Rom4(table+8);
+  pos = addr;
+  bitnum = 0;
+  len = 0;
+  done = FALSE;
+
+  while (1) {
+    symaddr = pos;
+    symbit = bitnum;
+
+    /* Walk down the tree to a leaf. */
+    node = root;
+    if (node+1 > romlen)
+      return TRUE;
+    type = Rom1(node);
+    while (type == 0x00) {
+      if (pos >= romlen || node+9 > romlen)
+        return TRUE;
+      if (Rom1(pos) & (1 << bitnum))
+        node = Rom4(node+5);
+      else
+        node = Rom4(node+1);
+      bitnum++;
+      if (bitnum == 8) {
+        bitnum = 0;
+        pos++;
+      }
+      if (node >= romlen)
+        return TRUE;
+      type = Rom1(node);
+    }
+
+    if (type == 0x01) {
+      done = TRUE;
+      break;
+    }
+    if (type == 0x02) {
+      if (node+2 > romlen)
+        return TRUE;
+      if (!workbuf_addchar(&len, Rom1(node+1)))
+        return FALSE;
+    }
+    else if (type == 0x04) {
+      if (node+5 > romlen)
+        return TRUE;
+      if (!workbuf_addchar(&len, Rom4(node+1)))
+        return FALSE;
+    }
+    else if (type == 0x03) {
+      for (ix=node+1; ix < romlen && (ch=Rom1(ix)) != 0; ix++) {
+        if (!workbuf_addchar(&len, ch))
+          return FALSE;
+      }
+      if (ix >= romlen)
+        return TRUE;
+    }
+    else if (type == 0x05) {
+      for (ix=node+1; ix+4 <= romlen && (ch=Rom4(ix)) != 0; ix+=4) {
+        if (!workbuf_addchar(&len, ch))
+          return FALSE;
+      }
+      if (ix+4 > romlen)
+        return TRUE;
+    }
+    else {
+      /* An indirect reference (or something we don't recognize). Leave
+         it for the decoder. */
+      pos = symaddr;
+      bitnum = symbit;
+      break;
+    }
+
+    if (len > PREDECODE_MAXLEN)
+      return TRUE;
+  }
+
+  isuni = FALSE;
+  for (ix=0; ix<len; ix++) {
+    if (workbuf[ix] > 0xFF) {
+      isuni = TRUE;
+      break;
+    }
+  }
+
+  pre = (predecoded_t *)glulx_malloc(sizeof(predecoded_t));
+  if (!pre)
+    return FALSE;
+  pre->text = NULL;
+  if (len) {
+    pre->text = glulx_malloc(len * (isuni ? 4 : 1));
+    if (!pre->text) {
+      glulx_free(pre);
+      return FALSE;
+    }
+    if (isuni) {
+      for (ix=0; ix<len; ix++)
+        ((glui32 *)pre->text)[ix] = workbuf[ix];
+    }
+    else {
+      for (ix=0; ix<len; ix++)
+        ((char *)pre->text)[ix] = (char)workbuf[ix];
+    }
+  }
+  pre->addr = addr;
+  pre->resaddr = pos;
+  pre->resbit = bitnum;
+  pre->done = done;
+  pre->isuni = isuni;
+  pre->len = len;
+
+  pre->hashnext = workindex[PREDECODE_HASH(addr)];
+  workindex[PREDECODE_HASH(addr)] = pre;
+  return TRUE;
+}
+
+/* workbuf_addchar():
+   Append a character to the worker's scratch buffer. Returns FALSE if
+   memory runs out. (The worker can't call fatal_error().)
+*/
+static int workbuf_addchar(glui32 *lenp, glui32 ch)
+{
+  if (*lenp >= workbufsize) {
+    glui32 newsize = (workbufsize ? workbufsize*2 : 256);
+    glui32 *newbuf = (glui32 *)glulx_realloc(workbuf,
+      newsize * sizeof(glui32));
+    if (!newbuf)
+      return FALSE;
+    workbuf = newbuf;
+    workbufsize = newsize;
+  }
+  workbuf[*lenp] = ch;
+  (*lenp)++;
+  return TRUE;
+}
+
+/* free_index():
+   Throw away a partly-built index.
+*/
+static void free_index(predecoded_t **index)
+{
+  predecoded_t *pre, *next;
+  int ix;
+
+  for (ix=0; ix<PREDECODE_HASHSIZE; ix++) {
+    for (pre = index[ix]; pre; pre = next) {
+      next = pre->hashnext;
+      if (pre->text)
+        glulx_free(pre->text);
+      glulx_free(pre);
+    }
+  }
+  glulx_free(index);
+}
+
+#endif /* STRING_PREDECODE */
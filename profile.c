@@ -75,6 +75,43 @@ function generated by the compiler. Its total_time is the running time
 of the entire program; its total_ops is the number of opcodes executed
 by the entire program; its max_depth is zero.
 
+String profiling is separate. If you use the "--strprofile" option,
+the interpreter counts what happens while each string is printed, and
+writes another XML file at shutdown:
+
+<strprofile>
+  <string addr=HEX ... />
+  <string addr=HEX ... />
+  ...
+</strprofile>
+
+There is one string tag for every string the program printed, most
+characters first. Each includes the following attributes:
+
+  addr=HEX:          The VM address of the string (in hex).
+  type=HEX:          Its type byte: E0, E1, or E2.
+  call_count=INT:    The number of times the string was printed,
+    either directly or through an indirect reference.
+  chars=INT:         The number of characters it produced.
+  cache_hits=INT:    The number of decoding-cache lookups.
+  memo_hits=INT:     The number of times its text came straight from
+    the string memo (or the predecoded index).
+  tree_walks=INT:    The number of characters (or other nodes) decoded
+    by walking the string table from memory, because the cache was not
+    usable.
+  indirect_calls=INT: The number of indirect references (node types 08
+    through 0B) it followed.
+
+All of these count only the string's own work. The characters of a
+string printed through an indirect reference are charged to that
+string, not to the one that referred to it. (A C string inside the
+decoding table, node type 03 or 05, counts as part of the string that
+uses it; so does anything printed by a function that it calls.)
+
+Like the function profiler, this doesn't cope with @throw, @restore,
+or @restoreundo in the middle of printing a string; the counts after
+that may be charged to the wrong strings.
+
  */
 
 #include "glk.h"
@@ -83,6 +120,7 @@ by the entire program; its max_depth is zero.
 #if VM_PROFILING
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
 
@@ -139,6 +177,37 @@ static frame_t *current_frame = NULL;
    increments it. */
 glui32 profile_opcount = 0;
 
+/* Set if the --strprofile switch is used. */
+static strid_t strprofiling_stream = NULL;
+
+typedef struct strstat_struct {
+  glui32 addr;
+  int type;
+  glui32 call_count;
+  glui32 counts[profstr_Count];
+
+  struct strstat_struct *hash_next;
+} strstat_t;
+
+static strstat_t **strstats = NULL;
+static glui32 strstat_count = 0;
+
+/* The strings being printed, innermost last. */
+static strstat_t **strstack = NULL;
+static int strstack_depth = 0;
+static int strstack_size = 0;
+
+/* These counters are globally visible, because the profile_strcount()
+   macro increments them. They run all the time; whatever they've
+   gained since the last change of string is charged to the innermost
+   string. */
+glui32 profile_strcounts[profstr_Count];
+static glui32 strcounts_charged[profstr_Count];
+
+static void charge_strcounts(void);
+static int compare_strstats(const void *p1, const void *p2);
+static void profile_string_quit(void);
+
 /* This is called from the setup code -- glkunix_startup_code(), for the
    Unix version. If called, the interpreter will keep profiling information,
    and write it out at shutdown time. If this is not called, the interpreter
@@ -171,10 +240,29 @@ void setup_profile(strid_t stream, char *filename)
     profiling_filename = "profile-raw";
 }
 
+/* setup_string_profile():
+   Turn on string profiling, which will be written to stream at
+   shutdown time. Like setup_profile(), this is called from the setup
+   code.
+*/
+void setup_string_profile(strid_t stream)
+{
+  strprofiling_stream = stream;
+}
+
 int init_profile()
 {
   int bucknum;
 
+  if (strprofiling_stream) {
+    strstats = (strstat_t **)glulx_malloc(FUNC_HASH_SIZE
+      * sizeof(strstat_t *));
+    if (!strstats) 
+      return FALSE;
+    for (bucknum=0; bucknum<FUNC_HASH_SIZE; bucknum++) 
+      strstats[bucknum] = NULL;
+  }
+
   if (!profiling_active)
     return TRUE;
 
@@ -370,6 +458,153 @@ void profile_fail(char *reason)
   fatal_error_2("Profiler: unable to handle operation", reason);
 }
 
+/* profile_string_in():
+   A string is starting to print. addr is the string's address, or zero
+   if this is a C string from the decoding table, which is charged to
+   the string that's already printing.
+*/
+void profile_string_in(glui32 addr)
+{
+  int bucknum;
+  strstat_t *stat;
+
+  if (!strstats)
+    return;
+
+  charge_strcounts();
+
+  if (addr) {
+    bucknum = (addr % FUNC_HASH_SIZE);
+    for (stat = strstats[bucknum]; 
+         stat && stat->addr != addr;
+         stat = stat->hash_next) { }
+
+    if (!stat) {
+      stat = (strstat_t *)glulx_malloc(sizeof(strstat_t));
+      if (!stat)
+        fatal_error("Profiler: cannot malloc string.");
+      memset(stat, 0, sizeof(strstat_t));
+      stat->addr = addr;
+      stat->type = Mem1(addr);
+      stat->hash_next = strstats[bucknum];
+      strstats[bucknum] = stat;
+      strstat_count++;
+    }
+    stat->call_count++;
+  }
+  else {
+    stat = (strstack_depth ? strstack[strstack_depth-1] : NULL);
+  }
+
+  if (strstack_depth >= strstack_size) {
+    strstack_size = (strstack_size ? strstack_size*2 : 16);
+    strstack = (strstat_t **)glulx_realloc(strstack,
+      strstack_size * sizeof(strstat_t *));
+    if (!strstack)
+      fatal_error("Profiler: cannot malloc string stack.");
+  }
+  strstack[strstack_depth++] = stat;
+}
+
+/* profile_string_out():
+   The innermost string (or C string) has finished printing.
+*/
+void profile_string_out()
+{
+  if (!strstats)
+    return;
+
+  charge_strcounts();
+  if (strstack_depth)
+    strstack_depth--;
+}
+
+static void charge_strcounts()
+{
+  strstat_t *stat = (strstack_depth ? strstack[strstack_depth-1] : NULL);
+  int ix;
+
+  for (ix=0; ix<profstr_Count; ix++) {
+    if (stat)
+      stat->counts[ix] += (profile_strcounts[ix] - strcounts_charged[ix]);
+    strcounts_charged[ix] = profile_strcounts[ix];
+  }
+}
+
+static int compare_strstats(const void *p1, const void *p2)
+{
+  const strstat_t *stat1 = *(const strstat_t **)p1;
+  const strstat_t *stat2 = *(const strstat_t **)p2;
+
+  if (stat1->counts[profstr_Chars] != stat2->counts[profstr_Chars])
+    return (stat1->counts[profstr_Chars] > stat2->counts[profstr_Chars]) ? -1 : 1;
+  if (stat1->addr != stat2->addr)
+    return (stat1->addr < stat2->addr) ? -1 : 1;
+  return 0;
+}
+
+/* profile_string_quit():
+   Write out the string profile, if there is one.
+*/
+static void profile_string_quit()
+{
+  int bucknum;
+  glui32 ix;
+  strstat_t *stat, **list;
+  char linebuf[512];
+
+  if (!strstats)
+    return;
+
+  charge_strcounts();
+
+  list = (strstat_t **)glulx_malloc((strstat_count+1) * sizeof(strstat_t *));
+  if (!list)
+    fatal_error("Profiler: cannot malloc string list.");
+  ix = 0;
+  for (bucknum=0; bucknum<FUNC_HASH_SIZE; bucknum++) {
+    for (stat = strstats[bucknum]; stat; stat = stat->hash_next)
+      list[ix++] = stat;
+  }
+  qsort(list, strstat_count, sizeof(strstat_t *), compare_strstats);
+
+  glk_put_string_stream(strprofiling_stream, "<strprofile>\n");
+
+  for (ix=0; ix<strstat_count; ix++) {
+    stat = list[ix];
+    sprintf(linebuf, "  <string addr=\"%lx\" type=\"%X\" call_count=\"%ld\" chars=\"%ld\" cache_hits=\"%ld\" memo_hits=\"%ld\" tree_walks=\"%ld\" indirect_calls=\"%ld\" />\n",
+      (unsigned long)stat->addr, stat->type, (long)stat->call_count,
+      (long)stat->counts[profstr_Chars],
+      (long)stat->counts[profstr_CacheHits],
+      (long)stat->counts[profstr_MemoHits],
+      (long)stat->counts[profstr_TreeWalks],
+      (long)stat->counts[profstr_Indirect]);
+    glk_put_string_stream(strprofiling_stream, linebuf);
+  }
+
+  glk_put_string_stream(strprofiling_stream, "</strprofile>\n");
+
+  glk_stream_close(strprofiling_stream, NULL);
+  strprofiling_stream = NULL;
+
+  for (bucknum=0; bucknum<FUNC_HASH_SIZE; bucknum++) {
+    strstat_t *next;
+    for (stat = strstats[bucknum]; stat; stat = next) {
+      next = stat->hash_next;
+      glulx_free(stat);
+    }
+  }
+  glulx_free(strstats);
+  strstats = NULL;
+  glulx_free(list);
+  if (strstack) {
+    glulx_free(strstack);
+    strstack = NULL;
+  }
+  strstack_depth = 0;
+  strstack_size = 0;
+}
+
 void profile_quit()
 {
   int bucknum;
@@ -377,6 +612,8 @@ void profile_quit()
   char linebuf[512];
   strid_t profstr;
 
+  profile_string_quit();
+
   if (!profiling_active)
     return;
 
@@ -451,4 +688,9 @@ int init_profile()
     return TRUE;
 }
 
+void setup_string_profile(strid_t stream)
+{
+    /* Profiling is not compiled in. Do nothing. */
+}
+
 #endif /* VM_PROFILING */
@@ -3,6 +3,7 @@
     http://eblong.com/zarf/glulx/index.html
 */
 
+#include <string.h>
 #include "glk.h"
 #include "glulxe.h"
 
@@ -125,8 +126,15 @@ glui32 binary_search(glui32 key, glui32 keysize,
   glui32 top, bot, val, addr;
   int ix;
   int retindex = ((options & serop_ReturnIndex) != 0);
+  int keyinmem;
 
   fetchkey(keybuf, key, keysize, options);
+
+  /* For a long key (such as a dictionary word), we can compare whole
+     keys at once -- as long as they lie entirely in memory. If they
+     don't, we compare byte by byte, so that the range error happens
+     exactly where it would otherwise. */
+  keyinmem = (keysize > 4 && key < endmem && endmem - key >= keysize);
   
   bot = 0;
   top = numstructs;
@@ -145,6 +153,10 @@ glui32 binary_search(glui32 key, glui32 keysize,
           cmp = 1;
       }
     }
+    else if (keyinmem && addr + keyoffset < endmem
+      && endmem - (addr + keyoffset) >= keysize) {
+      cmp = memcmp(memmap + addr + keyoffset, memmap + key, keysize);
+    }
     else {
       for (ix=0; (!cmp) && ix<keysize; ix++) {
         byte = Mem1(addr + keyoffset + ix);
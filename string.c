@@ -3,6 +3,7 @@
     http://eblong.com/zarf/glulx/index.html
 */
 
+#include <string.h>
 #include "glk.h"
 #include "glulxe.h"
 
@@ -13,25 +14,117 @@ static glui32 iosys_rock;
 #define iosys_Filter (1)
 #define iosys_Glk (2)
 
-#define CACHEBITS (4)
-#define CACHESIZE (1<<CACHEBITS) 
-#define CACHEMASK (15)
-
-typedef struct cacheblock_struct {
-  int depth; /* 1 to 4 */
-  int type;
+#if TABLECACHE_BITS < 8 || TABLECACHE_BITS > 12
+#error "TABLECACHE_BITS must be between 8 and 12."
+#endif
+
+#define CACHESIZE (1<<TABLECACHE_BITS)
+#define CACHEMAXCHARS (4)
+
+/* One entry in a decoding table. The entry is selected by the low
+   bits of the string; it consumes numbits of them, and stands for up
+   to CACHEMAXCHARS plain characters followed by one node of some other
+   type. chardepth[ix] is the number of bits consumed up to the end of
+   chars[ix].
+   If type is 0x02, the entry is just the characters. If type is zero,
+   the node is a branch too deep for the table, and decoding continues
+   in the subtable at index u.subtable, which has 2^subbits entries.
+   (numchars is always zero in that case.)
+   This is 16 bytes, so that a table lookup touches one cache line. */
+typedef struct cacheentry_struct {
+  unsigned char numbits;
+  unsigned char numchars;
+  unsigned char type;
+  unsigned char subbits;
+  unsigned char chardepth[CACHEMAXCHARS];
+  unsigned char chars[CACHEMAXCHARS];
   union {
-    struct cacheblock_struct *branches;
-    unsigned char ch;
+    glui32 subtable;
     glui32 uch;
     glui32 addr;
   } u;
-} cacheblock_t;
+} cacheentry_t;
 
 /* The current string-decoding tables, broken out into a fast and
-   easy-to-use form. */
+   easy-to-use form. All the tables live in one array; the top-level
+   table is at index 0, with CACHESIZE entries. If tablecache_rootleaf
+   is set, the root node is not a branch, and every string is empty. */
 static int tablecache_valid = FALSE;
-static cacheblock_t tablecache;
+static int tablecache_rootleaf = FALSE;
+/* If the table is (even partly) in RAM, a copy of the RAM part as it
+   was when the cache was built. This is compared against memory before
+   each compressed string is decoded, so that a game which changes its
+   table gets the new decoding. */
+static unsigned char *tablecache_ramcopy = NULL;
+static glui32 tablecache_ramstart = 0;
+static glui32 tablecache_ramlen = 0;
+/* Set if the table can't be cached as it stands. (Only a RAM table
+   gets this far; a bad ROM table is a fatal error.) */
+static int buildcache_failed = FALSE;
+/* After a change to the table (or setting a table in RAM), the number
+   of compressed strings to print before the cache is built. */
+#define TABLECACHE_DELAY (16)
+static int tablecache_countdown = 0;
+static cacheentry_t *tablecache = NULL;
+static glui32 tablecache_count = 0;
+static glui32 tablecache_size = 0;
+
+/* The memo of decoded strings. Each memo holds the text at the start
+   of one compressed ROM string, up to its terminator or its first
+   indirect reference, so that it can be printed with a single Glk
+   call. (This is only used with the Glk iosys, and only while the
+   decoding tables are valid.) Memos are found through a hash table,
+   and kept on a list from most to least recently used; the least
+   recently used are discarded when the total size exceeds
+   string_memo_budget. */
+typedef struct strmemo_struct {
+  glui32 addr; /* the first byte after the E1 */
+  glui32 resaddr; /* where decoding resumes, if not done */
+  int resbit;
+  int done; /* the text runs all the way to the terminator */
+  int isuni; /* text is an array of glui32 rather than char */
+  glui32 len;
+  glui32 size; /* bytes counted against the budget */
+  void *text;
+  struct strmemo_struct *hashnext;
+  struct strmemo_struct *prev;
+  struct strmemo_struct *next;
+} strmemo_t;
+
+#define STRMEMO_HASHSIZE (1024)
+#define STRMEMO_HASH(addr) (((glui32)(addr) * 0x9E3779B1) >> 22)
+
+glui32 string_memo_budget = 0x40000;
+static strmemo_t *strmemo_hash[STRMEMO_HASHSIZE];
+static strmemo_t *strmemo_head = NULL;
+static strmemo_t *strmemo_tail = NULL;
+static glui32 strmemo_total = 0;
+static glui32 *strmemo_buf = NULL;
+static glui32 strmemo_bufsize = 0;
+
+/* The output buffer. In iosys_Glk mode, characters collect here and
+   go to the current Glk stream in one glk_put_buffer_uni() call (or
+   glk_put_buffer(), if the library has no Unicode support). The buffer
+   must be flushed before anything else touches Glk, since the current
+   stream might change, or the game might be about to wait for input;
+   perform_glk() and the error handlers take care of that.
+
+   When Glk output is being deferred (see glkop.c), this is also where
+   the deferred text lives. The queued calls only note how much of the
+   buffer came before them, and stream_flush_output() sends the two
+   over interleaved. So the buffer is sized for a whole turn's worth of
+   text, not just one string. */
+#define OUTBUF_SIZE (16384)
+static glui32 outbuf[OUTBUF_SIZE];
+static glui32 outbuf_len = 0;
+
+#define OUTBUF_PUT(ch)  \
+  do {  \
+    if (outbuf_len >= OUTBUF_SIZE)  \
+      stream_flush_output();  \
+    outbuf[outbuf_len++] = (ch);  \
+    profile_strcount(profstr_Chars, 1);  \
+  } while (0)
 
 static void stream_setup_unichar(void);
 
@@ -39,13 +132,35 @@ static void nopio_char_han(unsigned char ch);
 static void filio_char_han(unsigned char ch);
 static void nopio_unichar_han(glui32 ch);
 static void filio_unichar_han(glui32 ch);
+static int filter_native(glui32 ch);
+static void glkio_char_han(unsigned char ch);
+static glui32 string_span(glui32 addr);
+static glui32 ustring_span(glui32 addr);
+static void outbuf_put_bytes(glui32 addr, glui32 len);
+static void outbuf_put_chars(unsigned char *ptr, glui32 len);
+static void outbuf_put_words(glui32 addr, glui32 len);
+static void glkio_unichar_han(glui32 ch);
 static void glkio_unichar_nouni_han(glui32 val);
 static void (*glkio_unichar_han_ptr)(glui32 val) = NULL;
 
-static void dropcache(cacheblock_t *cablist);
-static void buildcache(cacheblock_t *cablist, glui32 nodeaddr, int depth,
-  int mask, int recdepth);
-static void dumpcache(cacheblock_t *cablist, int count, int indent);
+static void setupcache(void);
+static int tablecache_unchanged(void);
+static void tablecache_changed(void);
+static void buildcache_fail(char *msg);
+static void dropcache(void);
+static glui32 buildcache(glui32 nodeaddr, int bits, int depth);
+static void buildcache_entry(glui32 ix, glui32 pattern, int bits,
+  glui32 nodeaddr, int depth);
+static int cache_node_height(glui32 nodeaddr, int limit);
+static glui32 cache_fetch_tail(glui32 addr, int *availbits);
+static cacheentry_t *cache_lookup(glui32 *addrp, int *bitnump);
+static int strmemo_print(glui32 *addrp, int *bitnump);
+static void strmemo_emit(void *text, glui32 len, int isuni);
+static strmemo_t *strmemo_build(glui32 addr);
+static void strmemo_addchar(glui32 *lenp, glui32 ch);
+static void strmemo_unlink(strmemo_t *memo);
+static void strmemo_clear(void);
+static void dumpcache(glui32 tableix, int bits, int indent);
 
 void stream_get_iosys(glui32 *mode, glui32 *rock)
 {
@@ -71,6 +186,10 @@ static void stream_setup_unichar()
 
 void stream_set_iosys(glui32 mode, glui32 rock)
 {
+  /* Deferred text stays in order in the buffer; otherwise, send it. */
+  if (!glkdefer_enabled)
+    stream_flush_output();
+
   switch (mode) {
   default:
     mode = 0;
@@ -88,8 +207,8 @@ void stream_set_iosys(glui32 mode, glui32 rock)
     if (!glkio_unichar_han_ptr)
       stream_setup_unichar();
     rock = 0;
-    stream_char_handler = glk_put_char;
-    stream_unichar_handler = glkio_unichar_han_ptr;
+    stream_char_handler = glkio_char_han;
+    stream_unichar_handler = glkio_unichar_han;
     break;
   }
 
@@ -108,16 +227,243 @@ static void nopio_unichar_han(glui32 ch)
 static void filio_char_han(unsigned char ch)
 {
   glui32 val = ch;
+  if (filter_native(val))
+    return;
   push_callstub(0, 0);
   enter_function(iosys_rock, 1, &val);
 }
 
 static void filio_unichar_han(glui32 val)
 {
+  if (filter_native(val))
+    return;
   push_callstub(0, 0);
   enter_function(iosys_rock, 1, &val);
 }
 
+/* filter_native():
+   If the filter function is accelerated, pass it one character in
+   native code -- no call stubs, no VM -- and return TRUE. Returns FALSE
+   if the character must go through the VM in the usual way (because
+   the function isn't accelerated, or its native code declined).
+*/
+static int filter_native(glui32 ch)
+{
+  acceleration_func func = accel_get_func(iosys_rock);
+
+  profile_strcount(profstr_Chars, 1);
+  if (!func)
+    return FALSE;
+
+  profile_in(iosys_rock, stackptr, TRUE);
+  func(1, &ch);
+  profile_out(stackptr);
+  if (accel_fallback) {
+    accel_fallback = FALSE;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static void glkio_char_han(unsigned char ch)
+{
+  OUTBUF_PUT(ch);
+}
+
+static void glkio_unichar_han(glui32 val)
+{
+  OUTBUF_PUT(val);
+}
+
+/* stream_buffer_char():
+   Add a character to the output buffer, to be printed to the current
+   Glk stream. (This is for Glk output calls; it doesn't depend on
+   the iosys mode.)
+*/
+void stream_buffer_char(glui32 ch)
+{
+  OUTBUF_PUT(ch);
+}
+
+/* stream_buffer_text():
+   Add Latin-1 or Unicode text to the output buffer. This is for
+   deferred Glk output calls; see glkop.c.
+*/
+void stream_buffer_text(void *text, glui32 len, int isuni)
+{
+  glui32 count;
+  glui32 *words;
+
+  if (!isuni) {
+    outbuf_put_chars((unsigned char *)text, len);
+    return;
+  }
+
+  words = (glui32 *)text;
+  while (len) {
+    if (outbuf_len >= OUTBUF_SIZE)
+      stream_flush_output();
+    count = OUTBUF_SIZE - outbuf_len;
+    if (count > len)
+      count = len;
+    memcpy(outbuf+outbuf_len, words, count * sizeof(glui32));
+    outbuf_len += count;
+    words += count;
+    len -= count;
+  }
+}
+
+/* stream_output_pos():
+   Return how many characters are waiting in the output buffer. A
+   deferred Glk call records this, so that it goes out after the text
+   before it.
+*/
+glui32 stream_output_pos()
+{
+  return outbuf_len;
+}
+
+/* stream_flush_output():
+   Send everything in the output buffer to the current Glk stream,
+   along with any deferred Glk calls in between. Call this before
+   anything which talks to Glk directly.
+*/
+void stream_flush_output()
+{
+  glui32 pos = 0;
+
+  if (glkdefer_enabled)
+    pos = glkdefer_flush();
+  stream_send_output(pos, outbuf_len);
+  outbuf_len = 0;
+}
+
+/* stream_send_output():
+   Send part of the output buffer, from start up to end, to the current
+   Glk stream. The buffer is not emptied; that's up to the caller.
+*/
+void stream_send_output(glui32 start, glui32 end)
+{
+  glui32 ix;
+  char *cbuf;
+
+  if (start >= end)
+    return;
+
+  if (!glkio_unichar_han_ptr)
+    stream_setup_unichar();
+
+#ifdef GLK_MODULE_UNICODE
+  if (glkio_unichar_han_ptr == glk_put_char_uni) {
+    glk_put_buffer_uni(outbuf+start, end-start);
+    return;
+  }
+#endif /* GLK_MODULE_UNICODE */
+
+  /* No Unicode; narrow that part of the buffer in place. */
+  cbuf = (char *)(outbuf+start);
+  for (ix=0; ix<end-start; ix++) {
+    glui32 val = outbuf[start+ix];
+    if (val > 0xFF)
+      val = '?';
+    cbuf[ix] = (char)val;
+  }
+  glk_put_buffer(cbuf, end-start);
+}
+
+/* string_span():
+   Return the length of the zero-terminated run of bytes at addr (not
+   counting the terminator). This checks the bounds once, rather than
+   on every character.
+*/
+static glui32 string_span(glui32 addr)
+{
+  unsigned char *ptr;
+
+  if (addr >= endmem)
+    fatal_error_i("Memory access out of range", addr);
+  ptr = (unsigned char *)memchr(memmap+addr, 0, endmem-addr);
+  if (!ptr)
+    fatal_error_i("Memory access out of range", endmem);
+  return (ptr - (memmap+addr));
+}
+
+/* ustring_span():
+   Return the length, in words, of the zero-terminated run of four-byte
+   words at addr (not counting the terminator).
+*/
+static glui32 ustring_span(glui32 addr)
+{
+  unsigned char *ptr, *start, *end;
+  glui32 word;
+
+  if (addr >= endmem)
+    fatal_error_i("Memory access out of range", addr);
+  start = memmap+addr;
+  end = start + ((endmem-addr) & ~3);
+  for (ptr=start; ptr<end; ptr+=4) {
+    /* Byte order doesn't matter when testing for zero. */
+    memcpy(&word, ptr, 4);
+    if (!word)
+      return (ptr - start) / 4;
+  }
+  fatal_error_i("Memory access out of range", (glui32)(end - memmap));
+  return 0;
+}
+
+/* outbuf_put_bytes():
+   Add len characters, stored as bytes at addr, to the output buffer.
+   The caller has checked the bounds.
+*/
+static void outbuf_put_bytes(glui32 addr, glui32 len)
+{
+  profile_strcount(profstr_Chars, len);
+  outbuf_put_chars(memmap+addr, len);
+}
+
+/* outbuf_put_chars():
+   Add len characters, stored as bytes at ptr, to the output buffer.
+   (A run too long for the buffer goes straight to Glk.)
+*/
+static void outbuf_put_chars(unsigned char *ptr, glui32 len)
+{
+  glui32 ix;
+
+  if (len > OUTBUF_SIZE - outbuf_len) {
+    stream_flush_output();
+    if (len > OUTBUF_SIZE) {
+      glk_put_buffer((char *)ptr, len);
+      return;
+    }
+  }
+  for (ix=0; ix<len; ix++)
+    outbuf[outbuf_len+ix] = ptr[ix];
+  outbuf_len += len;
+}
+
+/* outbuf_put_words():
+   Add len characters, stored as big-endian words at addr, to the
+   output buffer. The caller has checked the bounds.
+*/
+static void outbuf_put_words(glui32 addr, glui32 len)
+{
+  unsigned char *ptr = memmap+addr;
+  glui32 count;
+
+  profile_strcount(profstr_Chars, len);
+  while (len) {
+    if (outbuf_len >= OUTBUF_SIZE)
+      stream_flush_output();
+    count = OUTBUF_SIZE - outbuf_len;
+    if (count > len)
+      count = len;
+    read_word_array(outbuf+outbuf_len, ptr, count);
+    ptr += 4*count;
+    outbuf_len += count;
+    len -= count;
+  }
+}
+
 static void glkio_unichar_nouni_han(glui32 val)
 {
   /* Only used if the Glk library has no Unicode functions */
@@ -126,45 +472,66 @@ static void glkio_unichar_nouni_han(glui32 val)
   glk_put_char(val);
 }
 
+/* The decimal digit pairs "00" through "99", for stream_num(). */
+static const char digitpairs[201] =
+  "0001020304050607080910111213141516171819"
+  "2021222324252627282930313233343536373839"
+  "4041424344454647484950515253545556575859"
+  "6061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
 /* stream_num():
    Write a signed integer to the current output stream.
 */
 void stream_num(glsi32 val, int inmiddle, int charnum)
 {
-  int ix = 0;
+  int ix, len;
   int res, jx;
   char buf[16];
+  char *str;
   glui32 ival;
 
-  if (val == 0) {
-    buf[ix] = '0';
-    ix++;
+  /* Format the number at the end of buf, two digits at a time. */
+  ix = sizeof(buf);
+  if (val < 0) 
+    ival = -(glui32)val;
+  else 
+    ival = val;
+
+  while (ival >= 100) {
+    jx = (ival % 100) * 2;
+    ival /= 100;
+    ix -= 2;
+    buf[ix] = digitpairs[jx];
+    buf[ix+1] = digitpairs[jx+1];
+  }
+  if (ival >= 10) {
+    ix -= 2;
+    buf[ix] = digitpairs[ival*2];
+    buf[ix+1] = digitpairs[ival*2+1];
   }
   else {
-    if (val < 0) 
-      ival = -(glui32)val;
-    else 
-      ival = val;
-
-    while (ival != 0) {
-      buf[ix] = (ival % 10) + '0';
-      ix++;
-      ival /= 10;
-    }
-
-    if (val < 0) {
-      buf[ix] = '-';
-      ix++;
-    }
+    ix--;
+    buf[ix] = '0' + ival;
+  }
+  if (val < 0) {
+    ix--;
+    buf[ix] = '-';
   }
 
+  str = buf + ix;
+  len = sizeof(buf) - ix;
+
   switch (iosys_mode) {
 
   case iosys_Glk:
-    ix -= charnum;
-    while (ix > 0) {
-      ix--;
-      glk_put_char(buf[ix]);
+    /* As in the one-character-at-a-time version, the first charnum
+       characters were already printed (by a filter function which then
+       switched to Glk); the rest go out as they are. */
+    len -= charnum;
+    if (len > 0) {
+      outbuf_put_chars((unsigned char *)str+charnum, len);
+      profile_strcount(profstr_Chars, len);
     }
     break;
 
@@ -173,8 +540,12 @@ void stream_num(glsi32 val, int inmiddle, int charnum)
       push_callstub(0x11, 0);
       inmiddle = TRUE;
     }
-    if (charnum < ix) {
-      ival = buf[(ix-1)-charnum] & 0xFF;
+    while (charnum < len) {
+      ival = str[charnum] & 0xFF;
+      if (filter_native(ival)) {
+        charnum++;
+        continue;
+      }
       pc = val;
       push_callstub(0x12, charnum+1);
       enter_function(iosys_rock, 1, &ival);
@@ -206,7 +577,8 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
   int type;
   int alldone = FALSE;
   int substring = (inmiddle != 0);
-  glui32 ival;
+  int fresh;
+  glui32 ival, len;
 
   if (!addr)
     fatal_error("Called stream_string with null address.");
@@ -215,82 +587,78 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
 
     if (inmiddle == 0) {
       type = Mem1(addr);
+      profile_string_in(addr);
       if (type == 0xE2)
         addr+=4;
       else
         addr++;
       bitnum = 0;
+      fresh = TRUE;
     }
     else {
       type = inmiddle;
+      fresh = FALSE;
     }
 
     if (type == 0xE1) {
+      /* Check a RAM table when a string starts, not every time one
+         is resumed after an embedded call. */
+      if (fresh && tablecache_ramcopy && !tablecache_unchanged())
+        tablecache_changed();
+      if (tablecache_countdown) {
+        /* The table was changed recently. */
+        tablecache_countdown--;
+        if (!tablecache_countdown)
+          setupcache();
+      }
       if (tablecache_valid) {
-        int bits, numbits;
-        int readahead;
-        glui32 tmpaddr;
-        cacheblock_t *cablist;
+        int ix;
+        cacheentry_t *ent;
+        cacheentry_t entbuf;
         int done = 0;
 
-        /* bitnum is already set right */
-        bits = Mem1(addr); 
-        if (bitnum)
-          bits >>= bitnum;
-        numbits = (8 - bitnum);
-        readahead = FALSE;
-
-        if (tablecache.type != 0) {
-          /* This is a bit of a cheat. If the top-level block is not
-             a branch, then it must be a string-terminator -- otherwise
-             the string would be an infinite repetition of that block.
-             We check for this case and bail immediately. */
+        if (tablecache_rootleaf) {
+          /* This is a bit of a cheat. If the root node is not a branch,
+             then it must be a string-terminator -- otherwise the string
+             would be an infinite repetition of that node. We check for
+             this case and bail immediately. */
           done = 1;
         }
+        else if (fresh && iosys_mode == iosys_Glk
+          && (string_memo_budget || predecode_enabled)) {
+          /* Print as much as we can from the memo. This may leave us at
+             an indirect reference, to be decoded below. */
+          done = strmemo_print(&addr, &bitnum);
+        }
 
-        cablist = tablecache.u.branches;
         while (!done) {
-          cacheblock_t *cab;
-
-          if (numbits < CACHEBITS) {
-            /* readahead is certainly false */
-            int newbyte = Mem1(addr+1);
-            bits |= (newbyte << numbits);
-            numbits += 8;
-            readahead = TRUE;
-          }
-
-          cab = &(cablist[bits & CACHEMASK]);
-          numbits -= cab->depth;
-          bits >>= cab->depth;
-          bitnum += cab->depth;
-          if (bitnum >= 8) {
-            addr += 1;
-            bitnum -= 8;
-            if (readahead) {
-              readahead = FALSE;
-            }
-            else {
-              int newbyte = Mem1(addr);
-              bits |= (newbyte << numbits);
-              numbits += 8;
-            }
-          }
+          /* bitnum is already set right */
+          ent = cache_lookup(&addr, &bitnum);
+          profile_strcount(profstr_CacheHits, 1);
 
-          switch (cab->type) {
-          case 0x00: /* non-leaf node */
-            cablist = cab->u.branches;
-            break;
-          case 0x01: /* string terminator */
-            done = 1;
-            break;
-          case 0x02: /* single character */
+          if (ent->numchars) {
             switch (iosys_mode) {
             case iosys_Glk:
-              glk_put_char(cab->u.ch);
+              for (ix=0; ix<ent->numchars; ix++)
+                OUTBUF_PUT(ent->chars[ix]);
               break;
             case iosys_Filter: 
-              ival = cab->u.ch & 0xFF;
+              /* The native filter might write into the table, which
+                 would free the cache; so work from a copy. */
+              entbuf = *ent;
+              ent = &entbuf;
+              for (ix=0; ix<ent->numchars; ix++) {
+                if (!filter_native(ent->chars[ix]))
+                  break;
+              }
+              if (ix == ent->numchars)
+                break;
+              /* This character has to go through the VM; the filter
+                 function will resume us right after it. */
+              ival = ent->chars[ix];
+              bitnum += ent->chardepth[ix];
+              addr += (bitnum >> 3);
+              bitnum &= 7;
               if (!substring) {
                 push_callstub(0x11, 0);
                 substring = TRUE;
@@ -300,15 +668,27 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               enter_function(iosys_rock, 1, &ival);
               return;
             }
-            cablist = tablecache.u.branches;
+          }
+
+          bitnum += ent->numbits;
+          addr += (bitnum >> 3);
+          bitnum &= 7;
+
+          switch (ent->type) {
+          case 0x02: /* plain characters, already printed */
+            break;
+          case 0x01: /* string terminator */
+            done = 1;
             break;
           case 0x04: /* single Unicode character */
             switch (iosys_mode) {
             case iosys_Glk:
-              glkio_unichar_han_ptr(cab->u.uch);
+              OUTBUF_PUT(ent->u.uch);
               break;
             case iosys_Filter: 
-              ival = cab->u.uch;
+              ival = ent->u.uch;
+              if (filter_native(ival))
+                break;
               if (!substring) {
                 push_callstub(0x11, 0);
                 substring = TRUE;
@@ -318,14 +698,11 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               enter_function(iosys_rock, 1, &ival);
               return;
             }
-            cablist = tablecache.u.branches;
             break;
           case 0x03: /* C string */
             switch (iosys_mode) {
             case iosys_Glk:
-              for (tmpaddr=cab->u.addr; (ch=Mem1(tmpaddr)) != '\0'; tmpaddr++) 
-                glk_put_char(ch);
-              cablist = tablecache.u.branches; 
+              outbuf_put_bytes(ent->u.addr, string_span(ent->u.addr));
               break;
             case iosys_Filter:
               if (!substring) {
@@ -334,21 +711,19 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               }
               pc = addr;
               push_callstub(0x10, bitnum);
+              profile_string_in(0);
               inmiddle = 0xE0;
-              addr = cab->u.addr;
+              addr = ent->u.addr;
               done = 2;
               break;
             default:
-              cablist = tablecache.u.branches; 
               break;
             }
             break;
           case 0x05: /* C Unicode string */
             switch (iosys_mode) {
             case iosys_Glk:
-              for (tmpaddr=cab->u.addr; (ival=Mem4(tmpaddr)) != 0; tmpaddr+=4) 
-                glkio_unichar_han_ptr(ival);
-              cablist = tablecache.u.branches; 
+              outbuf_put_words(ent->u.addr, ustring_span(ent->u.addr));
               break;
             case iosys_Filter:
               if (!substring) {
@@ -357,12 +732,12 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               }
               pc = addr;
               push_callstub(0x10, bitnum);
+              profile_string_in(0);
               inmiddle = 0xE2;
-              addr = cab->u.addr;
+              addr = ent->u.addr;
               done = 2;
               break;
             default:
-              cablist = tablecache.u.branches; 
               break;
             }
             break;
@@ -373,10 +748,11 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
             {
               glui32 oaddr;
               int otype;
-              oaddr = cab->u.addr;
-              if (cab->type >= 0x09)
+              profile_strcount(profstr_Indirect, 1);
+              oaddr = ent->u.addr;
+              if (ent->type >= 0x09)
                 oaddr = Mem4(oaddr);
-              if (cab->type == 0x0B)
+              if (ent->type == 0x0B)
                 oaddr = Mem4(oaddr);
               otype = Mem1(oaddr);
               if (!substring) {
@@ -393,9 +769,9 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               else if (otype >= 0xC0 && otype <= 0xDF) {
                 glui32 argc;
                 glui32 *argv;
-                if (cab->type == 0x0A || cab->type == 0x0B) {
-                  argc = Mem4(cab->u.addr+4);
-                  argv = pop_arguments(argc, cab->u.addr+8);
+                if (ent->type == 0x0A || ent->type == 0x0B) {
+                  argc = Mem4(ent->u.addr+4);
+                  argv = pop_arguments(argc, ent->u.addr+8);
                 }
                 else {
                   argc = 0;
@@ -415,6 +791,12 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
             fatal_error("Unknown entity in string decoding (cached).");
             break;
           }
+          if (!done && !tablecache_valid) {
+            /* A native filter changed the table. Carry on without
+               the cache. */
+            inmiddle = 0xE1;
+            done = 2;
+          }
         }
         if (done > 1) {
           continue; /* restart the top-level loop */
@@ -436,6 +818,8 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
         while (!done) {
           nodetype = Mem1(node);
           node++;
+          if (nodetype != 0x00)
+            profile_strcount(profstr_TreeWalks, 1);
           switch (nodetype) {
           case 0x00: /* non-leaf node */
             if (byte & 1) 
@@ -459,10 +843,12 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
             ch = Mem1(node);
             switch (iosys_mode) {
             case iosys_Glk:
-              glk_put_char(ch);
+              OUTBUF_PUT(ch);
               break;
             case iosys_Filter: 
               ival = ch & 0xFF;
+              if (filter_native(ival))
+                break;
               if (!substring) {
                 push_callstub(0x11, 0);
                 substring = TRUE;
@@ -478,9 +864,11 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
             ival = Mem4(node);
             switch (iosys_mode) {
             case iosys_Glk:
-              glkio_unichar_han_ptr(ival);
+              OUTBUF_PUT(ival);
               break;
             case iosys_Filter: 
+              if (filter_native(ival))
+                break;
               if (!substring) {
                 push_callstub(0x11, 0);
                 substring = TRUE;
@@ -495,8 +883,7 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
           case 0x03: /* C string */
             switch (iosys_mode) {
             case iosys_Glk:
-              for (; (ch=Mem1(node)) != '\0'; node++) 
-                glk_put_char(ch);
+              outbuf_put_bytes(node, string_span(node));
               node = Mem4(stringtable+8);
               break;
             case iosys_Filter:
@@ -506,6 +893,7 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               }
               pc = addr;
               push_callstub(0x10, bitnum);
+              profile_string_in(0);
               inmiddle = 0xE0;
               addr = node;
               done = 2;
@@ -518,8 +906,7 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
           case 0x05: /* C Unicode string */
             switch (iosys_mode) {
             case iosys_Glk:
-              for (; (ival=Mem4(node)) != 0; node+=4) 
-                glkio_unichar_han_ptr(ival);
+              outbuf_put_words(node, ustring_span(node));
               node = Mem4(stringtable+8);
               break;
             case iosys_Filter:
@@ -529,6 +916,7 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
               }
               pc = addr;
               push_callstub(0x10, bitnum);
+              profile_string_in(0);
               inmiddle = 0xE2;
               addr = node;
               done = 2;
@@ -545,6 +933,7 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
             {
               glui32 oaddr;
               int otype;
+              profile_strcount(profstr_Indirect, 1);
               oaddr = Mem4(node);
               if (nodetype == 0x09 || nodetype == 0x0B)
                 oaddr = Mem4(oaddr);
@@ -594,23 +983,23 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
     else if (type == 0xE0) {
       switch (iosys_mode) {
       case iosys_Glk:
-        while (1) {
-          ch = Mem1(addr);
-          addr++;
-          if (ch == '\0')
-            break;
-          glk_put_char(ch);
-        }
+        len = string_span(addr);
+        outbuf_put_bytes(addr, len);
+        addr += (len+1);
         break;
       case iosys_Filter:
         if (!substring) {
           push_callstub(0x11, 0);
           substring = TRUE;
         }
-        ch = Mem1(addr);
-        addr++;
-        if (ch != '\0') {
+        while (1) {
+          ch = Mem1(addr);
+          addr++;
+          if (ch == '\0')
+            break;
           ival = ch & 0xFF;
+          if (filter_native(ival))
+            continue;
           pc = addr;
           push_callstub(0x13, 0);
           enter_function(iosys_rock, 1, &ival);
@@ -622,22 +1011,22 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
     else if (type == 0xE2) {
       switch (iosys_mode) {
       case iosys_Glk:
-        while (1) {
-          ival = Mem4(addr);
-          addr+=4;
-          if (ival == 0)
-            break;
-          glkio_unichar_han_ptr(ival);
-        }
+        len = ustring_span(addr);
+        outbuf_put_words(addr, len);
+        addr += 4*(len+1);
         break;
       case iosys_Filter:
         if (!substring) {
           push_callstub(0x11, 0);
           substring = TRUE;
         }
-        ival = Mem4(addr);
-        addr+=4;
-        if (ival != 0) {
+        while (1) {
+          ival = Mem4(addr);
+          addr+=4;
+          if (ival == 0)
+            break;
+          if (filter_native(ival))
+            continue;
           pc = addr;
           push_callstub(0x14, 0);
           enter_function(iosys_rock, 1, &ival);
@@ -653,6 +1042,7 @@ void stream_string(glui32 addr, int inmiddle, int bitnum)
       fatal_error("Attempt to print non-string.");
     }
 
+    profile_string_out();
     if (!substring) {
       /* Just get straight out. */
       alldone = TRUE;
@@ -688,163 +1078,752 @@ void stream_set_table(glui32 addr)
 
   /* Drop cache. */
   if (tablecache_valid) {
-    if (tablecache.type == 0)
-      dropcache(tablecache.u.branches);
-    tablecache.u.branches = NULL;
-    tablecache_valid = FALSE;
+    strmemo_clear();
+    dropcache();
   }
+  tablecache_countdown = 0;
 
   stringtable = addr;
 
   if (stringtable) {
-    /* Build cache. We can only do this if the table is entirely in ROM. */
-    glui32 tablelen = Mem4(stringtable);
-    glui32 rootaddr = Mem4(stringtable+8);
-    int cache_stringtable = (stringtable+tablelen <= ramstart);
-    /* cache_stringtable = TRUE; ...for testing only */
+    int cache_stringtable = TRUE;
     /* cache_stringtable = FALSE; ...for testing only */
     if (cache_stringtable) {
-      buildcache(&tablecache, rootaddr, CACHEBITS, 0, 0);
-      /* dumpcache(&tablecache, 1, 0); */
-      tablecache_valid = TRUE;
+      /* A table in RAM may be about to be written, so it waits until
+         a few strings have been printed. */
+      if (stringtable+Mem4(stringtable) > ramstart)
+        tablecache_countdown = TABLECACHE_DELAY;
+      else
+        setupcache();
     }
   }
 }
 
-static void buildcache(cacheblock_t *cablist, glui32 nodeaddr, int depth,
-  int mask, int recdepth)
+/* tablecache_unchanged():
+   Check whether the RAM part of the table still matches the copy made
+   when the cache was built.
+*/
+static int tablecache_unchanged()
+{
+  if (tablecache_ramstart+tablecache_ramlen > endmem)
+    return FALSE;
+  return (memcmp(memmap+tablecache_ramstart, tablecache_ramcopy,
+    tablecache_ramlen) == 0);
+}
+
+/* tablecache_changed():
+   The game has changed the string-decoding table, which is in RAM.
+   Drop the decoding cache. It will be rebuilt after a few strings have
+   been printed the slow way -- so that a game which rewrites its table
+   between every string doesn't pay for a rebuild each time.
+*/
+static void tablecache_changed()
 {
-  int ix, type;
+  strmemo_clear();
+  dropcache();
+  tablecache_countdown = TABLECACHE_DELAY;
+}
+
+/* setupcache():
+   Build the decoding cache for the current table. If the table is
+   (even partly) in RAM, keep a copy of the RAM part, so that changes
+   to it will be noticed. If a RAM table can't be cached, we just leave
+   it uncached.
+*/
+static void setupcache()
+{
+  glui32 tablelen = Mem4(stringtable);
+  glui32 rootaddr = Mem4(stringtable+8);
+  glui32 tableend;
+
+  tableend = stringtable+tablelen;
+  if (tableend < stringtable)
+    tableend = 0xFFFFFFFF;
+  if (tableend > ramstart) {
+    if (tableend > endmem)
+      return;
+    tablecache_ramstart = (stringtable > ramstart) ? stringtable : ramstart;
+    tablecache_ramlen = tableend - tablecache_ramstart;
+    tablecache_ramcopy = (unsigned char *)glulx_malloc(tablecache_ramlen);
+    if (!tablecache_ramcopy) {
+      tablecache_ramlen = 0;
+      return;
+    }
+    memcpy(tablecache_ramcopy, memmap+tablecache_ramstart,
+      tablecache_ramlen);
+  }
+
+  buildcache_failed = FALSE;
+  if (rootaddr >= endmem)
+    buildcache_fail("String table root node is out of range.");
+  else if (Mem1(rootaddr) != 0x00)
+    tablecache_rootleaf = TRUE;
+  else
+    buildcache(rootaddr, TABLECACHE_BITS, 0);
+  if (buildcache_failed) {
+    dropcache();
+    return;
+  }
+  /* dumpcache(0, TABLECACHE_BITS, 0); */
+  tablecache_valid = TRUE;
+}
+
+/* buildcache_fail():
+   The table can't be cached. For a table in ROM, that's a fatal error.
+   A table in RAM may just be half-written; it's decoded without the
+   cache, which will report any real problem when a string uses it.
+*/
+static void buildcache_fail(char *msg)
+{
+  if (!tablecache_ramcopy)
+    fatal_error(msg);
+  buildcache_failed = TRUE;
+}
+
+/* cache_fetch_tail():
+   Read the bits at addr for the string decoder, when addr is within
+   three bytes of the end of memory. Bytes past the end read as zero;
+   *availbits is set to the number of real bits.
+*/
+static glui32 cache_fetch_tail(glui32 addr, int *availbits)
+{
+  glui32 bits;
+  int ix;
+
+  bits = Mem1(addr);
+  *availbits = 8;
+  for (ix=1; ix<3 && addr+ix < endmem; ix++) {
+    bits |= ((glui32)Mem1(addr+ix) << (8*ix));
+    *availbits += 8;
+  }
+  return bits;
+}
+
+/* cache_lookup():
+   Find the decoding-table entry for the bits at *addrp, starting at
+   bit *bitnump. If the lookup passes through subtables, *addrp and
+   *bitnump are advanced past the bits used to reach the final entry;
+   the caller is responsible for consuming the entry's own bits.
+*/
+static cacheentry_t *cache_lookup(glui32 *addrp, int *bitnump)
+{
+  glui32 addr = *addrp;
+  int bitnum = *bitnump;
+  glui32 bits;
+  int availbits;
+  glui32 tableix = 0;
+  int tablebits = TABLECACHE_BITS;
+  cacheentry_t *ent;
+
+  while (1) {
+    /* Three bytes is enough for any lookup, since bitnum is at most 7
+       and a window is at most 12 bits. */
+    if (addr < endmem-2) {
+      bits = Read1(memmap+addr)
+        | (Read1(memmap+addr+1) << 8)
+        | (Read1(memmap+addr+2) << 16);
+      availbits = 24;
+    }
+    else {
+      bits = cache_fetch_tail(addr, &availbits);
+    }
+    bits >>= bitnum;
+    availbits -= bitnum;
+    ent = &(tablecache[tableix + (bits & ((1 << tablebits) - 1))]);
+    if (ent->numbits > availbits)
+      fatal_error("Compressed string runs past the end of memory.");
+    if (ent->type != 0x00)
+      break;
+    bitnum += ent->numbits;
+    addr += (bitnum >> 3);
+    bitnum &= 7;
+    tableix = ent->u.subtable;
+    tablebits = ent->subbits;
+  }
+
+  *addrp = addr;
+  *bitnump = bitnum;
+  return ent;
+}
+
+/* buildcache():
+   Build a decoding table of 2^bits entries, for strings whose next
+   bits start at the branch node nodeaddr. Returns the table's index
+   in the tablecache array. depth is the depth of nodeaddr in the
+   tree.
+*/
+static glui32 buildcache(glui32 nodeaddr, int bits, int depth)
+{
+  glui32 base, count, pattern;
 
   /* This gets up to 24 in large games, so I think 48 is a generous
      maximum. If it's not, we might need a command-line parameter. */
-  if (recdepth >= 48)
-    fatal_error("Apparent infinite recursion in buildcache");
-  
-  type = Mem1(nodeaddr);
-
-  if (type == 0 && depth == CACHEBITS) {
-    cacheblock_t *list, *cab;
-    list = (cacheblock_t *)glulx_malloc(sizeof(cacheblock_t) * CACHESIZE);
-    buildcache(list, nodeaddr, 0, 0, recdepth+1);
-    cab = &(cablist[mask]);
-    cab->type = 0;
-    cab->depth = CACHEBITS;
-    cab->u.branches = list;
-    return;
+  if (depth >= 48) {
+    buildcache_fail("Apparent infinite recursion in buildcache");
+    return 0;
   }
 
-  if (type == 0) {
-    glui32 leftaddr  = Mem4(nodeaddr+1);
-    glui32 rightaddr = Mem4(nodeaddr+5);
-    buildcache(cablist, leftaddr, depth+1, mask, recdepth+1);
-    buildcache(cablist, rightaddr, depth+1, (mask | (1 << depth)), recdepth+1);
-    return;
+  count = ((glui32)1 << bits);
+  if (tablecache_count + count > tablecache_size) {
+    glui32 newsize = (tablecache_size ? tablecache_size : CACHESIZE);
+    while (newsize < tablecache_count + count)
+      newsize *= 2;
+    tablecache = (cacheentry_t *)glulx_realloc(tablecache,
+      newsize * sizeof(cacheentry_t));
+    if (!tablecache)
+      fatal_error("Unable to allocate space for string decoding table.");
+    tablecache_size = newsize;
   }
+  base = tablecache_count;
+  tablecache_count += count;
 
-  /* Leaf node. */
-  nodeaddr++;
-  for (ix = mask; ix < CACHESIZE; ix += (1 << depth)) {
-    cacheblock_t *cab = &(cablist[ix]);
-    cab->type = type;
-    cab->depth = depth;
-    switch (type) {
-    case 0x02:
-      cab->u.ch = Mem1(nodeaddr);
+  /* Building an entry may build subtables, which can move the array.
+     So we refer to entries by index here. */
+  for (pattern=0; pattern<count && !buildcache_failed; pattern++)
+    buildcache_entry(base+pattern, pattern, bits, nodeaddr, depth);
+
+  return base;
+}
+
+/* buildcache_entry():
+   Fill in tablecache[ix] by walking the tree from nodeaddr, following
+   the given pattern of bits (low bit first).
+*/
+static void buildcache_entry(glui32 ix, glui32 pattern, int bits,
+  glui32 nodeaddr, int depth)
+{
+  glui32 rootaddr = Mem4(stringtable+8);
+  cacheentry_t ent;
+  int used = 0;
+  int type, subbits, jx;
+
+  ent.numbits = 0;
+  ent.numchars = 0;
+  ent.type = 0x02;
+  ent.subbits = 0;
+  for (jx=0; jx<CACHEMAXCHARS; jx++) {
+    ent.chardepth[jx] = 0;
+    ent.chars[jx] = 0;
+  }
+  ent.u.addr = 0;
+
+  while (!buildcache_failed) {
+    if (nodeaddr >= endmem) {
+      buildcache_fail("String table node is out of range.");
       break;
+    }
+    type = Mem1(nodeaddr);
+
+    if (type == 0x00) {
+      if (nodeaddr+9 > endmem) {
+        buildcache_fail("String table node is out of range.");
+        break;
+      }
+      if (used < bits) {
+        if ((pattern >> used) & 1)
+          nodeaddr = Mem4(nodeaddr+5);
+        else
+          nodeaddr = Mem4(nodeaddr+1);
+        used++;
+        continue;
+      }
+      if (ent.numchars == 0) {
+        /* This branch is too deep for the table, so it gets a
+           subtable of its own -- only as wide as it needs to be. */
+        subbits = cache_node_height(nodeaddr, TABLECACHE_BITS);
+        ent.u.subtable = buildcache(nodeaddr, subbits, depth+bits);
+        ent.type = 0x00;
+        ent.subbits = subbits;
+        ent.numbits = bits;
+      }
+      /* Otherwise, the entry ends after the characters we have. */
+      break;
+    }
+
+    if (type == 0x02) {
+      /* A plain character. Add it, and start again from the root. */
+      ent.chars[ent.numchars] = Mem1(nodeaddr+1);
+      ent.chardepth[ent.numchars] = used;
+      ent.numchars++;
+      ent.numbits = used;
+      if (ent.numchars == CACHEMAXCHARS)
+        break;
+      nodeaddr = rootaddr;
+      continue;
+    }
+
+    /* Any other node ends the entry. */
+    nodeaddr++;
+    ent.type = type;
+    ent.numbits = used;
+    switch (type) {
     case 0x04:
-      cab->u.uch = Mem4(nodeaddr);
+      ent.u.uch = Mem4(nodeaddr);
       break;
     case 0x03:
     case 0x05:
     case 0x0A:
     case 0x0B:
-      cab->u.addr = nodeaddr;
+      ent.u.addr = nodeaddr;
       break;
     case 0x08:
     case 0x09:
-      cab->u.addr = Mem4(nodeaddr);
+      ent.u.addr = Mem4(nodeaddr);
       break;
     }
+    break;
   }
+
+  tablecache[ix] = ent;
+}
+
+/* cache_node_height():
+   Return the depth of the subtree at nodeaddr (the longest path to a
+   leaf), or limit, whichever is less.
+*/
+static int cache_node_height(glui32 nodeaddr, int limit)
+{
+  int left, right;
+
+  if (limit == 0 || nodeaddr+9 > endmem || Mem1(nodeaddr) != 0x00)
+    return 0;
+
+  left = cache_node_height(Mem4(nodeaddr+1), limit-1);
+  if (left == limit-1)
+    return limit;
+  right = cache_node_height(Mem4(nodeaddr+5), limit-1);
+  if (right > left)
+    left = right;
+  return left+1;
 }
 
 #if 0
 #include <stdio.h>
-static void dumpcache(cacheblock_t *cablist, int count, int indent)
+static void dumpcache(glui32 tableix, int bits, int indent)
 {
-  int ix, jx;
+  glui32 ix;
+  int jx;
 
-  for (ix=0; ix<count; ix++) {
-    cacheblock_t *cab = &(cablist[ix]); 
+  for (ix=0; ix<((glui32)1 << bits); ix++) {
+    cacheentry_t *ent = &(tablecache[tableix+ix]); 
     for (jx=0; jx<indent; jx++)
       printf("  ");
-    printf("%X: ", ix);
-    switch (cab->type) {
+    printf("%lX: (%d bits) ", (unsigned long)ix, ent->numbits);
+    for (jx=0; jx<ent->numchars; jx++) {
+      if (ent->chars[jx] < 32)
+        printf("0x%02X ", ent->chars[jx]);
+      else
+        printf("'%c' ", ent->chars[jx]);
+    }
+    switch (ent->type) {
     case 0:
       printf("...\n");
-      dumpcache(cab->u.branches, CACHESIZE, indent+1);
+      dumpcache(ent->u.subtable, ent->subbits, indent+1);
       break;
     case 1:
       printf("<EOS>\n");
       break;
     case 2:
-      printf("0x%02X", cab->u.ch);
-      if (cab->u.ch < 32)
-        printf(" ''\n");
-      else
-        printf(" '%c'\n", cab->u.ch);
+      printf("\n");
       break;
     default:
-      printf("type %02X, address %06lX\n", cab->type, cab->u.addr);
+      printf("type %02X, address %06lX\n", ent->type,
+        (unsigned long)ent->u.addr);
       break;
     }
   }
 }
 #endif /* 0 */
 
-static void dropcache(cacheblock_t *cablist)
+static void dropcache()
 {
-  int ix;
-  for (ix=0; ix<CACHESIZE; ix++) {
-    cacheblock_t *cab = &(cablist[ix]);
-    if (cab->type == 0) {
-      dropcache(cab->u.branches);
-      cab->u.branches = NULL;
+  if (tablecache_ramcopy) {
+    glulx_free(tablecache_ramcopy);
+    tablecache_ramcopy = NULL;
+  }
+  tablecache_ramstart = 0;
+  tablecache_ramlen = 0;
+  if (tablecache) {
+    glulx_free(tablecache);
+    tablecache = NULL;
+  }
+  tablecache_count = 0;
+  tablecache_size = 0;
+  tablecache_rootleaf = FALSE;
+  tablecache_valid = FALSE;
+}
+
+/* strmemo_print():
+   Print the start of the compressed string at *addrp from the
+   predecoded index or the memo, building a memo if there is neither.
+   Returns TRUE if that finished the string. Otherwise, *addrp and
+   *bitnump are left where decoding should continue (which is unchanged
+   if the string can't be memoized).
+*/
+static int strmemo_print(glui32 *addrp, int *bitnump)
+{
+  strmemo_t *memo;
+#if STRING_PREDECODE
+  predecoded_t *pre;
+#endif /* STRING_PREDECODE */
+
+  if (*addrp >= ramstart)
+    return FALSE;
+
+#if STRING_PREDECODE
+  pre = predecode_find(*addrp);
+  if (pre) {
+    strmemo_emit(pre->text, pre->len, pre->isuni);
+    if (pre->done)
+      return TRUE;
+    *addrp = pre->resaddr;
+    *bitnump = pre->resbit;
+    return FALSE;
+  }
+#endif /* STRING_PREDECODE */
+
+  for (memo = strmemo_hash[STRMEMO_HASH(*addrp)]; memo; memo = memo->hashnext) {
+    if (memo->addr == *addrp)
+      break;
+  }
+
+  if (memo) {
+    /* Move it to the front of the list. */
+    if (memo != strmemo_head) {
+      memo->prev->next = memo->next;
+      if (memo->next)
+        memo->next->prev = memo->prev;
+      else
+        strmemo_tail = memo->prev;
+      memo->prev = NULL;
+      memo->next = strmemo_head;
+      strmemo_head->prev = memo;
+      strmemo_head = memo;
     }
   }
-  glulx_free(cablist);
+  else {
+    if (!string_memo_budget)
+      return FALSE;
+    memo = strmemo_build(*addrp);
+    if (!memo)
+      return FALSE;
+  }
+
+  strmemo_emit(memo->text, memo->len, memo->isuni);
+
+  if (memo->done)
+    return TRUE;
+  *addrp = memo->resaddr;
+  *bitnump = memo->resbit;
+  return FALSE;
 }
 
-/* This misbehaves if a Glk function has more than one S argument. */
+/* strmemo_emit():
+   Send a run of decoded text (from a memo, or from the predecoded
+   index) to the output buffer, or straight to Glk if it's too long to
+   fit.
+*/
+static void strmemo_emit(void *text, glui32 len, int isuni)
+{
+  glui32 ix;
+
+  profile_strcount(profstr_Chars, len);
+  profile_strcount(profstr_MemoHits, 1);
+  if (len > OUTBUF_SIZE) {
+    /* Too big for the buffer, so print it directly. */
+    stream_flush_output();
+    if (!isuni) {
+      glk_put_buffer((char *)text, len);
+    }
+    else {
+#ifdef GLK_MODULE_UNICODE
+      if (glkio_unichar_han_ptr == glk_put_char_uni) {
+        glk_put_buffer_uni((glui32 *)text, len);
+      }
+      else
+#endif /* GLK_MODULE_UNICODE */
+      {
+        for (ix=0; ix<len; ix++)
+          glkio_unichar_han_ptr(((glui32 *)text)[ix]);
+      }
+    }
+  }
+  else {
+    if (len > OUTBUF_SIZE - outbuf_len)
+      stream_flush_output();
+    if (!isuni) {
+      unsigned char *chars = (unsigned char *)text;
+      for (ix=0; ix<len; ix++)
+        outbuf[outbuf_len++] = chars[ix];
+    }
+    else {
+      glui32 *words = (glui32 *)text;
+      for (ix=0; ix<len; ix++)
+        outbuf[outbuf_len++] = words[ix];
+    }
+  }
 
-#define STATIC_TEMP_BUFSIZE (127)
-static char temp_buf[STATIC_TEMP_BUFSIZE+1];
+}
+
+/* strmemo_build():
+   Decode the compressed string at addr as far as its terminator or its
+   first indirect reference, and store the result as a new memo. Returns
+   NULL if the string is not suitable (too long, or not entirely in ROM).
+*/
+static strmemo_t *strmemo_build(glui32 addr)
+{
+  strmemo_t *memo;
+  cacheentry_t *ent;
+  glui32 pos = addr;
+  int bitnum = 0;
+  glui32 entpos;
+  int entbit;
+  glui32 len = 0;
+  glui32 maxlen = string_memo_budget / 4;
+  glui32 tmpaddr, ch, ix;
+  int jx, isuni, done;
+
+  done = FALSE;
+  while (1) {
+    entpos = pos;
+    entbit = bitnum;
+    ent = cache_lookup(&pos, &bitnum);
+
+    if (ent->type == 0x00 || ent->type > 0x05) {
+      /* An indirect reference (or something we don't recognize). Keep
+         the characters before it, and leave it for the decoder. */
+      if (ent->numchars) {
+        for (jx=0; jx<ent->numchars; jx++)
+          strmemo_addchar(&len, ent->chars[jx]);
+        bitnum += ent->chardepth[ent->numchars-1];
+        pos += (bitnum >> 3);
+        bitnum &= 7;
+      }
+      else {
+        pos = entpos;
+        bitnum = entbit;
+      }
+      break;
+    }
+
+    for (jx=0; jx<ent->numchars; jx++)
+      strmemo_addchar(&len, ent->chars[jx]);
+    bitnum += ent->numbits;
+    pos += (bitnum >> 3);
+    bitnum &= 7;
+
+    if (ent->type == 0x01) {
+      done = TRUE;
+      break;
+    }
+    switch (ent->type) {
+    case 0x04:
+      strmemo_addchar(&len, ent->u.uch);
+      break;
+    case 0x03:
+      for (tmpaddr=ent->u.addr; (ch=Mem1(tmpaddr)) != 0 && len <= maxlen; tmpaddr++) 
+        strmemo_addchar(&len, ch);
+      break;
+    case 0x05:
+      for (tmpaddr=ent->u.addr; (ch=Mem4(tmpaddr)) != 0 && len <= maxlen; tmpaddr+=4) 
+        strmemo_addchar(&len, ch);
+      break;
+    }
+
+    if (len > maxlen)
+      return NULL;
+  }
+
+  /* The bits we read must all lie in ROM, or they might change. */
+  if (pos + (bitnum ? 1 : 0) > ramstart)
+    return NULL;
+
+  isuni = FALSE;
+  for (ix=0; ix<len; ix++) {
+    if (strmemo_buf[ix] > 0xFF) {
+      isuni = TRUE;
+      break;
+    }
+  }
+
+  memo = (strmemo_t *)glulx_malloc(sizeof(strmemo_t));
+  if (!memo)
+    return NULL;
+  memo->text = NULL;
+  if (len) {
+    memo->text = glulx_malloc(len * (isuni ? 4 : 1));
+    if (!memo->text) {
+      glulx_free(memo);
+      return NULL;
+    }
+    if (isuni) {
+      for (ix=0; ix<len; ix++)
+        ((glui32 *)memo->text)[ix] = strmemo_buf[ix];
+    }
+    else {
+      for (ix=0; ix<len; ix++)
+        ((char *)memo->text)[ix] = (char)strmemo_buf[ix];
+    }
+  }
+  memo->addr = addr;
+  memo->resaddr = pos;
+  memo->resbit = bitnum;
+  memo->done = done;
+  memo->isuni = isuni;
+  memo->len = len;
+  memo->size = sizeof(strmemo_t) + len * (isuni ? 4 : 1);
+
+  memo->hashnext = strmemo_hash[STRMEMO_HASH(addr)];
+  strmemo_hash[STRMEMO_HASH(addr)] = memo;
+  memo->prev = NULL;
+  memo->next = strmemo_head;
+  if (strmemo_head)
+    strmemo_head->prev = memo;
+  else
+    strmemo_tail = memo;
+  strmemo_head = memo;
+  strmemo_total += memo->size;
+
+  /* Make room, least recently used first. (The new memo is at the
+     front, and it's less than the whole budget, so it survives.) */
+  while (strmemo_total > string_memo_budget && strmemo_tail != memo)
+    strmemo_unlink(strmemo_tail);
+
+  return memo;
+}
+
+/* strmemo_addchar():
+   Append a character to the scratch buffer used by strmemo_build().
+*/
+static void strmemo_addchar(glui32 *lenp, glui32 ch)
+{
+  if (*lenp >= strmemo_bufsize) {
+    strmemo_bufsize = (strmemo_bufsize ? strmemo_bufsize*2 : 256);
+    strmemo_buf = (glui32 *)glulx_realloc(strmemo_buf,
+      strmemo_bufsize * sizeof(glui32));
+    if (!strmemo_buf)
+      fatal_error("Unable to allocate space for string memo.");
+  }
+  strmemo_buf[*lenp] = ch;
+  (*lenp)++;
+}
+
+/* strmemo_unlink():
+   Remove a memo from the hash table and the list, and free it.
+*/
+static void strmemo_unlink(strmemo_t *memo)
+{
+  strmemo_t **mptr;
+
+  for (mptr = &(strmemo_hash[STRMEMO_HASH(memo->addr)]); *mptr; mptr = &((*mptr)->hashnext)) {
+    if (*mptr == memo) {
+      *mptr = memo->hashnext;
+      break;
+    }
+  }
+
+  if (memo->prev)
+    memo->prev->next = memo->next;
+  else
+    strmemo_head = memo->next;
+  if (memo->next)
+    memo->next->prev = memo->prev;
+  else
+    strmemo_tail = memo->prev;
+
+  strmemo_total -= memo->size;
+  if (memo->text)
+    glulx_free(memo->text);
+  glulx_free(memo);
+}
+
+/* strmemo_clear():
+   Discard all memos. This must be done whenever the decoding tables
+   change.
+*/
+static void strmemo_clear()
+{
+  while (strmemo_head)
+    strmemo_unlink(strmemo_head);
+}
+
+/* Temporary strings (for Glk string arguments) are carved out of an
+   arena, which perform_glk() resets after each call. So a Glk function
+   can have any number of string arguments, and none of them has to be
+   freed individually. The arena is a chain of blocks, newest first;
+   each new block is at least twice as big as the last, and a reset
+   frees all but the newest. So after a few calls, everything fits in
+   one block and there's no allocation at all. */
+
+typedef struct temparena_struct {
+  struct temparena_struct *next;
+  glui32 size;
+  glui32 used;
+  /* data follows */
+} temparena_t;
+
+#define TEMP_ARENA_MINSIZE (1024)
+
+static temparena_t *temp_arena = NULL;
+
+/* temp_arena_alloc():
+   Allocate len bytes from the arena, aligned for glui32 access.
+*/
+static void *temp_arena_alloc(glui32 len)
+{
+  temparena_t *block;
+  glui32 size;
+  void *res;
+
+  len = (len+7) & ~7;
+  if (!temp_arena || temp_arena->size - temp_arena->used < len) {
+    size = (temp_arena ? temp_arena->size * 2 : TEMP_ARENA_MINSIZE);
+    while (size < len)
+      size *= 2;
+    block = (temparena_t *)glulx_malloc(sizeof(temparena_t) + size);
+    if (!block)
+      fatal_error("Unable to allocate space for string argument to Glk call.");
+    block->next = temp_arena;
+    block->size = size;
+    block->used = 0;
+    temp_arena = block;
+  }
+
+  res = ((unsigned char *)(temp_arena+1)) + temp_arena->used;
+  temp_arena->used += len;
+  return res;
+}
+
+/* reset_temp_strings():
+   Discard all the temporary strings. This is called at the end of
+   every Glk call that goes through the dispatcher.
+*/
+void reset_temp_strings()
+{
+  temparena_t *block, *next;
+
+  if (!temp_arena)
+    return;
+  for (block = temp_arena->next; block; block = next) {
+    next = block->next;
+    glulx_free(block);
+  }
+  temp_arena->next = NULL;
+  temp_arena->used = 0;
+}
 
 char *make_temp_string(glui32 addr)
 {
-  int ix, len;
-  glui32 addr2;
+  glui32 len;
   char *res;
 
   if (Mem1(addr) != 0xE0)
     fatal_error("String argument to a Glk call must be unencoded.");
   addr++;
 
-  for (addr2=addr; Mem1(addr2); addr2++) { };
-  len = (addr2 - addr);
-  if (len < STATIC_TEMP_BUFSIZE) {
-    res = temp_buf;
-  }
-  else {
-    res = (char *)glulx_malloc(len+1);
-    if (!res) 
-      fatal_error("Unable to allocate space for string argument to Glk call.");
-  }
-  
-  for (ix=0, addr2=addr; ix<len; ix++, addr2++) {
-    res[ix] = Mem1(addr2);
-  }
+  len = string_span(addr);
+  res = (char *)temp_arena_alloc(len+1);
+  memcpy(res, memmap+addr, len);
   res[len] = '\0';
 
   return res;
@@ -852,42 +1831,17 @@ char *make_temp_string(glui32 addr)
 
 glui32 *make_temp_ustring(glui32 addr)
 {
-  int ix, len;
-  glui32 addr2;
+  glui32 len;
   glui32 *res;
 
   if (Mem1(addr) != 0xE2)
     fatal_error("Ustring argument to a Glk call must be unencoded.");
   addr+=4;
 
-  for (addr2=addr; Mem4(addr2); addr2+=4) { };
-  len = (addr2 - addr) / 4;
-  if ((len+1)*4 < STATIC_TEMP_BUFSIZE) {
-    res = (glui32 *)temp_buf;
-  }
-  else {
-    res = (glui32 *)glulx_malloc((len+1)*4);
-    if (!res) 
-      fatal_error("Unable to allocate space for ustring argument to Glk call.");
-  }
-  
-  for (ix=0, addr2=addr; ix<len; ix++, addr2+=4) {
-    res[ix] = Mem4(addr2);
-  }
+  len = ustring_span(addr);
+  res = (glui32 *)temp_arena_alloc((len+1)*4);
+  read_word_array(res, memmap+addr, len);
   res[len] = 0;
 
   return res;
 }
-
-void free_temp_string(char *str)
-{
-  if (str && str != temp_buf) 
-    glulx_free(str);
-}
-
-void free_temp_ustring(glui32 *str)
-{
-  if (str && str != (glui32 *)temp_buf) 
-    glulx_free(str);
-}
-
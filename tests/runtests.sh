@@ -0,0 +1,49 @@
+#!/bin/sh
+# Run the test games in this directory, and compare each one's output
+# byte for byte with what's expected.
+#
+#   NAME.ulx    the game
+#   NAME.out    the expected output (as printed with --echo)
+#   NAME.in     input lines, if the game wants any (passed with --script)
+#   NAME.log    a recorded session, for a replay test (passed with --replay)
+#
+# Each game is run three ways: plainly, with --glkdefer, and with the
+# string memo turned off. The output must be the same every time. The
+# expected output (all but replay.out) came from the interpreter as it
+# was before those options existed.
+#
+# Usage: sh tests/runtests.sh [interpreter]
+# The interpreter should be glulxe-bench, or anything else linked with
+# nullglk; the default is ./glulxe-bench.
+
+GLULXE=${1:-./glulxe-bench}
+TESTDIR=`dirname "$0"`
+TMPOUT=${TMPDIR:-/tmp}/glulxe-test.$$
+count=0
+failed=0
+
+for game in "$TESTDIR"/*.ulx; do
+  name=`basename "$game" .ulx`
+  base="$TESTDIR/$name"
+  for opts in "" "--glkdefer" "--strmemo 0"; do
+    args="--echo $opts"
+    if [ -f "$base.in" ]; then
+      args="$args --script $base.in"
+    fi
+    if [ -f "$base.log" ]; then
+      args="$args --replay $base.log"
+    fi
+    "$GLULXE" $args "$game" > "$TMPOUT" 2>&1 < /dev/null
+    count=`expr $count + 1`
+    if cmp -s "$TMPOUT" "$base.out"; then
+      :
+    else
+      echo "FAILED: $name $opts"
+      failed=`expr $failed + 1`
+    fi
+  done
+done
+
+rm -f "$TMPOUT"
+echo "$count runs, $failed failed."
+test $failed -eq 0
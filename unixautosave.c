@@ -490,8 +490,14 @@ static void recover_extra_state(extra_state_data_t *state)
     stream_set_table(state->stringtable);
 
     if (state->accel_params) {
-        for (int ix=0; ix<state->accel_param_count; ix++) {
-            accel_set_param(ix, state->accel_params[ix].param);
+        /* An autosave from an older interpreter has fewer params (the
+           spec's nine, say). The missing ones, and any that were still
+           zero, keep the values they got at startup. Extra ones from a
+           newer interpreter are ignored. */
+        glui32 count = accel_get_param_count();
+        for (int ix=0; ix<state->accel_param_count && ix<count; ix++) {
+            if (state->accel_params[ix].param)
+                accel_set_param(ix, state->accel_params[ix].param);
         }
     }
 
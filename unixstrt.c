@@ -5,12 +5,17 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
 #include "glk.h"
 #include "gi_blorb.h"
 #include "glulxe.h"
 #include "unixstrt.h"
 #include "glkstart.h" /* This comes with the Glk library. */
 
+#if ACCEL_PLUGINS
+#include <dlfcn.h>
+#endif /* ACCEL_PLUGINS */
+
 #if VM_DEBUGGER
 /* This header file may come with the Glk library. If it doesn't, comment
    out VM_DEBUGGER in glulxe.h -- you won't be able to use debugging. */
@@ -20,6 +25,11 @@
 static void glkunix_game_select(glui32 selector, glui32 arg0, glui32 arg1, glui32 arg2);
 static void glkunix_game_start(void);
 static void glkunix_game_autorestore(void);
+static void glkunix_glkstats_dump(void);
+static void glkunix_glkstats_signal(int sig);
+
+/* The file which --glkstats reports are written to. */
+static char *glkstats_filename = NULL;
 
 /* The only command-line arguments are the filename and the number of
    undo states. And the profiling switch, if that's compiled in. The
@@ -35,6 +45,16 @@ glkunix_argumentlist_t glkunix_arguments[] = {
 
   { "--undo", glkunix_arg_ValueFollows, "Number of undo states to store." },
   { "--rngseed", glkunix_arg_ValueFollows, "Fix initial RNG if nonzero." },
+  { "--accelscan", glkunix_arg_ValueFollows, "Accelerate functions which match a fingerprint file (or \"builtin\" for the standard veneer functions)." },
+  { "--acceltrain", glkunix_arg_ValueFollows, "Write fingerprints of accelerated functions to a file." },
+#if ACCEL_PLUGINS
+  { "--accelplugin", glkunix_arg_ValueFollows, "Load accelerated functions from a shared library." },
+#endif /* ACCEL_PLUGINS */
+  { "--strmemo", glkunix_arg_ValueFollows, "Memory for caching decoded strings, in bytes (0 to disable)." },
+  { "--glkstats", glkunix_arg_ValueFollows, "Write Glk call counts and timings to a file at exit (or on SIGUSR1)." },
+  { "--glkdefer", glkunix_arg_NoValue, "Queue up Glk output calls and send them to the library just before input." },
+  { "--record", glkunix_arg_ValueFollows, "Record input events to a file, for --replay. (Requires --rngseed; random numbers are then always seeded.)" },
+  { "--replay", glkunix_arg_ValueFollows, "Replay input events from a --record file, then exit." },
 
 #if GLKUNIX_AUTOSAVE_FEATURES
   { "--autosave", glkunix_arg_NoValue, "Autosave every turn." },
@@ -47,8 +67,13 @@ glkunix_argumentlist_t glkunix_arguments[] = {
 #if VM_PROFILING
   { "--profile", glkunix_arg_ValueFollows, "Generate profiling information to a file." },
   { "--profcalls", glkunix_arg_NoValue, "Include what-called-what details in profiling. (Slow!)" },
+  { "--strprofile", glkunix_arg_ValueFollows, "Generate string-decoding statistics to a file." },
 #endif /* VM_PROFILING */
 
+#if STRING_PREDECODE
+  { "--predecode", glkunix_arg_NoValue, "Decode compressed strings in the background at startup." },
+#endif /* STRING_PREDECODE */
+
 #if VM_DEBUGGER
   { "--gameinfo", glkunix_arg_ValueFollows, "Read debug information from a file." },
   { "--cpu", glkunix_arg_NoValue, "Display CPU usage of each command (debug)." },
@@ -72,6 +97,8 @@ int glkunix_startup_code(glkunix_startup_t *data)
   int gameinfoloaded = FALSE;
   int pref_autosave = FALSE;
   int pref_autorestore = FALSE;
+  int pref_eventlog = FALSE;
+  int pref_record = FALSE;
   unsigned char buf[12];
   int res;
 
@@ -108,6 +135,125 @@ int glkunix_startup_code(glkunix_startup_t *data)
       continue;
     }
 
+    if (!strcmp(data->argv[ix], "--accelscan")) {
+      ix++;
+      if (ix<data->argc) {
+        strid_t scanstr;
+        int sres;
+        if (!strcmp(data->argv[ix], "builtin")) {
+          accel_builtin_scan = TRUE;
+          continue;
+        }
+        scanstr = glkunix_stream_open_pathname_gen(data->argv[ix], FALSE, TRUE, 1);
+        if (!scanstr) {
+          init_err = "Unable to open fingerprint file.";
+          init_err2 = data->argv[ix];
+          return TRUE;
+        }
+        sres = accel_load_fingerprints(scanstr);
+        glk_stream_close(scanstr, NULL);
+        if (!sres) {
+          init_err = "Unable to parse fingerprint file.";
+          init_err2 = data->argv[ix];
+          return TRUE;
+        }
+      }
+      continue;
+    }
+    if (!strcmp(data->argv[ix], "--acceltrain")) {
+      ix++;
+      if (ix<data->argc) {
+        strid_t trainstr = glkunix_stream_open_pathname_gen(data->argv[ix], TRUE, TRUE, 1);
+        if (!trainstr) {
+          init_err = "Unable to open fingerprint output file.";
+          init_err2 = data->argv[ix];
+          return TRUE;
+        }
+        accel_set_train_stream(trainstr);
+      }
+      continue;
+    }
+#if ACCEL_PLUGINS
+    if (!strcmp(data->argv[ix], "--accelplugin")) {
+      ix++;
+      if (ix<data->argc) {
+        void *handle = dlopen(data->argv[ix], RTLD_NOW | RTLD_LOCAL);
+        glulxe_accel_plugin_init_t initfunc;
+        if (!handle) {
+          init_err = "Unable to load accelerator plugin.";
+          init_err2 = data->argv[ix];
+          return TRUE;
+        }
+        initfunc = (glulxe_accel_plugin_init_t)dlsym(handle, GLULXE_ACCEL_PLUGIN_INIT_NAME);
+        if (!initfunc) {
+          init_err = "Accelerator plugin has no init function.";
+          init_err2 = data->argv[ix];
+          return TRUE;
+        }
+        if (!accel_load_plugin(initfunc)) {
+          init_err = "Accelerator plugin failed to start.";
+          init_err2 = data->argv[ix];
+          return TRUE;
+        }
+      }
+      continue;
+    }
+#endif /* ACCEL_PLUGINS */
+
+    if (!strcmp(data->argv[ix], "--strmemo")) {
+      ix++;
+      if (ix<data->argc) {
+        char *endptr = NULL;
+        long val = strtol(data->argv[ix], &endptr, 10);
+        if (*endptr || val < 0) {
+          init_err = "--strmemo must be a non-negative number.";
+          return TRUE;
+        }
+        string_memo_budget = val;
+      }
+      continue;
+    }
+
+    if (!strcmp(data->argv[ix], "--glkstats")) {
+      ix++;
+      if (ix<data->argc) {
+        glkstats_filename = data->argv[ix];
+        setup_glkstats(&glkunix_glkstats_dump);
+#ifdef SIGUSR1
+        signal(SIGUSR1, &glkunix_glkstats_signal);
+#endif /* SIGUSR1 */
+      }
+      continue;
+    }
+
+    if (!strcmp(data->argv[ix], "--glkdefer")) {
+      setup_glkdefer();
+      continue;
+    }
+
+    if (!strcmp(data->argv[ix], "--record")
+      || !strcmp(data->argv[ix], "--replay")) {
+      int replay = !strcmp(data->argv[ix], "--replay");
+      pref_record = !replay;
+      ix++;
+      if (ix<data->argc) {
+        strid_t logstr;
+        if (pref_eventlog) {
+          init_err = "You may only use one of --record and --replay.";
+          return TRUE;
+        }
+        logstr = glkunix_stream_open_pathname_gen(data->argv[ix], !replay, FALSE, 1);
+        if (!logstr) {
+          init_err = (replay ? "Unable to open replay file." : "Unable to open record file.");
+          init_err2 = data->argv[ix];
+          return TRUE;
+        }
+        setup_glkrecord(logstr, replay);
+        pref_eventlog = TRUE;
+      }
+      continue;
+    }
+
 #if GLKUNIX_AUTOSAVE_FEATURES
     if (!strcmp(data->argv[ix], "--autosave")) {
       pref_autosave = TRUE;
@@ -155,8 +301,28 @@ int glkunix_startup_code(glkunix_startup_t *data)
       profile_set_call_counts(TRUE);
       continue;
     }
+    if (!strcmp(data->argv[ix], "--strprofile")) {
+      ix++;
+      if (ix<data->argc) {
+        strid_t profstr = glkunix_stream_open_pathname_gen(data->argv[ix], TRUE, FALSE, 1);
+        if (!profstr) {
+          init_err = "Unable to open string profile output file.";
+          init_err2 = data->argv[ix];
+          return TRUE;
+        }
+        setup_string_profile(profstr);
+      }
+      continue;
+    }
 #endif /* VM_PROFILING */
 
+#if STRING_PREDECODE
+    if (!strcmp(data->argv[ix], "--predecode")) {
+      predecode_enabled = TRUE;
+      continue;
+    }
+#endif /* STRING_PREDECODE */
+
 #if VM_DEBUGGER
     if (!strcmp(data->argv[ix], "--gameinfo")) {
       ix++;
@@ -194,6 +360,11 @@ int glkunix_startup_code(glkunix_startup_t *data)
     init_err = "You must supply the name of a game file.";
     return TRUE;
   }
+
+  if (pref_record && !init_rng_seed) {
+    init_err = "--record requires a nonzero --rngseed, so that the replay gets the same random numbers.";
+    return TRUE;
+  }
     
   gamefile = glkunix_stream_open_pathname(filename, FALSE, 1);
   if (!gamefile) {
@@ -321,3 +492,26 @@ static void glkunix_game_autorestore()
 }
 
 #endif /* GLKUNIX_AUTOSAVE_FEATURES */
+
+/* Write a --glkstats report, replacing whatever the file held before.
+   Called at exit, and at the first Glk call after a SIGUSR1. */
+static void glkunix_glkstats_dump()
+{
+  strid_t str = glkunix_stream_open_pathname_gen(glkstats_filename, TRUE, TRUE, 1);
+  if (!str) {
+    nonfatal_warning("Unable to open Glk statistics file.");
+    return;
+  }
+  glkstats_write(str);
+  glk_stream_close(str, NULL);
+}
+
+/* The signal handler only sets a flag; the report is written at the
+   next safe point. */
+static void glkunix_glkstats_signal(int sig)
+{
+  glkstats_dump_requested = TRUE;
+#ifdef SIGUSR1
+  signal(SIGUSR1, &glkunix_glkstats_signal);
+#endif /* SIGUSR1 */
+}
@@ -3,6 +3,7 @@
     http://eblong.com/zarf/glulx/index.html
 */
 
+#include <string.h>
 #include "glk.h"
 #include "glulxe.h"
 
@@ -118,6 +119,17 @@ void setup_vm()
   /* Set up the initial machine state. */
   vm_restart();
 
+  /* Let any accelerator plugins look at the game. */
+  accel_start_plugins();
+
+  /* If we have a catalogue of function fingerprints, look for
+     functions to accelerate which the game won't tell us about. */
+  accel_scan_functions();
+
+  /* If requested, start decoding the game's strings in the
+     background. */
+  predecode_start();
+
   /* If the debugger is compiled in, check that the debug data matches
      the game. (This only prints warnings for mismatch.) */
   debugger_check_story_file();
@@ -131,6 +143,7 @@ void setup_vm()
 */
 void finalize_vm()
 {
+  predecode_stop();
   stream_set_table(0);
 
   if (memmap) {
@@ -315,10 +328,8 @@ glui32 *pop_arguments(glui32 count, glui32 addr)
     }
   }
   else {
-    for (ix=0; ix<count; ix++) {
-      array[ix] = Mem4(addr);
-      addr += 4;
-    }
+    verify_array_addresses(addr, count, 4);
+    read_word_array(array, memmap+addr, count);
   }
 
   return array;
@@ -413,3 +424,111 @@ void verify_array_addresses(glui32 addr, glui32 count, glui32 size)
     fatal_error_i("Memory access too long", addr);
 }
 
+
+/* read_word_array(), write_word_array():
+   Copy count 32-bit words between VM memory (big-endian, at any
+   alignment) and a native glui32 array. The caller is responsible for
+   checking the VM address range.
+
+   On little-endian hosts this is a byte-swapping copy. We use SIMD
+   byte shuffles when the compiler has been told the target supports
+   them (SSE2 is always present on x86-64), and a plain loop for
+   whatever's left over. On big-endian hosts it's just memcpy(). If we
+   can't tell the host's byte order, we fall back to Read4/Write4.
+*/
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define HOST_LITTLE_ENDIAN (1)
+#elif defined(_M_IX86) || defined(_M_X64)
+#define HOST_LITTLE_ENDIAN (1)
+#elif defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define HOST_BIG_ENDIAN (1)
+#endif
+
+#ifdef HOST_LITTLE_ENDIAN
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#define HOST_SIMD (1)
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HOST_SIMD (1)
+#endif
+
+static void swap_word_array(unsigned char *dest, unsigned char *src, 
+  glui32 count)
+{
+#ifdef HOST_SIMD
+#if defined(__AVX2__)
+  const __m256i mask8 = _mm256_setr_epi8(
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+#endif /* __AVX2__ */
+#if defined(__AVX2__) || defined(__SSSE3__)
+  const __m128i mask4 = _mm_setr_epi8(
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+#endif /* __SSSE3__ */
+  __m128i val;
+#endif /* HOST_SIMD */
+
+#ifdef HOST_SIMD
+#if defined(__AVX2__)
+  for (; count >= 8; count -= 8, src += 32, dest += 32) {
+    __m256i val8 = _mm256_loadu_si256((__m256i *)src);
+    _mm256_storeu_si256((__m256i *)dest, _mm256_shuffle_epi8(val8, mask8));
+  }
+#endif /* __AVX2__ */
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+  for (; count >= 4; count -= 4, src += 16, dest += 16) {
+    val = _mm_loadu_si128((__m128i *)src);
+    _mm_storeu_si128((__m128i *)dest, _mm_shuffle_epi8(val, mask4));
+  }
+#else
+  /* Without a byte shuffle: swap the bytes in each 16-bit half, then
+     swap the halves. */
+  for (; count >= 4; count -= 4, src += 16, dest += 16) {
+    val = _mm_loadu_si128((__m128i *)src);
+    val = _mm_or_si128(_mm_slli_epi16(val, 8), _mm_srli_epi16(val, 8));
+    val = _mm_shufflelo_epi16(val, _MM_SHUFFLE(2, 3, 0, 1));
+    val = _mm_shufflehi_epi16(val, _MM_SHUFFLE(2, 3, 0, 1));
+    _mm_storeu_si128((__m128i *)dest, val);
+  }
+#endif /* __SSSE3__ */
+#endif /* HOST_SIMD */
+
+  for (; count; count--, src += 4, dest += 4) {
+    dest[0] = src[3];
+    dest[1] = src[2];
+    dest[2] = src[1];
+    dest[3] = src[0];
+  }
+}
+
+#endif /* HOST_LITTLE_ENDIAN */
+
+void read_word_array(glui32 *dest, unsigned char *src, glui32 count)
+{
+#if defined(HOST_LITTLE_ENDIAN)
+  swap_word_array((unsigned char *)dest, src, count);
+#elif defined(HOST_BIG_ENDIAN)
+  memcpy(dest, src, count*4);
+#else
+  glui32 ix;
+  for (ix=0; ix<count; ix++, src+=4)
+    dest[ix] = Read4(src);
+#endif
+}
+
+void write_word_array(unsigned char *dest, glui32 *src, glui32 count)
+{
+#if defined(HOST_LITTLE_ENDIAN)
+  swap_word_array(dest, (unsigned char *)src, count);
+#elif defined(HOST_BIG_ENDIAN)
+  memcpy(dest, src, count*4);
+#else
+  glui32 ix;
+  for (ix=0; ix<count; ix++, dest+=4)
+    Write4(dest, src[ix]);
+#endif
+}